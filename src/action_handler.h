@@ -13,6 +13,15 @@
 #define IPCAM_IS_ACTION_HANDLER_CLASS(klass) (G_TYPE_CHECK_CLASS_TYPE((klass), IPCAM_ACTION_HANDLER_TYPE))
 #define IPCAM_ACTION_HANDLER_GET_CLASS(obj) (G_TYPE_INSTANCE_GET_CLASS((obj), IPCAM_ACTION_HANDLER_TYPE, IpcamActionHandlerClass))
 
+/*
+ * ipcam_base_app_register_request_handler() creates a new handler for
+ * every request of the action and drops it after run().  A handler
+ * registered with ipcam_base_app_register_shared_request_handler()
+ * instead is created once and runs every request for the action, one at
+ * a time on the service thread, so its fields keep their values from one
+ * request to the next: reset any per-request state in run(), or keep it
+ * in locals.
+ */
 typedef struct _IpcamActionHandler IpcamActionHandler;
 typedef struct _IpcamActionHandlerClass IpcamActionHandlerClass;
 
@@ -1,45 +1,98 @@
 #include <string.h>
+#include <stdlib.h>
 #include "base_app.h"
 #include "config_manager.h"
 #include "timer_pump.h"
 #include "socket_manager.h"
 #include "action_handler.h"
-#include "response_message.h"
+#include "messages.h"
+#include "message_pool.h"
+#include "message_schema.h"
+#include "deadline_queue.h"
+#include "timer_spec.h"
 #include "event_handler.h"
 
 #define IPCAM_TIMER_CLIENT_NAME "_timer_client"
+/* Used when a socket has no max_size setting */
+#define IPCAM_BASE_APP_DEFAULT_MAX_SIZE (1024 * 1024)
+/* Peers beyond this many are counted together under "*" */
+#define IPCAM_BASE_APP_MAX_REJECT_PEERS 256
 
 typedef struct _IpcamBaseAppPrivate
 {
     IpcamConfigManager *config_manager;
     IpcamTimerManager *timer_manager;
     IpcamMessageManager *msg_manager;
+    IpcamMessagePool *msg_pool;
     GHashTable *req_handler_hash;
     GHashTable *not_handler_hash;
+    GHashTable *req_schema_hash;
+    GHashTable *not_schema_hash;
+    GHashTable *reject_hash;
     GMutex mutex;
+    /* Requests in flight or waiting for a slot, see ipcam_base_app_window_send() */
+    GHashTable *window_hash;
+    GHashTable *window_request_hash;
+    GMutex window_mutex;
 } IpcamBaseAppPrivate;
 
+/* A registered handler type, with its one instance if it is shared */
+typedef struct _IpcamBaseAppHandler
+{
+    GType type;
+    GObject *instance;          /* NULL to create one per message */
+} IpcamBaseAppHandler;
+
+/* One per peer: a client socket, or a client of a server socket */
+typedef struct _IpcamBaseAppWindow
+{
+    gchar *name;
+    gchar *client_id;           /* NULL on a client socket */
+    guint in_flight;
+    GQueue queue;
+} IpcamBaseAppWindow;
+
+typedef struct _IpcamBaseAppWindowRequest
+{
+    guint64 id;
+    IpcamBaseAppWindow *window;
+    /* Kept only while queued */
+    GBytes *frames[3];
+    gchar *client_id;
+} IpcamBaseAppWindowRequest;
+
 G_DEFINE_TYPE_WITH_PRIVATE(IpcamBaseApp, ipcam_base_app, IPCAM_SERVICE_TYPE);
 
-static void ipcam_base_app_server_receive_string_impl(IpcamService *self,
-                                                      const gchar *name,
-                                                      const gchar *client_id,
-                                                      const gchar *string);
-static void ipcam_base_app_client_receive_string_impl(IpcamService *self,
-                                                      const gchar *name,
-                                                      const gchar *string);
+static void ipcam_base_app_server_receive_bytes_impl(IpcamService *self,
+                                                     const gchar *name,
+                                                     GBytes *client_id,
+                                                     GBytes *data[]);
+static void ipcam_base_app_client_receive_bytes_impl(IpcamService *self,
+                                                     const gchar *name,
+                                                     GBytes *data[]);
 static void ipcam_base_app_connect_to_timer(IpcamBaseApp *base_app);
+static gboolean ipcam_base_app_local_timers(IpcamBaseApp *base_app);
 static void ipcam_base_app_load_config(IpcamBaseApp *base_app);
 static void ipcam_base_app_apply_config(IpcamBaseApp *base_app);
-static void ipcam_base_app_message_manager_clear(GObject *base_app);
-static void ipcam_base_app_on_timer(IpcamBaseApp *base_app, const gchar *timer_id);
-static void ipcam_base_app_receive_string(IpcamBaseApp *base_app,
-                                          const gchar *string,
-                                          const gchar *name,
-                                          const gint type,
-                                          const gchar *client_id);
+static void ipcam_base_app_prepare_poll_impl(IpcamBaseService *self, gint *timeout);
+static void ipcam_base_app_on_timer(IpcamBaseApp *base_app, const gchar *timer_id, gint64 lateness);
+static void ipcam_base_app_receive_data(IpcamBaseApp *base_app,
+                                        GBytes *data[],
+                                        const gchar *name,
+                                        const gint type,
+                                        GBytes *client_id);
 static void ipcam_base_app_action_handler(IpcamBaseApp *base_app, IpcamMessage *msg);
+static gboolean ipcam_base_app_transmit(IpcamBaseApp *base_app,
+                                        IpcamMessage *msg,
+                                        const gchar *name,
+                                        const gchar *client_id);
+static guint ipcam_base_app_window_hash(gconstpointer key);
+static gboolean ipcam_base_app_window_equal(gconstpointer a, gconstpointer b);
+static void ipcam_base_app_window_free(IpcamBaseAppWindow *window);
+static void ipcam_base_app_window_request_free(IpcamBaseAppWindowRequest *request);
+static void ipcam_base_app_window_release(guint64 msg_id, gpointer user_data);
 static void ipcam_base_app_notice_handler(IpcamBaseApp *base_app, IpcamMessage *msg);
+static void ipcam_base_app_handler_free(IpcamBaseAppHandler *handler);
 
 
 static GObject *ipcam_base_app_constructor(GType self_type,
@@ -58,7 +111,13 @@ static void ipcam_base_app_dispose(GObject *self)
 
     if (priv->config_manager) g_clear_object(&priv->config_manager);
     if (priv->timer_manager) g_clear_object(&priv->timer_manager);
-    if (priv->msg_manager) g_clear_object(&priv->msg_manager);
+    if (priv->msg_manager)
+    {
+        /* Nothing is sent for requests cancelled from here on */
+        ipcam_message_manager_set_release_func(priv->msg_manager, NULL, NULL);
+        g_clear_object(&priv->msg_manager);
+    }
+    if (priv->msg_pool) g_clear_object(&priv->msg_pool);
 
     G_OBJECT_CLASS(ipcam_base_app_parent_class)->dispose(self);
 }
@@ -68,6 +127,12 @@ static void ipcam_base_app_finalize(GObject *self)
     g_mutex_clear(&priv->mutex);
     g_hash_table_destroy(priv->req_handler_hash);
     g_hash_table_destroy(priv->not_handler_hash);
+    g_hash_table_destroy(priv->req_schema_hash);
+    g_hash_table_destroy(priv->not_schema_hash);
+    g_hash_table_destroy(priv->reject_hash);
+    g_hash_table_destroy(priv->window_request_hash);
+    g_hash_table_destroy(priv->window_hash);
+    g_mutex_clear(&priv->window_mutex);
 
     G_OBJECT_CLASS(ipcam_base_app_parent_class)->finalize(self);
 }
@@ -77,13 +142,29 @@ static void ipcam_base_app_init(IpcamBaseApp *self)
     priv->config_manager = g_object_new(IPCAM_CONFIG_MANAGER_TYPE, NULL);
     priv->timer_manager = g_object_new(IPCAM_TIMER_MANAGER_TYPE, NULL);
     priv->msg_manager = g_object_new(IPCAM_MESSAGE_MANAGER_TYPE, NULL);
-    priv->req_handler_hash = g_hash_table_new(g_str_hash, g_str_equal);
-    priv->not_handler_hash = g_hash_table_new(g_str_hash, g_str_equal);
+    priv->msg_pool = g_object_new(IPCAM_MESSAGE_POOL_TYPE, NULL);
+    priv->req_handler_hash = g_hash_table_new_full(g_direct_hash, g_direct_equal, NULL,
+                                                   (GDestroyNotify)ipcam_base_app_handler_free);
+    priv->not_handler_hash = g_hash_table_new_full(g_direct_hash, g_direct_equal, NULL,
+                                                   (GDestroyNotify)ipcam_base_app_handler_free);
+    priv->req_schema_hash = g_hash_table_new_full(g_direct_hash, g_direct_equal, NULL,
+                                                  (GDestroyNotify)ipcam_message_schema_free);
+    priv->not_schema_hash = g_hash_table_new_full(g_direct_hash, g_direct_equal, NULL,
+                                                  (GDestroyNotify)ipcam_message_schema_free);
+    priv->reject_hash = g_hash_table_new_full(g_str_hash, g_str_equal, g_free, NULL);
     g_mutex_init(&priv->mutex);
+    priv->window_hash = g_hash_table_new_full(ipcam_base_app_window_hash, ipcam_base_app_window_equal,
+                                              NULL, (GDestroyNotify)ipcam_base_app_window_free);
+    priv->window_request_hash = g_hash_table_new_full(g_int64_hash, g_int64_equal, NULL,
+                                                      (GDestroyNotify)ipcam_base_app_window_request_free);
+    g_mutex_init(&priv->window_mutex);
+    ipcam_message_manager_set_release_func(priv->msg_manager, ipcam_base_app_window_release, self);
 
     ipcam_base_app_load_config(self);
-    ipcam_base_app_connect_to_timer(self);
-    ipcam_base_app_add_timer(self, "clear_message_manager", "10", ipcam_base_app_message_manager_clear);
+    if (!ipcam_base_app_local_timers(self))
+    {
+        ipcam_base_app_connect_to_timer(self);
+    }
 
     ipcam_base_app_apply_config(self);
 }
@@ -95,28 +176,48 @@ static void ipcam_base_app_class_init(IpcamBaseAppClass *klass)
     this_class->finalize = &ipcam_base_app_finalize;
 
     IpcamServiceClass *service_class = IPCAM_SERVICE_CLASS(klass);
-    service_class->server_receive_string = &ipcam_base_app_server_receive_string_impl;
-    service_class->client_receive_string = &ipcam_base_app_client_receive_string_impl;
+    service_class->server_receive_bytes = &ipcam_base_app_server_receive_bytes_impl;
+    service_class->client_receive_bytes = &ipcam_base_app_client_receive_bytes_impl;
+
+    IpcamBaseServiceClass *base_service_class = IPCAM_BASE_SERVICE_CLASS(klass);
+    base_service_class->prepare_poll = &ipcam_base_app_prepare_poll_impl;
 }
-static void ipcam_base_app_server_receive_string_impl(IpcamService *self,
-                                                      const gchar *name,
-                                                      const gchar *client_id,
-                                                      const gchar *string)
+static void ipcam_base_app_server_receive_bytes_impl(IpcamService *self,
+                                                     const gchar *name,
+                                                     GBytes *client_id,
+                                                     GBytes *data[])
 {
-    ipcam_base_app_receive_string(IPCAM_BASE_APP(self), string, name, IPCAM_SOCKET_TYPE_SERVER, client_id);
+    g_return_if_fail(data[0]);
+    ipcam_base_app_receive_data(IPCAM_BASE_APP(self), data, name, IPCAM_SOCKET_TYPE_SERVER, client_id);
 }
-static void ipcam_base_app_client_receive_string_impl(IpcamService *self,
-                                                      const gchar *name,
-                                                      const gchar *string)
+static void ipcam_base_app_client_receive_bytes_impl(IpcamService *self,
+                                                     const gchar *name,
+                                                     GBytes *data[])
 {
     IpcamBaseApp *base_app = IPCAM_BASE_APP(self);
+
+    g_return_if_fail(data[0]);
     if (0 == strcmp(name, IPCAM_TIMER_CLIENT_NAME))
     {
-        ipcam_base_app_on_timer(base_app, string);
+        gsize length;
+        const gchar *bytes = g_bytes_get_data(data[0], &length);
+        gchar *timer_id = g_strndup(bytes, length);
+        gint64 lateness = 0;
+        if (data[1])
+        {
+            /* Older pumps send no lateness */
+            gchar *text;
+            bytes = g_bytes_get_data(data[1], &length);
+            text = g_strndup(bytes, length);
+            lateness = g_ascii_strtoll(text, NULL, 10);
+            g_free(text);
+        }
+        ipcam_base_app_on_timer(base_app, timer_id, lateness);
+        g_free(timer_id);
     }
     else
     {
-        ipcam_base_app_receive_string(base_app, string, name, IPCAM_SOCKET_TYPE_CLIENT, NULL);
+        ipcam_base_app_receive_data(base_app, data, name, IPCAM_SOCKET_TYPE_CLIENT, NULL);
     }
 }
 static void ipcam_base_app_load_config(IpcamBaseApp *base_app)
@@ -133,174 +234,713 @@ static void ipcam_base_app_connect_to_timer(IpcamBaseApp *base_app)
                                   IPCAM_TIMER_PUMP_ADDRESS,
                                   token);
 }
+/* With "timer_mode: local" no timer goes through the timer pump */
+static gboolean ipcam_base_app_local_timers(IpcamBaseApp *base_app)
+{
+    return 0 == g_strcmp0(ipcam_base_app_get_config(base_app, "timer_mode"), "local");
+}
+/*
+ * The spec as sent to the timer pump.  The period goes in seconds: a
+ * baseline pump reads it with strtol, so it gets whole seconds right and
+ * drops a sub-second timer as a removal, where "100ms" would have been
+ * 100 seconds; fractions of a second above one are truncated there.  The
+ * pump is asked for batches and lateness, which older pumps ignore.
+ */
+static gchar *ipcam_base_app_pump_spec(const gchar *interval, const IpcamTimerSpec *spec)
+{
+    const gchar *options = interval;
+    gchar period[G_ASCII_DTOSTR_BUF_SIZE];
+
+    if (spec->cron || spec->interval <= 0)
+        return g_strdup_printf("%s batch lateness", interval);
+
+    while (*options == ' ')
+        options++;
+    while (*options && *options != ' ')
+        options++;
+    if (0 == spec->interval % G_TIME_SPAN_SECOND)
+        g_snprintf(period, sizeof(period), "%" G_GINT64_FORMAT, spec->interval / G_TIME_SPAN_SECOND);
+    else
+        g_ascii_formatd(period, sizeof(period), "%.6f", (gdouble)spec->interval / G_TIME_SPAN_SECOND);
+    return g_strdup_printf("%s%s batch lateness", period, options);
+}
+/*
+ * interval is a timer spec: a period in seconds unless suffixed, e.g.
+ * "100ms", or a cron line, optionally "once" or jittered; see timer_spec.h.
+ * "0" removes the timer.  Through a baseline timer pump only whole
+ * seconds work: a sub-second period registers nothing there, use
+ * "timer_mode: local" for those.
+ */
 void ipcam_base_app_add_timer(IpcamBaseApp *base_app,
                               const gchar *timer_id,
                               const gchar *interval,
                               TCFunc callback)
 {
     IpcamBaseAppPrivate *priv = ipcam_base_app_get_instance_private(base_app);
-    ipcam_timer_manager_add_timer(priv->timer_manager, timer_id, G_OBJECT(base_app), callback);
+    IpcamTimerSpec spec;
+    gboolean removal = FALSE, once = FALSE;
+    gchar *spec_text;
+
+    /* A period of 0 and no cron line, "0", removes the timer */
+    if (ipcam_timer_spec_parse(interval, &spec))
+    {
+        removal = (spec.interval <= 0 && NULL == spec.cron);
+        once = spec.once;
+    }
+    if (removal)
+        ipcam_timer_manager_del_timer(priv->timer_manager, timer_id);
+    if (ipcam_base_app_local_timers(base_app))
+    {
+        ipcam_timer_spec_clear(&spec);
+        if (!removal)
+            ipcam_base_app_add_local_timer(base_app, timer_id, interval, callback);
+        return;
+    }
+    /* A malformed spec is passed on, for the pump to refuse */
+    spec_text = removal ? g_strdup(interval) : ipcam_base_app_pump_spec(interval, &spec);
+    ipcam_timer_spec_clear(&spec);
+    if (!removal &&
+        ipcam_timer_manager_add_timer(priv->timer_manager, timer_id, G_OBJECT(base_app), callback) &&
+        once)
+    {
+        ipcam_timer_manager_set_once(priv->timer_manager, timer_id);
+    }
+    /* Batched fires are unpacked by IpcamService */
     const gchar **strings = (const gchar **)g_new(gpointer, 3);
     strings[0] = timer_id;
-    strings[1] = interval;
+    strings[1] = spec_text;
     strings[2] = NULL;
     const gchar *token = ipcam_base_app_get_config(base_app, "token");
     ipcam_service_send_strings(IPCAM_SERVICE(base_app), IPCAM_TIMER_CLIENT_NAME, strings, token);
     g_free(strings);
+    g_free(spec_text);
 }
-static void ipcam_base_app_message_manager_clear(GObject *base_app)
+/*
+ * Runs on the service thread and needs no timer pump.  A timer added
+ * from another thread while the loop is polling may start up to one
+ * poll period late.
+ */
+gboolean ipcam_base_app_add_local_timer(IpcamBaseApp *base_app,
+                                        const gchar *timer_id,
+                                        const gchar *interval,
+                                        TCFunc callback)
 {
-    g_return_if_fail(IPCAM_IS_BASE_APP(base_app));
-    IpcamBaseAppPrivate *priv = ipcam_base_app_get_instance_private(IPCAM_BASE_APP(base_app));
-    ipcam_message_manager_clear(priv->msg_manager);
+    g_return_val_if_fail(IPCAM_IS_BASE_APP(base_app), FALSE);
+    IpcamBaseAppPrivate *priv = ipcam_base_app_get_instance_private(base_app);
+    return ipcam_timer_manager_add_local_timer(priv->timer_manager, timer_id, interval,
+                                               G_OBJECT(base_app), callback);
+}
+/*
+ * Times out pending requests, fires local timers and wakes the poll for
+ * whichever deadline comes next.  The parent flushes batches last, so
+ * whatever the callbacks queued counts towards its timeout too.
+ */
+static void ipcam_base_app_prepare_poll_impl(IpcamBaseService *self, gint *timeout)
+{
+    IpcamBaseAppPrivate *priv = ipcam_base_app_get_instance_private(IPCAM_BASE_APP(self));
+    IpcamBaseServiceClass *parent_class = IPCAM_BASE_SERVICE_CLASS(ipcam_base_app_parent_class);
+    gint64 now, next;
+
+    now = g_get_monotonic_time();
+    next = MIN(ipcam_message_manager_expire(priv->msg_manager, now),
+               ipcam_timer_manager_dispatch(priv->timer_manager, now));
+    if (next != IPCAM_DEADLINE_QUEUE_NONE && (next - now) / 1000 < *timeout)
+        *timeout = next > now ? (gint)((next - now + 999) / 1000) : 0;
+
+    /* Only ever lowers the timeout */
+    if (parent_class->prepare_poll)
+        parent_class->prepare_poll(self, timeout);
 }
-static void ipcam_base_app_on_timer(IpcamBaseApp *base_app, const gchar *timer_id)
+static void ipcam_base_app_on_timer(IpcamBaseApp *base_app, const gchar *timer_id, gint64 lateness)
 {
     IpcamBaseAppPrivate *priv = ipcam_base_app_get_instance_private(base_app);
-    ipcam_timer_manager_trig_timer(priv->timer_manager, timer_id);
+    ipcam_timer_manager_fire_timer(priv->timer_manager, timer_id, lateness);
 }
-static void ipcam_base_app_receive_string(IpcamBaseApp *base_app,
-                                          const gchar *string,
-                                          const gchar *name,
-                                          const gint type,
-                                          const gchar *client_id)
+/* How late, in microseconds, the timer's current or last fire was */
+gint64 ipcam_base_app_get_timer_lateness(IpcamBaseApp *base_app, const gchar *timer_id)
 {
-    IpcamMessage *msg = ipcam_message_parse_from_string(string);
-    if (msg)
+    g_return_val_if_fail(IPCAM_IS_BASE_APP(base_app), 0);
+    IpcamBaseAppPrivate *priv = ipcam_base_app_get_instance_private(base_app);
+    return ipcam_timer_manager_get_lateness(priv->timer_manager, timer_id);
+}
+/*
+ * Counts a dropped message against the peer that sent it: the client id
+ * on server sockets, the socket name otherwise.  Only the first reject of
+ * a peer is logged, so a flooding peer cannot flood the log too.
+ */
+static void ipcam_base_app_reject(IpcamBaseApp *base_app,
+                                  const gchar *name,
+                                  GBytes *client_id,
+                                  const gchar *reason)
+{
+    IpcamBaseAppPrivate *priv = ipcam_base_app_get_instance_private(base_app);
+    gchar *peer;
+    guint count;
+
+    if (client_id)
     {
-        if (type == IPCAM_SOCKET_TYPE_SERVER && NULL != client_id)
-        {
-            gchar *strval;
-            g_object_get(G_OBJECT(msg), "token", &strval, NULL);
-            if (0 != strcmp(client_id, strval))
-            {
-                g_object_unref(msg);
-                g_free(strval);
-                return;
-            }
-            g_free(strval);
-        }
+        gsize size;
+        const gchar *id = g_bytes_get_data(client_id, &size);
+        peer = g_strndup(id, size);
+    }
+    else
+    {
+        peer = g_strdup(name);
+    }
 
-        if (ipcam_message_is_request(msg))
-        {
-            ipcam_base_app_action_handler(base_app, msg);
-        }
-        else if (ipcam_message_is_notice(msg))
-        {
-            ipcam_base_app_notice_handler(base_app, msg);
-        }
-        else if (ipcam_message_is_response(msg))
-        {
-            IpcamBaseAppPrivate *priv = ipcam_base_app_get_instance_private(base_app);
-            ipcam_message_manager_handle(priv->msg_manager, msg);
-        }
-        else
+    g_mutex_lock(&priv->mutex);
+    if (!g_hash_table_contains(priv->reject_hash, peer) &&
+        g_hash_table_size(priv->reject_hash) >= IPCAM_BASE_APP_MAX_REJECT_PEERS)
+    {
+        g_free(peer);
+        peer = g_strdup("*");
+    }
+    count = GPOINTER_TO_UINT(g_hash_table_lookup(priv->reject_hash, peer)) + 1;
+    g_hash_table_insert(priv->reject_hash, g_strdup(peer), GUINT_TO_POINTER(count));
+    g_mutex_unlock(&priv->mutex);
+
+    if (1 == count)
+    {
+        g_warning("Rejected %s from '%s' on '%s'.\n", reason, peer, name);
+    }
+    g_free(peer);
+}
+static const IpcamMessageSchema *ipcam_base_app_lookup_schema(IpcamBaseApp *base_app, IpcamMessage *msg)
+{
+    IpcamBaseAppPrivate *priv = ipcam_base_app_get_instance_private(base_app);
+    GHashTable *hash;
+    GQuark name;
+    const IpcamMessageSchema *schema;
+
+    switch (ipcam_message_get_kind(msg))
+    {
+    case IPCAM_MESSAGE_KIND_REQUEST:
+        hash = priv->req_schema_hash;
+        name = ipcam_request_message_get_action_quark(IPCAM_REQUEST_MESSAGE(msg));
+        break;
+    case IPCAM_MESSAGE_KIND_NOTICE:
+        hash = priv->not_schema_hash;
+        name = ipcam_notice_message_get_event_quark(IPCAM_NOTICE_MESSAGE(msg));
+        break;
+    default:
+        return NULL;
+    }
+    if (0 == name)
+        return NULL;
+
+    /* Schemas are never replaced, so the pointer stays good after unlocking */
+    g_mutex_lock(&priv->mutex);
+    schema = g_hash_table_lookup(hash, GUINT_TO_POINTER(name));
+    g_mutex_unlock(&priv->mutex);
+
+    return schema;
+}
+static gboolean ipcam_base_app_client_id_matches(GBytes *client_id, const gchar *token)
+{
+    gsize size;
+    const gchar *id = g_bytes_get_data(client_id, &size);
+    return NULL != token && strlen(token) == size && 0 == memcmp(id, token, size);
+}
+static void ipcam_base_app_receive_data(IpcamBaseApp *base_app,
+                                        GBytes *data[],
+                                        const gchar *name,
+                                        const gint type,
+                                        GBytes *client_id)
+{
+    IpcamBaseAppPrivate *priv = ipcam_base_app_get_instance_private(base_app);
+    const IpcamMessageSchema *schema;
+    IpcamMessage *msg;
+    gsize max_size, size = 0;
+    gint i;
+
+    /* Oversized input is dropped before any of it is parsed */
+    max_size = ipcam_service_get_socket_option(IPCAM_SERVICE(base_app), name, IPCAM_SOCKET_OPTION_MAX_SIZE);
+    if (0 == max_size)
+        max_size = IPCAM_BASE_APP_DEFAULT_MAX_SIZE;
+    for (i = 0; data[i]; i++)
+        size += g_bytes_get_size(data[i]);
+    if (size > max_size)
+    {
+        ipcam_base_app_reject(base_app, name, client_id, "an oversized message");
+        return;
+    }
+
+    /* Two frames are a split head and body, the body stays unread here */
+    if (data[1])
+    {
+        msg = ipcam_message_pool_parse_from_frames(priv->msg_pool, data[0], data[1]);
+    }
+    else
+    {
+        msg = ipcam_message_pool_parse_from_bytes(priv->msg_pool, data[0]);
+    }
+    if (NULL == msg)
+    {
+        ipcam_base_app_reject(base_app, name, client_id, "a malformed message");
+        return;
+    }
+
+    if (type == IPCAM_SOCKET_TYPE_SERVER && NULL != client_id)
+    {
+        if (!ipcam_base_app_client_id_matches(client_id, ipcam_message_get_token(msg)))
         {
-            // do nothing
+            ipcam_base_app_reject(base_app, name, client_id, "a message with a wrong token");
+            g_object_unref(msg);
+            return;
         }
+    }
 
+    schema = ipcam_base_app_lookup_schema(base_app, msg);
+    if (schema && !ipcam_message_validate_body(msg, schema))
+    {
+        ipcam_base_app_reject(base_app, name, client_id, "a message with an invalid body");
         g_object_unref(msg);
+        return;
     }
+
+    switch (ipcam_message_get_kind(msg))
+    {
+    case IPCAM_MESSAGE_KIND_REQUEST:
+        ipcam_base_app_action_handler(base_app, msg);
+        break;
+    case IPCAM_MESSAGE_KIND_NOTICE:
+        ipcam_base_app_notice_handler(base_app, msg);
+        break;
+    case IPCAM_MESSAGE_KIND_RESPONSE:
+        ipcam_message_manager_handle(priv->msg_manager, msg);
+        break;
+    default:
+        // do nothing
+        break;
+    }
+
+    g_object_unref(msg);
 }
-static void ipcam_base_app_action_handler(IpcamBaseApp *base_app, IpcamMessage *msg)
+static void ipcam_base_app_handler_free(IpcamBaseAppHandler *handler)
+{
+    if (handler->instance)
+        g_object_unref(handler->instance);
+    g_free(handler);
+}
+/* The handler to run one message through, a new one unless it is shared */
+static GObject *ipcam_base_app_get_handler(IpcamBaseApp *base_app, GHashTable *handler_hash, GQuark name)
 {
-    GType action_handler_class_type = G_TYPE_INVALID;
-    gchar *strval;
-    g_object_get(G_OBJECT(msg), "action", &strval, NULL);
     IpcamBaseAppPrivate *priv = ipcam_base_app_get_instance_private(base_app);
+    IpcamBaseAppHandler *handler;
+    GObject *instance = NULL;
+    GType type = G_TYPE_INVALID;
 
     g_mutex_lock(&priv->mutex);
-    action_handler_class_type = (GType)g_hash_table_lookup(priv->req_handler_hash, (gpointer)strval);
+    handler = g_hash_table_lookup(handler_hash, GUINT_TO_POINTER(name));
+    if (handler && handler->instance)
+        instance = g_object_ref(handler->instance);
+    else if (handler)
+        type = handler->type;
     g_mutex_unlock(&priv->mutex);
 
-    g_free(strval);
-    if (G_TYPE_INVALID != action_handler_class_type)
+    if (G_TYPE_INVALID != type)
+        instance = g_object_new(type, "service", base_app, NULL);
+    return instance;
+}
+static void ipcam_base_app_register_handler(IpcamBaseApp *base_app,
+                                            GHashTable *handler_hash,
+                                            const gchar *handler_name,
+                                            GType handler_class_type,
+                                            gboolean shared)
+{
+    IpcamBaseAppPrivate *priv = ipcam_base_app_get_instance_private(base_app);
+    gpointer key = GUINT_TO_POINTER(g_quark_from_string(handler_name));
+    IpcamBaseAppHandler *handler;
+
+    g_mutex_lock(&priv->mutex);
+    if (!g_hash_table_contains(handler_hash, key))
+    {
+        handler = g_new0(IpcamBaseAppHandler, 1);
+        handler->type = handler_class_type;
+        if (shared)
+            handler->instance = g_object_new(handler_class_type, "service", base_app, NULL);
+        g_hash_table_insert(handler_hash, key, handler);
+    }
+    g_mutex_unlock(&priv->mutex);
+}
+static void ipcam_base_app_action_handler(IpcamBaseApp *base_app, IpcamMessage *msg)
+{
+    GObject *handler = NULL;
+    GQuark action = ipcam_request_message_get_action_quark(IPCAM_REQUEST_MESSAGE(msg));
+    IpcamBaseAppPrivate *priv = ipcam_base_app_get_instance_private(base_app);
+
+    /* A name nobody registered was never interned, so it has no handler */
+    if (0 == action)
+        return;
+
+    handler = ipcam_base_app_get_handler(base_app, priv->req_handler_hash, action);
+
+    if (handler)
     {
-        IpcamActionHandler *handler = g_object_new(action_handler_class_type, "service", base_app, NULL);
         if (IPCAM_IS_ACTION_HANDLER(handler))
         {
-            ipcam_action_handler_run(handler, msg);
+            ipcam_action_handler_run(IPCAM_ACTION_HANDLER(handler), msg);
         }
         g_object_unref(handler);
     }
 }
 static void ipcam_base_app_notice_handler(IpcamBaseApp *base_app, IpcamMessage *msg)
 {
-    GType event_handler_class_type = G_TYPE_INVALID;
-    gchar *strval;
-    g_object_get(G_OBJECT(msg), "event", &strval, NULL);
+    GObject *handler = NULL;
+    GQuark event = ipcam_notice_message_get_event_quark(IPCAM_NOTICE_MESSAGE(msg));
     IpcamBaseAppPrivate *priv = ipcam_base_app_get_instance_private(base_app);
 
-    g_mutex_lock(&priv->mutex);
-    event_handler_class_type = (GType)g_hash_table_lookup(priv->not_handler_hash, (gpointer)strval);
-    g_mutex_unlock(&priv->mutex);
+    if (0 == event)
+        return;
 
-    g_free(strval);
-    if (G_TYPE_INVALID != event_handler_class_type)
+    handler = ipcam_base_app_get_handler(base_app, priv->not_handler_hash, event);
+
+    if (handler)
     {
-        IpcamEventHandler *handler = g_object_new(event_handler_class_type, "service", base_app, NULL);
         if (IPCAM_IS_EVENT_HANDLER(handler))
         {
-            ipcam_event_handler_run(handler, msg);
+            ipcam_event_handler_run(IPCAM_EVENT_HANDLER(handler), msg);
         }
         g_object_unref(handler);
     }
 }
 
+/* A new handler for every request, see action_handler.h */
 void ipcam_base_app_register_request_handler(IpcamBaseApp *base_app,
                                              const gchar *handler_name,
                                              GType handler_class_type)
 {
     g_return_if_fail(IPCAM_IS_BASE_APP(base_app));
     IpcamBaseAppPrivate *priv = ipcam_base_app_get_instance_private(base_app);
+    ipcam_base_app_register_handler(base_app, priv->req_handler_hash,
+                                    handler_name, handler_class_type, FALSE);
+}
 
-    g_mutex_lock(&priv->mutex);
-    if (!g_hash_table_contains(priv->req_handler_hash, (gpointer)handler_name))
-        g_hash_table_insert(priv->req_handler_hash, (gpointer)handler_name, (gpointer)handler_class_type);
-    g_mutex_unlock(&priv->mutex);
+/* One handler for every request, see action_handler.h */
+void ipcam_base_app_register_shared_request_handler(IpcamBaseApp *base_app,
+                                                    const gchar *handler_name,
+                                                    GType handler_class_type)
+{
+    g_return_if_fail(IPCAM_IS_BASE_APP(base_app));
+    IpcamBaseAppPrivate *priv = ipcam_base_app_get_instance_private(base_app);
+    ipcam_base_app_register_handler(base_app, priv->req_handler_hash,
+                                    handler_name, handler_class_type, TRUE);
 }
 
+/* A new handler for every notice, see event_handler.h */
 void ipcam_base_app_register_notice_handler(IpcamBaseApp *base_app,
                                             const gchar *handler_name,
                                             GType handler_class_type)
 {
     g_return_if_fail(IPCAM_IS_BASE_APP(base_app));
     IpcamBaseAppPrivate *priv = ipcam_base_app_get_instance_private(base_app);
-
-    g_mutex_lock(&priv->mutex);
-    if (!g_hash_table_contains(priv->not_handler_hash, (gpointer)handler_name))
-        g_hash_table_insert(priv->not_handler_hash, (gpointer)handler_name, (gpointer)handler_class_type);
-    g_mutex_unlock(&priv->mutex);
+    ipcam_base_app_register_handler(base_app, priv->not_handler_hash,
+                                    handler_name, handler_class_type, FALSE);
 }
 
-void ipcam_base_app_send_message(IpcamBaseApp *base_app,
-                                 IpcamMessage *msg,
-                                 const gchar *name,
-                                 const gchar *client_id,
-                                 MsgHandler callback,
-                                 guint timeout)
+/* One handler for every notice, see event_handler.h */
+void ipcam_base_app_register_shared_notice_handler(IpcamBaseApp *base_app,
+                                                   const gchar *handler_name,
+                                                   GType handler_class_type)
 {
     g_return_if_fail(IPCAM_IS_BASE_APP(base_app));
-    g_return_if_fail(IPCAM_IS_MESSAGE(msg));
     IpcamBaseAppPrivate *priv = ipcam_base_app_get_instance_private(base_app);
+    ipcam_base_app_register_handler(base_app, priv->not_handler_hash,
+                                    handler_name, handler_class_type, TRUE);
+}
+
+/*
+ * Returns FALSE when the request was not sent because the peer's window
+ * and queue are both full; the callback is then never called.
+ */
+gboolean ipcam_base_app_send_message(IpcamBaseApp *base_app,
+                                     IpcamMessage *msg,
+                                     const gchar *name,
+                                     const gchar *client_id,
+                                     MsgHandler callback,
+                                     guint timeout)
+{
+    g_return_val_if_fail(IPCAM_IS_BASE_APP(base_app), FALSE);
+    g_return_val_if_fail(IPCAM_IS_MESSAGE(msg), FALSE);
+    IpcamBaseAppPrivate *priv = ipcam_base_app_get_instance_private(base_app);
+    if (ipcam_message_is_request(msg))
+    {
+        ipcam_message_manager_register(priv->msg_manager, msg, G_OBJECT(base_app), callback, timeout);
+    }
+    if (!ipcam_base_app_transmit(base_app, msg, name, client_id))
+    {
+        ipcam_message_manager_cancel(priv->msg_manager, msg);
+        return FALSE;
+    }
+    return TRUE;
+}
+/*
+ * Sends a request and returns a future for its response, to be released
+ * with ipcam_future_unref().  It completes on the service thread, and
+ * fails with IPCAM_FUTURE_TIMEOUT after timeout_ms, or at once with
+ * IPCAM_FUTURE_CANCELLED when the peer's window is full.  A timeout_ms
+ * of 0 or less sets no deadline.
+ */
+IpcamFuture *ipcam_base_app_send_message_future(IpcamBaseApp *base_app,
+                                                IpcamMessage *msg,
+                                                const gchar *name,
+                                                const gchar *client_id,
+                                                guint timeout_ms)
+{
+    g_return_val_if_fail(IPCAM_IS_BASE_APP(base_app), NULL);
+    g_return_val_if_fail(ipcam_message_is_request(msg), NULL);
+    IpcamBaseAppPrivate *priv = ipcam_base_app_get_instance_private(base_app);
+    IpcamFuture *future = ipcam_future_new();
+    if (!ipcam_message_manager_register_future(priv->msg_manager, msg, future, timeout_ms))
+    {
+        ipcam_future_fail(future, IPCAM_FUTURE_CANCELLED);
+        return future;
+    }
+    /* Cancelling also fails the future */
+    if (!ipcam_base_app_transmit(base_app, msg, name, client_id))
+        ipcam_message_manager_cancel(priv->msg_manager, msg);
+    return future;
+}
+/* A window is its own key, by socket name and client id */
+static guint ipcam_base_app_window_hash(gconstpointer key)
+{
+    const IpcamBaseAppWindow *window = key;
+    guint hash = g_str_hash(window->name);
+    return window->client_id ? hash * 31 + g_str_hash(window->client_id) : hash;
+}
+static gboolean ipcam_base_app_window_equal(gconstpointer a, gconstpointer b)
+{
+    const IpcamBaseAppWindow *window_a = a;
+    const IpcamBaseAppWindow *window_b = b;
+    return 0 == strcmp(window_a->name, window_b->name) &&
+        0 == g_strcmp0(window_a->client_id, window_b->client_id);
+}
+static void ipcam_base_app_window_free(IpcamBaseAppWindow *window)
+{
+    /* Its queued requests are freed with window_request_hash */
+    g_queue_clear(&window->queue);
+    g_free(window->client_id);
+    g_free(window->name);
+    g_free(window);
+}
+static void ipcam_base_app_window_request_free(IpcamBaseAppWindowRequest *request)
+{
+    gint i;
+    for (i = 0; request->frames[i]; i++)
+    {
+        g_bytes_unref(request->frames[i]);
+    }
+    g_free(request->client_id);
+    g_free(request);
+}
+/*
+ * With a "window" set on the socket, at most that many requests are
+ * outstanding toward each peer at once: the socket itself for a client
+ * socket, each client id on a server socket.  Further ones wait here, up
+ * to "window_queue" of them per peer, and go out in order as earlier ones
+ * are answered or time out.  Beyond that nothing is sent and FALSE is
+ * returned.
+ */
+static gboolean ipcam_base_app_window_send(IpcamBaseApp *base_app,
+                                           guint64 msg_id,
+                                           const gchar *name,
+                                           GBytes *frames[],
+                                           const gchar *client_id)
+{
+    IpcamBaseAppPrivate *priv = ipcam_base_app_get_instance_private(base_app);
+    IpcamService *service = IPCAM_SERVICE(base_app);
+    gint limit = ipcam_service_get_socket_option(service, name, IPCAM_SOCKET_OPTION_WINDOW);
+    gint max_queued;
+    IpcamBaseAppWindow key = {0, };
+    IpcamBaseAppWindow *window;
+    IpcamBaseAppWindowRequest *request;
+    gboolean ret = TRUE;
+    gint i;
+
+    if (limit <= 0 || 0 == msg_id)
+    {
+        return ipcam_service_queue_bytes(service, name, frames, client_id);
+    }
+    max_queued = ipcam_service_get_socket_option(service, name, IPCAM_SOCKET_OPTION_WINDOW_QUEUE);
+
+    key.name = (gchar *)name;
+    key.client_id = ipcam_service_is_server(service, name) ? (gchar *)client_id : NULL;
+
+    g_mutex_lock(&priv->window_mutex);
+    if (g_hash_table_contains(priv->window_request_hash, &msg_id))
+    {
+        /* Sent again while still tracked, it already holds a slot */
+        g_mutex_unlock(&priv->window_mutex);
+        return ipcam_service_queue_bytes(service, name, frames, client_id);
+    }
+    window = g_hash_table_lookup(priv->window_hash, &key);
+    if (NULL == window)
+    {
+        window = g_new0(IpcamBaseAppWindow, 1);
+        window->name = g_strdup(name);
+        window->client_id = g_strdup(key.client_id);
+        g_queue_init(&window->queue);
+        g_hash_table_insert(priv->window_hash, window, window);
+    }
+    if (window->in_flight >= limit && (gint)g_queue_get_length(&window->queue) >= max_queued)
+    {
+        g_mutex_unlock(&priv->window_mutex);
+        ipcam_service_add_socket_stat(service, name, IPCAM_SOCKET_STAT_WINDOW_OVERFLOW, 1);
+        return FALSE;
+    }
+    request = g_new0(IpcamBaseAppWindowRequest, 1);
+    request->id = msg_id;
+    request->window = window;
+    g_hash_table_insert(priv->window_request_hash, &request->id, request);
+    if (window->in_flight < limit)
+    {
+        window->in_flight++;
+        g_mutex_unlock(&priv->window_mutex);
+        ret = ipcam_service_queue_bytes(service, name, frames, client_id);
+    }
+    else
+    {
+        for (i = 0; frames[i]; i++)
+        {
+            request->frames[i] = g_bytes_ref(frames[i]);
+        }
+        request->client_id = g_strdup(client_id);
+        g_queue_push_tail(&window->queue, request);
+        g_mutex_unlock(&priv->window_mutex);
+    }
+    /* A very short timeout may have released it before it got in here */
+    if (!ipcam_message_manager_is_pending(priv->msg_manager, msg_id))
+    {
+        ipcam_base_app_window_release(msg_id, base_app);
+    }
+    return ret;
+}
+/* A request left the message manager: free its slot, send what now fits */
+static void ipcam_base_app_window_release(guint64 msg_id, gpointer user_data)
+{
+    IpcamBaseApp *base_app = IPCAM_BASE_APP(user_data);
+    IpcamBaseAppPrivate *priv = ipcam_base_app_get_instance_private(base_app);
+    IpcamService *service = IPCAM_SERVICE(base_app);
+    IpcamBaseAppWindowRequest *request;
+    IpcamBaseAppWindow *window;
+    GList *ready = NULL, *item;
+    gchar *name;
+    gint limit;
+
+    g_mutex_lock(&priv->window_mutex);
+    request = g_hash_table_lookup(priv->window_request_hash, &msg_id);
+    if (NULL == request)
+    {
+        g_mutex_unlock(&priv->window_mutex);
+        return;
+    }
+    window = request->window;
+    if (request->frames[0])
+    {
+        /* Timed out before it was ever sent */
+        g_queue_remove(&window->queue, request);
+    }
+    else if (window->in_flight > 0)
+    {
+        window->in_flight--;
+    }
+    g_hash_table_remove(priv->window_request_hash, &msg_id);
+
+    limit = ipcam_service_get_socket_option(service, window->name, IPCAM_SOCKET_OPTION_WINDOW);
+    while (!g_queue_is_empty(&window->queue) && (limit <= 0 || window->in_flight < limit))
+    {
+        IpcamBaseAppWindowRequest *next = g_queue_pop_head(&window->queue);
+        IpcamBaseAppWindowRequest *copy = g_new0(IpcamBaseAppWindowRequest, 1);
+        /* The frames move to the copy, the one in the table now counts as sent */
+        memcpy(copy->frames, next->frames, sizeof(next->frames));
+        memset(next->frames, 0, sizeof(next->frames));
+        copy->client_id = next->client_id;
+        next->client_id = NULL;
+        window->in_flight++;
+        ready = g_list_prepend(ready, copy);
+    }
+    name = g_strdup(window->name);
+    /* Idle windows go, a server socket may see many clients come and go */
+    if (0 == window->in_flight && g_queue_is_empty(&window->queue))
+    {
+        g_hash_table_remove(priv->window_hash, window);
+    }
+    g_mutex_unlock(&priv->window_mutex);
+
+    ready = g_list_reverse(ready);
+    for (item = ready; item; item = item->next)
+    {
+        IpcamBaseAppWindowRequest *copy = item->data;
+        ipcam_service_queue_bytes(service, name, copy->frames, copy->client_id);
+        ipcam_base_app_window_request_free(copy);
+    }
+    g_list_free(ready);
+    g_free(name);
+}
+static gboolean ipcam_base_app_transmit(IpcamBaseApp *base_app,
+                                        IpcamMessage *msg,
+                                        const gchar *name,
+                                        const gchar *client_id)
+{
     gboolean is_server = ipcam_service_is_server(IPCAM_SERVICE(base_app), name);
     const gchar *token = "";
     if (!is_server)
     {
         token = ipcam_base_app_get_config(base_app, "token");
     }
-    g_object_set(G_OBJECT(msg), "token", token, NULL);
+    ipcam_message_set_token(msg, token);
+    IpcamService *service = IPCAM_SERVICE(base_app);
+    IpcamMessageEncoding encoding =
+        ipcam_service_get_socket_option(service, name, IPCAM_SOCKET_OPTION_ENCODING);
+    IpcamMessageFraming framing =
+        ipcam_service_get_socket_option(service, name, IPCAM_SOCKET_OPTION_FRAMING);
+    IpcamMessageCompression compression = {0, };
+    GBytes *frames[3] = {NULL, };
+    gboolean ret = TRUE;
+    gint i;
+    compression.threshold = MAX(0, ipcam_service_get_socket_option(service, name, IPCAM_SOCKET_OPTION_COMPRESS_THRESHOLD));
+    ipcam_message_serialize_frames(msg, encoding, framing, &compression, frames);
+    if (compression.saved > 0)
+    {
+        ipcam_service_add_socket_stat(service, name, IPCAM_SOCKET_STAT_COMPRESSED, 1);
+        ipcam_service_add_socket_stat(service, name, IPCAM_SOCKET_STAT_BYTES_SAVED, compression.saved);
+    }
+    if (compression.time_us > 0)
+    {
+        ipcam_service_add_socket_stat(service, name, IPCAM_SOCKET_STAT_COMPRESS_TIME, compression.time_us);
+    }
     if (ipcam_message_is_request(msg))
     {
-        ipcam_message_manager_register(priv->msg_manager, msg, G_OBJECT(base_app), callback, timeout);
+        ret = ipcam_base_app_window_send(base_app,
+                                         ipcam_request_message_get_id_key(IPCAM_REQUEST_MESSAGE(msg)),
+                                         name, frames, client_id);
+    }
+    else
+    {
+        ret = ipcam_service_queue_bytes(service, name, frames, client_id);
+    }
+    for (i = 0; frames[i]; i++)
+    {
+        g_bytes_unref(frames[i]);
     }
-    gchar *strings[2];
-    strings[0] = (gchar *)ipcam_message_to_string(msg);
-    strings[1] = NULL;
-    ipcam_service_send_strings(IPCAM_SERVICE(base_app), name, strings, client_id);
-    g_free(strings[0]);
+    return ret;
 }
 
+/*
+ * Sends the message on every publisher.  It is serialized once, each
+ * socket gets a reference to the same frames.
+ */
+void ipcam_base_app_publish_message(IpcamBaseApp *base_app, IpcamMessage *msg)
+{
+    g_return_if_fail(IPCAM_IS_BASE_APP(base_app));
+    g_return_if_fail(IPCAM_IS_MESSAGE(msg));
+    GList *item;
+
+    for (item = ipcam_service_get_publish_names(IPCAM_SERVICE(base_app)); item; item = item->next)
+    {
+        ipcam_base_app_send_message(base_app, msg, (const gchar *)item->data, NULL, NULL, 0);
+    }
+}
 gboolean ipcam_base_app_wait_response(IpcamBaseApp *base_app,
                                       const char *msg_id,
                                       gint64 timeout_ms,
@@ -320,6 +960,51 @@ gboolean ipcam_base_app_wait_response(IpcamBaseApp *base_app,
 
 	return ret;
 }
+/*
+ * Sends a request and blocks the calling thread for its response, which
+ * the caller then owns.  The response is expected before the request
+ * goes out, so it cannot slip past, and each call sleeps on its own
+ * condition, woken only by its own response.  Returns FALSE after
+ * timeout_ms; a late response is then dropped.  A timeout_ms of 0 or
+ * less waits for ever, like ipcam_base_app_wait_response().  Not from
+ * the service thread, which is the one that delivers responses.
+ */
+gboolean ipcam_base_app_call(IpcamBaseApp *base_app,
+                             IpcamMessage *msg,
+                             const gchar *name,
+                             const gchar *client_id,
+                             gint64 timeout_ms,
+                             IpcamMessage **response)
+{
+	g_return_val_if_fail(IPCAM_IS_BASE_APP(base_app), FALSE);
+	g_return_val_if_fail(ipcam_message_is_request(msg), FALSE);
+	g_return_val_if_fail(response, FALSE);
+	IpcamBaseAppPrivate *priv = ipcam_base_app_get_instance_private(base_app);
+	IpcamFuture *future;
+	gboolean ret = FALSE;
+
+	*response = NULL;
+	if (pthread_equal(pthread_self(), ipcam_base_service_get_thread(IPCAM_BASE_SERVICE(base_app)))) {
+		g_warning("Should not call %s() in the same thread.\n", __func__);
+		return FALSE;
+	}
+
+	future = ipcam_future_new();
+	if (ipcam_message_manager_register_future(priv->msg_manager, msg, future, timeout_ms)) {
+		/* Cancelling fails the future, so the wait returns at once */
+		if (!ipcam_base_app_transmit(base_app, msg, name, client_id))
+			ipcam_message_manager_cancel(priv->msg_manager, msg);
+		/* Our own deadline, the manager may only notice it a poll later */
+		if (ipcam_future_wait(future, timeout_ms) &&
+		    ipcam_future_get_state(future) == IPCAM_FUTURE_DONE) {
+			*response = g_object_ref(ipcam_future_get_response(future));
+			ret = TRUE;
+		}
+	}
+	ipcam_future_unref(future);
+
+	return ret;
+}
 
 const gchar *ipcam_base_app_get_config(IpcamBaseApp *base_app,
                                        const gchar *config_name)
@@ -335,37 +1020,172 @@ GHashTable *ipcam_base_app_get_configs(IpcamBaseApp *base_app,
     IpcamBaseAppPrivate *priv = ipcam_base_app_get_instance_private(base_app);
     return ipcam_config_manager_get_collection(priv->config_manager, config_name);
 }
-static void ipcam_base_app_bind(gpointer key, gpointer value, gpointer user_data)
+static gboolean ipcam_base_app_register_schema(IpcamBaseApp *base_app,
+                                               GHashTable *hash,
+                                               const gchar *name,
+                                               const gchar *definition)
 {
-    IpcamBaseApp *base_app = IPCAM_BASE_APP(user_data);
-    ipcam_service_bind_by_name(IPCAM_SERVICE(base_app), (gchar *)key, (gchar *)value);
+    IpcamBaseAppPrivate *priv = ipcam_base_app_get_instance_private(base_app);
+    gpointer key = GUINT_TO_POINTER(g_quark_from_string(name));
+    IpcamMessageSchema *schema = ipcam_message_schema_new(definition);
+    gboolean ret = FALSE;
+
+    if (NULL == schema)
+        return FALSE;
+
+    g_mutex_lock(&priv->mutex);
+    if (!g_hash_table_contains(hash, key))
+    {
+        g_hash_table_insert(hash, key, schema);
+        schema = NULL;
+        ret = TRUE;
+    }
+    g_mutex_unlock(&priv->mutex);
+
+    ipcam_message_schema_free(schema);
+    return ret;
 }
-static void ipcam_base_app_bind_publish(gpointer key, gpointer value, gpointer user_data)
+gboolean ipcam_base_app_register_request_schema(IpcamBaseApp *base_app,
+                                                const gchar *action,
+                                                const gchar *definition)
 {
-    IpcamBaseApp *base_app = IPCAM_BASE_APP(user_data);
-    ipcam_service_publish_by_name(IPCAM_SERVICE(base_app), (gchar *)key, (gchar *)value);
+    g_return_val_if_fail(IPCAM_IS_BASE_APP(base_app), FALSE);
+    g_return_val_if_fail(action && definition, FALSE);
+    IpcamBaseAppPrivate *priv = ipcam_base_app_get_instance_private(base_app);
+    return ipcam_base_app_register_schema(base_app, priv->req_schema_hash, action, definition);
 }
-static void ipcam_base_app_connect(gpointer key, gpointer value, gpointer user_data)
+gboolean ipcam_base_app_register_notice_schema(IpcamBaseApp *base_app,
+                                               const gchar *event,
+                                               const gchar *definition)
 {
-    IpcamBaseApp *base_app = IPCAM_BASE_APP(user_data);
-    const gchar *token = ipcam_base_app_get_config(base_app, "token");
-    ipcam_service_connect_by_name(IPCAM_SERVICE(base_app), (gchar *)key, (gchar *)value, token);
+    g_return_val_if_fail(IPCAM_IS_BASE_APP(base_app), FALSE);
+    g_return_val_if_fail(event && definition, FALSE);
+    IpcamBaseAppPrivate *priv = ipcam_base_app_get_instance_private(base_app);
+    return ipcam_base_app_register_schema(base_app, priv->not_schema_hash, event, definition);
 }
-static void ipcam_base_app_subscribe(gpointer key, gpointer value, gpointer user_data)
+guint ipcam_base_app_get_reject_count(IpcamBaseApp *base_app, const gchar *peer)
 {
-    IpcamBaseApp *base_app = IPCAM_BASE_APP(user_data);
-    ipcam_service_subscirbe_by_name(IPCAM_SERVICE(base_app), (gchar *)key, (gchar *)value);
+    g_return_val_if_fail(IPCAM_IS_BASE_APP(base_app), 0);
+    IpcamBaseAppPrivate *priv = ipcam_base_app_get_instance_private(base_app);
+    guint count;
+
+    g_mutex_lock(&priv->mutex);
+    count = GPOINTER_TO_UINT(g_hash_table_lookup(priv->reject_hash, peer));
+    g_mutex_unlock(&priv->mutex);
+
+    return count;
+}
+IpcamMessagePool *ipcam_base_app_get_message_pool(IpcamBaseApp *base_app)
+{
+    g_return_val_if_fail(IPCAM_IS_BASE_APP(base_app), NULL);
+    IpcamBaseAppPrivate *priv = ipcam_base_app_get_instance_private(base_app);
+    return priv->msg_pool;
+}
+static void ipcam_base_app_open_socket(IpcamBaseApp *base_app,
+                                      const gint type,
+                                      const gchar *name,
+                                      const gchar *address)
+{
+    IpcamService *service = IPCAM_SERVICE(base_app);
+    switch (type)
+    {
+    case IPCAM_SOCKET_TYPE_SERVER:
+        ipcam_service_bind_by_name(service, name, address);
+        break;
+    case IPCAM_SOCKET_TYPE_CLIENT:
+        ipcam_service_connect_by_name(service, name, address,
+                                      ipcam_base_app_get_config(base_app, "token"));
+        break;
+    case IPCAM_SOCKET_TYPE_PUBLISHER:
+        ipcam_service_publish_by_name(service, name, address);
+        break;
+    case IPCAM_SOCKET_TYPE_SUBSCRIBER:
+        ipcam_service_subscirbe_by_name(service, name, address);
+        break;
+    default:
+        break;
+    }
+}
+static const struct
+{
+    const gchar *key;
+    IpcamSocketOption option;
+} socket_settings[] =
+{
+    {"encoding", IPCAM_SOCKET_OPTION_ENCODING},
+    {"framing", IPCAM_SOCKET_OPTION_FRAMING},
+    {"max_size", IPCAM_SOCKET_OPTION_MAX_SIZE},
+    {"compress_threshold", IPCAM_SOCKET_OPTION_COMPRESS_THRESHOLD},
+    {"batch_count", IPCAM_SOCKET_OPTION_BATCH_COUNT},
+    {"batch_bytes", IPCAM_SOCKET_OPTION_BATCH_BYTES},
+    {"batch_delay", IPCAM_SOCKET_OPTION_BATCH_DELAY},
+    {"window", IPCAM_SOCKET_OPTION_WINDOW},
+    {"window_queue", IPCAM_SOCKET_OPTION_WINDOW_QUEUE},
+};
+static gint ipcam_base_app_parse_socket_setting(IpcamSocketOption option, const gchar *value)
+{
+    switch (option)
+    {
+    case IPCAM_SOCKET_OPTION_ENCODING:
+        return ipcam_message_encoding_from_string(value);
+    case IPCAM_SOCKET_OPTION_FRAMING:
+        return ipcam_message_framing_from_string(value);
+    default:
+        return atoi(value);
+    }
+}
+/*
+ * A socket entry is either the plain "name: address" form, or a section
+ * of its own with "address" and optional settings such as "encoding".
+ */
+static void ipcam_base_app_apply_sockets(IpcamBaseApp *base_app,
+                                         const gchar *section,
+                                         const gint type)
+{
+    GHashTable *collection = ipcam_base_app_get_configs(base_app, section);
+    GHashTableIter iter;
+    gpointer key, value;
+
+    g_hash_table_iter_init(&iter, collection);
+    while (g_hash_table_iter_next(&iter, &key, &value))
+    {
+        const gchar *sep = strchr((gchar *)key, ':');
+        if (NULL == sep)
+        {
+            ipcam_base_app_open_socket(base_app, type, (gchar *)key, (gchar *)value);
+        }
+        else if (0 == strcmp(sep + 1, "address"))
+        {
+            gchar *name = g_strndup((gchar *)key, sep - (gchar *)key);
+            ipcam_base_app_open_socket(base_app, type, name, (gchar *)value);
+            g_free(name);
+        }
+    }
+
+    /* Settings need the socket, so they go after all sockets are open */
+    g_hash_table_iter_init(&iter, collection);
+    while (g_hash_table_iter_next(&iter, &key, &value))
+    {
+        const gchar *sep = strchr((gchar *)key, ':');
+        guint i;
+        for (i = 0; sep && i < G_N_ELEMENTS(socket_settings); i++)
+        {
+            if (0 == strcmp(sep + 1, socket_settings[i].key))
+            {
+                gchar *name = g_strndup((gchar *)key, sep - (gchar *)key);
+                ipcam_service_set_socket_option(IPCAM_SERVICE(base_app), name,
+                                                socket_settings[i].option,
+                                                ipcam_base_app_parse_socket_setting(socket_settings[i].option,
+                                                                                    (gchar *)value));
+                g_free(name);
+            }
+        }
+    }
 }
 static void ipcam_base_app_apply_config(IpcamBaseApp *base_app)
 {
-    GHashTable *collection;
-    
-    collection = ipcam_base_app_get_configs(base_app, "bind");
-    g_hash_table_foreach(collection, ipcam_base_app_bind, base_app);
-    collection = ipcam_base_app_get_configs(base_app, "connect");
-    g_hash_table_foreach(collection, ipcam_base_app_connect, base_app);
-    collection = ipcam_base_app_get_configs(base_app, "publish");
-    g_hash_table_foreach(collection, ipcam_base_app_bind_publish, base_app);
-    collection = ipcam_base_app_get_configs(base_app, "subscribe");
-    g_hash_table_foreach(collection, ipcam_base_app_subscribe, base_app);
+    ipcam_base_app_apply_sockets(base_app, "bind", IPCAM_SOCKET_TYPE_SERVER);
+    ipcam_base_app_apply_sockets(base_app, "connect", IPCAM_SOCKET_TYPE_CLIENT);
+    ipcam_base_app_apply_sockets(base_app, "publish", IPCAM_SOCKET_TYPE_PUBLISHER);
+    ipcam_base_app_apply_sockets(base_app, "subscribe", IPCAM_SOCKET_TYPE_SUBSCRIBER);
 }
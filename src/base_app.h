@@ -31,24 +31,56 @@ void ipcam_base_app_add_timer(IpcamBaseApp *base_app,
                               const gchar *timer_id,
                               const gchar *interval,
                               TCFunc callback);
+gint64 ipcam_base_app_get_timer_lateness(IpcamBaseApp *base_app, const gchar *timer_id);
+gboolean ipcam_base_app_add_local_timer(IpcamBaseApp *base_app,
+                                        const gchar *timer_id,
+                                        const gchar *interval,
+                                        TCFunc callback);
 void ipcam_base_app_register_request_handler(IpcamBaseApp *base_app,
                                              const gchar *handler_name,
                                              GType handler_class_type);
 void ipcam_base_app_register_notice_handler(IpcamBaseApp *base_app,
                                             const gchar *handler_name,
                                             GType handler_class_type);
-void ipcam_base_app_send_message(IpcamBaseApp *base_app,
-                                 IpcamMessage *msg,
-                                 const gchar *name,
-                                 const gchar *client_id,
-                                 MsgHandler callback,
-                                 guint timeout);
+/* As above, but every message runs through the one handler created here */
+void ipcam_base_app_register_shared_request_handler(IpcamBaseApp *base_app,
+                                                    const gchar *handler_name,
+                                                    GType handler_class_type);
+void ipcam_base_app_register_shared_notice_handler(IpcamBaseApp *base_app,
+                                                   const gchar *handler_name,
+                                                   GType handler_class_type);
+gboolean ipcam_base_app_send_message(IpcamBaseApp *base_app,
+                                     IpcamMessage *msg,
+                                     const gchar *name,
+                                     const gchar *client_id,
+                                     MsgHandler callback,
+                                     guint timeout);
+IpcamFuture *ipcam_base_app_send_message_future(IpcamBaseApp *base_app,
+                                                IpcamMessage *msg,
+                                                const gchar *name,
+                                                const gchar *client_id,
+                                                guint timeout_ms);
+void ipcam_base_app_publish_message(IpcamBaseApp *base_app, IpcamMessage *msg);
 gboolean ipcam_base_app_wait_response(IpcamBaseApp *base_app,
                                       const char *msg_id,
                                       gint64 timeout_ms,
                                       IpcamMessage **response);
+gboolean ipcam_base_app_call(IpcamBaseApp *base_app,
+                             IpcamMessage *msg,
+                             const gchar *name,
+                             const gchar *client_id,
+                             gint64 timeout_ms,
+                             IpcamMessage **response);
 const gchar *ipcam_base_app_get_config(IpcamBaseApp *base_app,
                                        const gchar *config_name);
 GHashTable *ipcam_base_app_get_configs(IpcamBaseApp *base_app,
                                        const gchar *config_name);
+IpcamMessagePool *ipcam_base_app_get_message_pool(IpcamBaseApp *base_app);
+gboolean ipcam_base_app_register_request_schema(IpcamBaseApp *base_app,
+                                                const gchar *action,
+                                                const gchar *definition);
+gboolean ipcam_base_app_register_notice_schema(IpcamBaseApp *base_app,
+                                               const gchar *event,
+                                               const gchar *definition);
+guint ipcam_base_app_get_reject_count(IpcamBaseApp *base_app, const gchar *peer);
 #endif /* __BASE_APP_H__*/
@@ -150,9 +150,14 @@ static void ipcam_base_service_on_read(IpcamBaseService *self, void *mq_socket)
 static void ipcam_base_service_do_poll(IpcamBaseService *self)
 {
     IpcamBaseServicePrivate *priv = ipcam_base_service_get_instance_private(self);
+    gint timeout = TIMEOUT_PERIOD;
+    if (IPCAM_BASE_SERVICE_GET_CLASS(self)->prepare_poll != NULL)
+    {
+        IPCAM_BASE_SERVICE_GET_CLASS(self)->prepare_poll(self, &timeout);
+    }
     if (priv->poller)
     {
-        void *which = zpoller_wait(priv->poller, TIMEOUT_PERIOD);
+        void *which = zpoller_wait(priv->poller, timeout);
         //g_return_if_fail(!zpoller_expired(priv->poller));
         if (zpoller_terminated(priv->poller))
         {
@@ -169,7 +174,7 @@ static void ipcam_base_service_do_poll(IpcamBaseService *self)
     }
     else
     {
-        zclock_sleep(TIMEOUT_PERIOD);
+        zclock_sleep(timeout);
     }
 }
 
@@ -261,6 +266,7 @@ static void ipcam_base_service_class_init(IpcamBaseServiceClass *klass)
     klass->before = NULL;
     klass->in_loop = NULL;
     klass->on_read = NULL;
+    klass->prepare_poll = NULL;
 }
 
 void ipcam_base_service_start(IpcamBaseService *base_service)
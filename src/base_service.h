@@ -32,6 +32,9 @@ struct _IpcamBaseServiceClass {
     void (*before)(IpcamBaseService *self);
     void (*in_loop)(IpcamBaseService *self);
     void (*on_read)(IpcamBaseService *self, void *mq_socket);
+    // optional, called before every poll, may change the poll timeout (ms);
+    // a stop is only noticed once the poll returns
+    void (*prepare_poll)(IpcamBaseService *self, gint *timeout);
 };
 
 GType ipcam_base_service_get_type(void);
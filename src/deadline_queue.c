@@ -0,0 +1,149 @@
+#include "deadline_queue.h"
+
+#define NOT_QUEUED G_MAXUINT
+
+struct _IpcamDeadlineQueue
+{
+    GPtrArray *heap;
+    guint64 sequence;
+};
+
+static inline IpcamDeadlineEntry *heap_get(IpcamDeadlineQueue *queue, guint i)
+{
+    return (IpcamDeadlineEntry *)g_ptr_array_index(queue->heap, i);
+}
+
+static inline gboolean earlier(const IpcamDeadlineEntry *a, const IpcamDeadlineEntry *b)
+{
+    return a->deadline < b->deadline ||
+        (a->deadline == b->deadline && a->sequence < b->sequence);
+}
+
+static inline void heap_set(IpcamDeadlineQueue *queue, guint i, IpcamDeadlineEntry *entry)
+{
+    g_ptr_array_index(queue->heap, i) = entry;
+    entry->index = i;
+}
+
+static void sift_up(IpcamDeadlineQueue *queue, guint i)
+{
+    IpcamDeadlineEntry *entry = heap_get(queue, i);
+
+    while (i > 0)
+    {
+        guint parent = (i - 1) / 2;
+        if (!earlier(entry, heap_get(queue, parent)))
+            break;
+        heap_set(queue, i, heap_get(queue, parent));
+        i = parent;
+    }
+    heap_set(queue, i, entry);
+}
+
+static void sift_down(IpcamDeadlineQueue *queue, guint i)
+{
+    IpcamDeadlineEntry *entry = heap_get(queue, i);
+    guint size = queue->heap->len;
+
+    for (;;)
+    {
+        guint child = 2 * i + 1;
+        if (child >= size)
+            break;
+        if (child + 1 < size && earlier(heap_get(queue, child + 1), heap_get(queue, child)))
+            child++;
+        if (!earlier(heap_get(queue, child), entry))
+            break;
+        heap_set(queue, i, heap_get(queue, child));
+        i = child;
+    }
+    heap_set(queue, i, entry);
+}
+
+IpcamDeadlineQueue *ipcam_deadline_queue_new(void)
+{
+    IpcamDeadlineQueue *queue = g_new0(IpcamDeadlineQueue, 1);
+    queue->heap = g_ptr_array_sized_new(64);
+    return queue;
+}
+
+void ipcam_deadline_queue_free(IpcamDeadlineQueue *queue)
+{
+    guint i;
+
+    /* The entries belong to the caller, they are only unlinked */
+    for (i = 0; i < queue->heap->len; i++)
+        heap_get(queue, i)->index = NOT_QUEUED;
+    g_ptr_array_free(queue->heap, TRUE);
+    g_free(queue);
+}
+
+void ipcam_deadline_queue_push(IpcamDeadlineQueue *queue, IpcamDeadlineEntry *entry, gint64 deadline)
+{
+    if (ipcam_deadline_queue_contains(queue, entry))
+        ipcam_deadline_queue_remove(queue, entry);
+
+    entry->deadline = deadline;
+    entry->sequence = queue->sequence++;
+    g_ptr_array_add(queue->heap, entry);
+    entry->index = queue->heap->len - 1;
+    sift_up(queue, entry->index);
+}
+
+gboolean ipcam_deadline_queue_contains(IpcamDeadlineQueue *queue, IpcamDeadlineEntry *entry)
+{
+    return entry->index < queue->heap->len && heap_get(queue, entry->index) == entry;
+}
+
+gboolean ipcam_deadline_queue_remove(IpcamDeadlineQueue *queue, IpcamDeadlineEntry *entry)
+{
+    guint i = entry->index;
+    IpcamDeadlineEntry *last;
+
+    if (!ipcam_deadline_queue_contains(queue, entry))
+        return FALSE;
+
+    last = g_ptr_array_remove_index(queue->heap, queue->heap->len - 1);
+    if (last != entry)
+    {
+        heap_set(queue, i, last);
+        sift_down(queue, i);
+        sift_up(queue, last->index);
+    }
+    entry->index = NOT_QUEUED;
+    return TRUE;
+}
+
+IpcamDeadlineEntry *ipcam_deadline_queue_pop_expired(IpcamDeadlineQueue *queue, gint64 now)
+{
+    IpcamDeadlineEntry *top;
+
+    if (0 == queue->heap->len)
+        return NULL;
+    top = heap_get(queue, 0);
+    if (top->deadline > now)
+        return NULL;
+    ipcam_deadline_queue_remove(queue, top);
+    return top;
+}
+
+gint64 ipcam_deadline_queue_next(IpcamDeadlineQueue *queue)
+{
+    return queue->heap->len ? heap_get(queue, 0)->deadline : IPCAM_DEADLINE_QUEUE_NONE;
+}
+
+guint ipcam_deadline_queue_size(IpcamDeadlineQueue *queue)
+{
+    return queue->heap->len;
+}
+
+gint ipcam_deadline_queue_timeout(IpcamDeadlineQueue *queue, gint64 now, gint max_ms)
+{
+    gint64 next = ipcam_deadline_queue_next(queue);
+
+    if (next <= now)
+        return 0;
+    if (next == IPCAM_DEADLINE_QUEUE_NONE || (next - now) / 1000 >= max_ms)
+        return max_ms;
+    return (gint)((next - now + 999) / 1000);
+}
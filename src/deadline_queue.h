@@ -0,0 +1,36 @@
+#ifndef __DEADLINE_QUEUE_H__
+#define __DEADLINE_QUEUE_H__
+
+#include <glib.h>
+
+/*
+ * A binary min-heap of deadlines in g_get_monotonic_time() microseconds.
+ * Entries are embedded in the caller's own structures, so queueing
+ * allocates nothing; each entry remembers its heap slot and can be taken
+ * out again in O(log n).  Equal deadlines come out in the order they were
+ * pushed.  Not thread safe, callers hold their own lock.
+ */
+typedef struct _IpcamDeadlineEntry
+{
+    gint64 deadline;
+    guint64 sequence;
+    guint index;
+} IpcamDeadlineEntry;
+
+typedef struct _IpcamDeadlineQueue IpcamDeadlineQueue;
+
+#define IPCAM_DEADLINE_QUEUE_NONE G_MAXINT64
+
+IpcamDeadlineQueue *ipcam_deadline_queue_new(void);
+void ipcam_deadline_queue_free(IpcamDeadlineQueue *queue);
+void ipcam_deadline_queue_push(IpcamDeadlineQueue *queue, IpcamDeadlineEntry *entry, gint64 deadline);
+gboolean ipcam_deadline_queue_remove(IpcamDeadlineQueue *queue, IpcamDeadlineEntry *entry);
+gboolean ipcam_deadline_queue_contains(IpcamDeadlineQueue *queue, IpcamDeadlineEntry *entry);
+IpcamDeadlineEntry *ipcam_deadline_queue_pop_expired(IpcamDeadlineQueue *queue, gint64 now);
+/* The earliest deadline, IPCAM_DEADLINE_QUEUE_NONE when empty */
+gint64 ipcam_deadline_queue_next(IpcamDeadlineQueue *queue);
+guint ipcam_deadline_queue_size(IpcamDeadlineQueue *queue);
+/* Milliseconds until the earliest deadline, rounded up, at most max_ms */
+gint ipcam_deadline_queue_timeout(IpcamDeadlineQueue *queue, gint64 now, gint max_ms);
+
+#endif /* __DEADLINE_QUEUE_H__ */
@@ -13,6 +13,15 @@
 #define IPCAM_IS_EVENT_HANDLER_CLASS(klass) (G_TYPE_CHECK_CLASS_TYPE((klass), IPCAM_EVENT_HANDLER_TYPE))
 #define IPCAM_EVENT_HANDLER_GET_CLASS(obj) (G_TYPE_INSTANCE_GET_CLASS((obj), IPCAM_EVENT_HANDLER_TYPE, IpcamEventHandlerClass))
 
+/*
+ * ipcam_base_app_register_notice_handler() creates a new handler for
+ * every notice of the event and drops it after run().  A handler
+ * registered with ipcam_base_app_register_shared_notice_handler()
+ * instead is created once and runs every notice for the event, one at a
+ * time on the service thread, so its fields keep their values from one
+ * notice to the next: reset any per-notice state in run(), or keep it in
+ * locals.
+ */
 typedef struct _IpcamEventHandler IpcamEventHandler;
 typedef struct _IpcamEventHandlerClass IpcamEventHandlerClass;
 
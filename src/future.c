@@ -0,0 +1,254 @@
+#include <unistd.h>
+#include <sys/eventfd.h>
+#include "future.h"
+
+typedef struct _IpcamFutureCallback
+{
+    IpcamFutureFunc func;
+    gpointer user_data;
+} IpcamFutureCallback;
+
+struct _IpcamFuture
+{
+    gint ref_count;
+    GMutex mutex;
+    GCond condition;
+    IpcamFutureState state;
+    IpcamMessage *response;
+    gint fd;
+    GSList *callbacks;
+    /* For all/any: children still outstanding */
+    gint remaining;
+};
+
+IpcamFuture *ipcam_future_new(void)
+{
+    IpcamFuture *future = g_new0(IpcamFuture, 1);
+    future->ref_count = 1;
+    future->state = IPCAM_FUTURE_PENDING;
+    future->fd = -1;
+    g_mutex_init(&future->mutex);
+    g_cond_init(&future->condition);
+    return future;
+}
+
+static gboolean ipcam_future_settle(IpcamFuture *future, IpcamFutureState state, IpcamMessage *response);
+
+IpcamFuture *ipcam_future_ref(IpcamFuture *future)
+{
+    g_return_val_if_fail(future, NULL);
+    g_atomic_int_inc(&future->ref_count);
+    return future;
+}
+
+void ipcam_future_unref(IpcamFuture *future)
+{
+    g_return_if_fail(future);
+    if (!g_atomic_int_dec_and_test(&future->ref_count))
+        return;
+
+    /*
+     * Nobody can complete it any more, so it is cancelled: its callbacks
+     * run and release what they hold, such as the reference a combined
+     * future's child keeps to it.  They run under a reference of their own.
+     */
+    if (future->callbacks)
+    {
+        g_atomic_int_set(&future->ref_count, 1);
+        ipcam_future_settle(future, IPCAM_FUTURE_CANCELLED, NULL);
+        if (!g_atomic_int_dec_and_test(&future->ref_count))
+            return;
+    }
+
+    if (future->response)
+        g_object_unref(future->response);
+    if (future->fd >= 0)
+        close(future->fd);
+    g_cond_clear(&future->condition);
+    g_mutex_clear(&future->mutex);
+    g_free(future);
+}
+
+static void ipcam_future_signal_fd(gint fd)
+{
+    guint64 one = 1;
+    if (write(fd, &one, sizeof(one)) != sizeof(one))
+        g_warning("Failed to signal future eventfd.\n");
+}
+
+static gboolean ipcam_future_settle(IpcamFuture *future, IpcamFutureState state, IpcamMessage *response)
+{
+    GSList *callbacks, *item;
+
+    g_mutex_lock(&future->mutex);
+    if (future->state != IPCAM_FUTURE_PENDING)
+    {
+        g_mutex_unlock(&future->mutex);
+        return FALSE;
+    }
+    future->state = state;
+    future->response = response ? g_object_ref(response) : NULL;
+    callbacks = g_slist_reverse(future->callbacks);
+    future->callbacks = NULL;
+    g_cond_broadcast(&future->condition);
+    if (future->fd >= 0)
+        ipcam_future_signal_fd(future->fd);
+    g_mutex_unlock(&future->mutex);
+
+    /* Unlocked, a callback may well look at the future again */
+    for (item = callbacks; item; item = item->next)
+    {
+        IpcamFutureCallback *callback = item->data;
+        callback->func(future, callback->user_data);
+    }
+    g_slist_free_full(callbacks, g_free);
+
+    return TRUE;
+}
+
+gboolean ipcam_future_complete(IpcamFuture *future, IpcamMessage *response)
+{
+    g_return_val_if_fail(future, FALSE);
+    return ipcam_future_settle(future, IPCAM_FUTURE_DONE, response);
+}
+
+gboolean ipcam_future_fail(IpcamFuture *future, IpcamFutureState state)
+{
+    g_return_val_if_fail(future, FALSE);
+    g_return_val_if_fail(state == IPCAM_FUTURE_TIMEOUT || state == IPCAM_FUTURE_CANCELLED, FALSE);
+    return ipcam_future_settle(future, state, NULL);
+}
+
+IpcamFutureState ipcam_future_get_state(IpcamFuture *future)
+{
+    IpcamFutureState state;
+
+    g_return_val_if_fail(future, IPCAM_FUTURE_CANCELLED);
+    g_mutex_lock(&future->mutex);
+    state = future->state;
+    g_mutex_unlock(&future->mutex);
+    return state;
+}
+
+gboolean ipcam_future_is_done(IpcamFuture *future)
+{
+    return ipcam_future_get_state(future) != IPCAM_FUTURE_PENDING;
+}
+
+IpcamMessage *ipcam_future_get_response(IpcamFuture *future)
+{
+    IpcamMessage *response;
+
+    g_return_val_if_fail(future, NULL);
+    g_mutex_lock(&future->mutex);
+    response = future->response;
+    g_mutex_unlock(&future->mutex);
+    return response;
+}
+
+gboolean ipcam_future_wait(IpcamFuture *future, gint64 timeout_ms)
+{
+    gint64 end_time = g_get_monotonic_time() + timeout_ms * G_TIME_SPAN_MILLISECOND;
+    gboolean done;
+
+    g_return_val_if_fail(future, FALSE);
+    g_mutex_lock(&future->mutex);
+    while (future->state == IPCAM_FUTURE_PENDING)
+    {
+        if (timeout_ms <= 0)
+            g_cond_wait(&future->condition, &future->mutex);
+        else if (!g_cond_wait_until(&future->condition, &future->mutex, end_time))
+            break;
+    }
+    done = (future->state != IPCAM_FUTURE_PENDING);
+    g_mutex_unlock(&future->mutex);
+    return done;
+}
+
+gint ipcam_future_get_fd(IpcamFuture *future)
+{
+    gint fd;
+
+    g_return_val_if_fail(future, -1);
+    g_mutex_lock(&future->mutex);
+    if (future->fd < 0)
+    {
+        future->fd = eventfd(0, EFD_CLOEXEC | EFD_NONBLOCK);
+        if (future->fd < 0)
+            g_warning("Failed to create future eventfd.\n");
+        else if (future->state != IPCAM_FUTURE_PENDING)
+            ipcam_future_signal_fd(future->fd);
+    }
+    fd = future->fd;
+    g_mutex_unlock(&future->mutex);
+    return fd;
+}
+
+void ipcam_future_on_done(IpcamFuture *future, IpcamFutureFunc func, gpointer user_data)
+{
+    g_return_if_fail(future);
+    g_return_if_fail(func);
+
+    g_mutex_lock(&future->mutex);
+    if (future->state == IPCAM_FUTURE_PENDING)
+    {
+        IpcamFutureCallback *callback = g_new(IpcamFutureCallback, 1);
+        callback->func = func;
+        callback->user_data = user_data;
+        future->callbacks = g_slist_prepend(future->callbacks, callback);
+        g_mutex_unlock(&future->mutex);
+        return;
+    }
+    g_mutex_unlock(&future->mutex);
+    func(future, user_data);
+}
+
+/* Each child holds a reference to the combined future until it completes */
+static void ipcam_future_all_child_done(IpcamFuture *child, gpointer user_data)
+{
+    IpcamFuture *all = user_data;
+    IpcamFutureState state = ipcam_future_get_state(child);
+
+    if (state != IPCAM_FUTURE_DONE)
+        ipcam_future_fail(all, state);
+    else if (g_atomic_int_dec_and_test(&all->remaining))
+        ipcam_future_complete(all, NULL);
+    ipcam_future_unref(all);
+}
+
+static void ipcam_future_any_child_done(IpcamFuture *child, gpointer user_data)
+{
+    IpcamFuture *any = user_data;
+    IpcamFutureState state = ipcam_future_get_state(child);
+
+    if (state == IPCAM_FUTURE_DONE)
+        ipcam_future_complete(any, ipcam_future_get_response(child));
+    else if (g_atomic_int_dec_and_test(&any->remaining))
+        ipcam_future_fail(any, state);
+    ipcam_future_unref(any);
+}
+
+static IpcamFuture *ipcam_future_combine(IpcamFuture *futures[], guint n_futures, IpcamFutureFunc child_done)
+{
+    IpcamFuture *future;
+    guint i;
+
+    g_return_val_if_fail(futures, NULL);
+    g_return_val_if_fail(n_futures > 0, NULL);
+
+    future = ipcam_future_new();
+    future->remaining = n_futures;
+    for (i = 0; i < n_futures; i++)
+        ipcam_future_on_done(futures[i], child_done, ipcam_future_ref(future));
+    return future;
+}
+
+IpcamFuture *ipcam_future_all(IpcamFuture *futures[], guint n_futures)
+{
+    return ipcam_future_combine(futures, n_futures, ipcam_future_all_child_done);
+}
+
+IpcamFuture *ipcam_future_any(IpcamFuture *futures[], guint n_futures)
+{
+    return ipcam_future_combine(futures, n_futures, ipcam_future_any_child_done);
+}
@@ -0,0 +1,61 @@
+#ifndef __FUTURE_H__
+#define __FUTURE_H__
+
+#include <glib.h>
+#include "message.h"
+
+/*
+ * The eventual outcome of a request: the response, or the reason there
+ * will never be one.  A future is completed exactly once, from whichever
+ * thread gets there first, normally the service thread when the response
+ * arrives or the request times out.  It can be waited on, polled, watched
+ * through an eventfd, or combined with others, so one thread can keep
+ * many requests in flight.
+ */
+typedef struct _IpcamFuture IpcamFuture;
+
+typedef enum _IpcamFutureState
+{
+    IPCAM_FUTURE_PENDING = 0,
+    IPCAM_FUTURE_DONE,
+    IPCAM_FUTURE_TIMEOUT,
+    IPCAM_FUTURE_CANCELLED
+} IpcamFutureState;
+
+/* Runs once, on the thread that completes the future */
+typedef void (*IpcamFutureFunc)(IpcamFuture *future, gpointer user_data);
+
+IpcamFuture *ipcam_future_new(void);
+IpcamFuture *ipcam_future_ref(IpcamFuture *future);
+/* Releasing the last reference to a pending future cancels it first */
+void ipcam_future_unref(IpcamFuture *future);
+
+/* Both return FALSE when the future was already completed */
+gboolean ipcam_future_complete(IpcamFuture *future, IpcamMessage *response);
+gboolean ipcam_future_fail(IpcamFuture *future, IpcamFutureState state);
+
+IpcamFutureState ipcam_future_get_state(IpcamFuture *future);
+gboolean ipcam_future_is_done(IpcamFuture *future);
+/* The response, owned by the future; NULL unless the state is DONE */
+IpcamMessage *ipcam_future_get_response(IpcamFuture *future);
+/*
+ * Blocks until the future completes or timeout_ms passes (0 waits for
+ * ever); TRUE when it completed.  Not from the thread that completes it.
+ */
+gboolean ipcam_future_wait(IpcamFuture *future, gint64 timeout_ms);
+/*
+ * An eventfd that becomes readable once the future completes and stays
+ * readable until the future is freed; do not read from it.  -1 on error.
+ */
+gint ipcam_future_get_fd(IpcamFuture *future);
+/* Called at once when the future has already completed */
+void ipcam_future_on_done(IpcamFuture *future, IpcamFutureFunc func, gpointer user_data);
+
+/*
+ * all: DONE once every future is DONE, fails as soon as one fails.
+ * any: DONE with the first response that arrives, fails once all failed.
+ */
+IpcamFuture *ipcam_future_all(IpcamFuture *futures[], guint n_futures);
+IpcamFuture *ipcam_future_any(IpcamFuture *futures[], guint n_futures);
+
+#endif /* __FUTURE_H__ */
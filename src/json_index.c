@@ -0,0 +1,270 @@
+#include <string.h>
+#include "json_index.h"
+
+#if defined(__x86_64__) || defined(__i386__)
+#define IPCAM_JSON_INDEX_X86 1
+#include <immintrin.h>
+#elif defined(__aarch64__)
+#define IPCAM_JSON_INDEX_NEON 1
+#include <arm_neon.h>
+#endif
+
+#define BLOCK_SIZE 64
+/* Containers nested deeper than this are refused rather than tracked */
+#define MAX_DEPTH 1024
+
+typedef guint64 (*BlockMaskFunc)(const guint8 *block);
+
+typedef struct _IpcamJsonIndexImpl
+{
+    const gchar *name;
+    BlockMaskFunc block_mask;
+} IpcamJsonIndexImpl;
+
+/*
+ * '[' and '{' differ only in bit 0x20, as do ']' and '}', so setting that
+ * bit folds each pair into one comparison.  No other byte folds onto them.
+ */
+static guint64 scalar_block_mask(const guint8 *block)
+{
+    guint64 mask = 0;
+    gint i;
+
+    for (i = 0; i < BLOCK_SIZE; i++)
+    {
+        guint8 c = block[i];
+        guint8 folded = c | 0x20;
+        if (c == '"' || c == '\\' || folded == '{' || folded == '}')
+            mask |= (guint64)1 << i;
+    }
+    return mask;
+}
+
+#ifdef IPCAM_JSON_INDEX_X86
+__attribute__((target("sse2")))
+static guint64 sse2_block_mask(const guint8 *block)
+{
+    const __m128i quote = _mm_set1_epi8('"');
+    const __m128i backslash = _mm_set1_epi8('\\');
+    const __m128i open = _mm_set1_epi8('{');
+    const __m128i close = _mm_set1_epi8('}');
+    const __m128i fold = _mm_set1_epi8(0x20);
+    guint64 mask = 0;
+    gint i;
+
+    for (i = 0; i < BLOCK_SIZE / 16; i++)
+    {
+        __m128i v = _mm_loadu_si128((const __m128i *)(block + i * 16));
+        __m128i folded = _mm_or_si128(v, fold);
+        __m128i hits = _mm_or_si128(_mm_or_si128(_mm_cmpeq_epi8(v, quote),
+                                                 _mm_cmpeq_epi8(v, backslash)),
+                                    _mm_or_si128(_mm_cmpeq_epi8(folded, open),
+                                                 _mm_cmpeq_epi8(folded, close)));
+        mask |= (guint64)(guint16)_mm_movemask_epi8(hits) << (i * 16);
+    }
+    return mask;
+}
+
+__attribute__((target("avx2")))
+static guint64 avx2_block_mask(const guint8 *block)
+{
+    const __m256i quote = _mm256_set1_epi8('"');
+    const __m256i backslash = _mm256_set1_epi8('\\');
+    const __m256i open = _mm256_set1_epi8('{');
+    const __m256i close = _mm256_set1_epi8('}');
+    const __m256i fold = _mm256_set1_epi8(0x20);
+    guint64 mask = 0;
+    gint i;
+
+    for (i = 0; i < BLOCK_SIZE / 32; i++)
+    {
+        __m256i v = _mm256_loadu_si256((const __m256i *)(block + i * 32));
+        __m256i folded = _mm256_or_si256(v, fold);
+        __m256i hits = _mm256_or_si256(_mm256_or_si256(_mm256_cmpeq_epi8(v, quote),
+                                                       _mm256_cmpeq_epi8(v, backslash)),
+                                       _mm256_or_si256(_mm256_cmpeq_epi8(folded, open),
+                                                       _mm256_cmpeq_epi8(folded, close)));
+        mask |= (guint64)(guint32)_mm256_movemask_epi8(hits) << (i * 32);
+    }
+    return mask;
+}
+#endif
+
+#ifdef IPCAM_JSON_INDEX_NEON
+static uint8x16_t neon_hits(const guint8 *data)
+{
+    uint8x16_t v = vld1q_u8(data);
+    uint8x16_t folded = vorrq_u8(v, vdupq_n_u8(0x20));
+    return vorrq_u8(vorrq_u8(vceqq_u8(v, vdupq_n_u8('"')),
+                             vceqq_u8(v, vdupq_n_u8('\\'))),
+                    vorrq_u8(vceqq_u8(folded, vdupq_n_u8('{')),
+                             vceqq_u8(folded, vdupq_n_u8('}'))));
+}
+
+/* NEON has no movemask: weight each lane by its bit and add pairwise */
+static guint64 neon_block_mask(const guint8 *block)
+{
+    static const guint8 weights[16] =
+        {0x01, 0x02, 0x04, 0x08, 0x10, 0x20, 0x40, 0x80,
+         0x01, 0x02, 0x04, 0x08, 0x10, 0x20, 0x40, 0x80};
+    const uint8x16_t bits = vld1q_u8(weights);
+    uint8x16_t t0 = vandq_u8(neon_hits(block), bits);
+    uint8x16_t t1 = vandq_u8(neon_hits(block + 16), bits);
+    uint8x16_t t2 = vandq_u8(neon_hits(block + 32), bits);
+    uint8x16_t t3 = vandq_u8(neon_hits(block + 48), bits);
+    uint8x16_t sum = vpaddq_u8(vpaddq_u8(t0, t1), vpaddq_u8(t2, t3));
+
+    sum = vpaddq_u8(sum, sum);
+    return vgetq_lane_u64(vreinterpretq_u64_u8(sum), 0);
+}
+#endif
+
+/* Fastest first, scalar last as it always works */
+static const IpcamJsonIndexImpl impls[] =
+{
+#ifdef IPCAM_JSON_INDEX_X86
+    {"avx2", avx2_block_mask},
+    {"sse2", sse2_block_mask},
+#endif
+#ifdef IPCAM_JSON_INDEX_NEON
+    {"neon", neon_block_mask},
+#endif
+    {"scalar", scalar_block_mask},
+};
+
+static const IpcamJsonIndexImpl *forced_impl = NULL;
+
+static gboolean impl_supported(const IpcamJsonIndexImpl *impl)
+{
+#ifdef IPCAM_JSON_INDEX_X86
+    __builtin_cpu_init();
+    if (0 == strcmp(impl->name, "avx2"))
+        return __builtin_cpu_supports("avx2");
+    if (0 == strcmp(impl->name, "sse2"))
+        return __builtin_cpu_supports("sse2");
+#endif
+    return TRUE;
+}
+
+static const IpcamJsonIndexImpl *get_impl(void)
+{
+    static gsize detected = 0;
+    const IpcamJsonIndexImpl *impl = g_atomic_pointer_get(&forced_impl);
+
+    if (impl)
+        return impl;
+    if (g_once_init_enter(&detected))
+    {
+        guint i = 0;
+        while (!impl_supported(&impls[i]))
+            i++;
+        g_once_init_leave(&detected, (gsize)&impls[i]);
+    }
+    return (const IpcamJsonIndexImpl *)detected;
+}
+
+const gchar *ipcam_json_index_get_impl(void)
+{
+    return get_impl()->name;
+}
+
+gboolean ipcam_json_index_set_impl(const gchar *name)
+{
+    guint i;
+
+    for (i = 0; i < G_N_ELEMENTS(impls); i++)
+    {
+        if (0 == g_strcmp0(impls[i].name, name) && impl_supported(&impls[i]))
+        {
+            g_atomic_pointer_set(&forced_impl, &impls[i]);
+            return TRUE;
+        }
+    }
+    return FALSE;
+}
+
+/*
+ * Walks the structural bytes only.  A backslash in a string hides the
+ * byte after it, which may sit in the next block.  Each closing bracket
+ * must match the kind of the one it closes; one bit per open container
+ * records whether it is an object.
+ */
+static gsize index_skip(const guint8 *data, gsize length, gboolean in_string)
+{
+    BlockMaskFunc block_mask = get_impl()->block_mask;
+    guint8 tail[BLOCK_SIZE];
+    guint64 objects[MAX_DEPTH / 64];
+    gsize base, hidden = 0;
+    gint depth = 0;
+
+    for (base = 0; base < length; base += BLOCK_SIZE)
+    {
+        guint64 mask;
+
+        if (length - base >= BLOCK_SIZE)
+        {
+            mask = block_mask(data + base);
+        }
+        else
+        {
+            memset(tail, 0, BLOCK_SIZE);
+            memcpy(tail, data + base, length - base);
+            mask = block_mask(tail);
+        }
+
+        while (mask)
+        {
+            gsize pos = base + __builtin_ctzll(mask);
+            mask &= mask - 1;
+            if (pos < hidden)
+                continue;
+
+            switch (data[pos])
+            {
+            case '"':
+                in_string = !in_string;
+                if (!in_string && depth == 0)
+                    return pos + 1;
+                break;
+            case '\\':
+                if (in_string)
+                    hidden = pos + 2;
+                break;
+            case '{':
+            case '[':
+                if (in_string)
+                    break;
+                if (depth == MAX_DEPTH)
+                    return 0;
+                if (data[pos] == '{')
+                    objects[depth / 64] |= (guint64)1 << (depth % 64);
+                else
+                    objects[depth / 64] &= ~((guint64)1 << (depth % 64));
+                depth++;
+                break;
+            default:
+                if (in_string)
+                    break;
+                if (depth == 0)
+                    return 0;
+                depth--;
+                if ((data[pos] == '}') != !!(objects[depth / 64] & ((guint64)1 << (depth % 64))))
+                    return 0;
+                if (depth == 0)
+                    return pos + 1;
+                break;
+            }
+        }
+    }
+    return 0;
+}
+
+gsize ipcam_json_index_skip_string(const gchar *data, gsize length)
+{
+    return index_skip((const guint8 *)data, length, TRUE);
+}
+
+gsize ipcam_json_index_skip_container(const gchar *data, gsize length)
+{
+    return index_skip((const guint8 *)data, length, FALSE);
+}
@@ -0,0 +1,30 @@
+#ifndef __JSON_INDEX_H__
+#define __JSON_INDEX_H__
+
+#include <glib.h>
+
+/*
+ * Structural index over JSON text.  The text is classified 64 bytes at a
+ * time into a bit mask of the bytes that matter when skipping a value:
+ * quotes, backslashes and brackets.  Everything else is passed over
+ * without being looked at one by one.  The classifier is picked once at
+ * run time from what the CPU supports: AVX2 or SSE2 on x86, NEON on
+ * AArch64, a plain loop anywhere else.
+ */
+
+/*
+ * Both return the number of bytes consumed, or 0 when the text ends
+ * first.  skip_string starts just after the opening quote and stops just
+ * after the closing one; skip_container starts at the opening bracket and
+ * also returns 0 when a closing bracket does not match the open one, or
+ * containers nest more than 1024 deep.
+ */
+gsize ipcam_json_index_skip_string(const gchar *data, gsize length);
+gsize ipcam_json_index_skip_container(const gchar *data, gsize length);
+
+/* "avx2", "sse2", "neon" or "scalar" */
+const gchar *ipcam_json_index_get_impl(void);
+/* For benchmarks and tests; FALSE if the CPU cannot run that one */
+gboolean ipcam_json_index_set_impl(const gchar *name);
+
+#endif /* __JSON_INDEX_H__ */
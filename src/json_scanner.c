@@ -0,0 +1,278 @@
+#include <string.h>
+#include "json_scanner.h"
+#include "json_index.h"
+
+static void skip_whitespace(IpcamJsonScanner *scanner)
+{
+    while (scanner->pos < scanner->end)
+    {
+        gchar c = *scanner->pos;
+        if (c != ' ' && c != '\t' && c != '\n' && c != '\r')
+            break;
+        scanner->pos++;
+    }
+}
+
+static gint hex_value(gchar c)
+{
+    if (c >= '0' && c <= '9') return c - '0';
+    if (c >= 'a' && c <= 'f') return c - 'a' + 10;
+    if (c >= 'A' && c <= 'F') return c - 'A' + 10;
+    return -1;
+}
+
+static gboolean read_hex4(IpcamJsonScanner *scanner, gunichar *value)
+{
+    gint i;
+    *value = 0;
+    if (scanner->end - scanner->pos < 4)
+        return FALSE;
+    for (i = 0; i < 4; i++)
+    {
+        gint v = hex_value(scanner->pos[i]);
+        if (v < 0)
+            return FALSE;
+        *value = (*value << 4) | v;
+    }
+    scanner->pos += 4;
+    return TRUE;
+}
+
+void ipcam_json_scanner_init(IpcamJsonScanner *scanner, const gchar *data, gsize length)
+{
+    scanner->data = data;
+    scanner->pos = data;
+    scanner->end = data + length;
+}
+
+gchar ipcam_json_scanner_peek(IpcamJsonScanner *scanner)
+{
+    skip_whitespace(scanner);
+    return (scanner->pos < scanner->end) ? *scanner->pos : '\0';
+}
+
+gboolean ipcam_json_scanner_expect(IpcamJsonScanner *scanner, gchar c)
+{
+    if (ipcam_json_scanner_peek(scanner) != c)
+        return FALSE;
+    scanner->pos++;
+    return TRUE;
+}
+
+gchar *ipcam_json_scanner_read_string(IpcamJsonScanner *scanner)
+{
+    const gchar *start;
+    GString *string = NULL;
+
+    if (!ipcam_json_scanner_expect(scanner, '"'))
+        return NULL;
+
+    start = scanner->pos;
+    while (scanner->pos < scanner->end)
+    {
+        gchar c = *scanner->pos;
+        if (c == '"')
+        {
+            gchar *ret;
+            if (string)
+            {
+                g_string_append_len(string, start, scanner->pos - start);
+                ret = g_string_free(string, FALSE);
+            }
+            else
+            {
+                ret = g_strndup(start, scanner->pos - start);
+            }
+            scanner->pos++;
+            return ret;
+        }
+        if (c == '\\')
+        {
+            gunichar uc;
+            if (!string)
+                string = g_string_sized_new(scanner->pos - start + 16);
+            g_string_append_len(string, start, scanner->pos - start);
+            scanner->pos++;
+            if (scanner->pos >= scanner->end)
+                break;
+            c = *scanner->pos++;
+            switch (c)
+            {
+            case '"':  g_string_append_c(string, '"'); break;
+            case '\\': g_string_append_c(string, '\\'); break;
+            case '/':  g_string_append_c(string, '/'); break;
+            case 'b':  g_string_append_c(string, '\b'); break;
+            case 'f':  g_string_append_c(string, '\f'); break;
+            case 'n':  g_string_append_c(string, '\n'); break;
+            case 'r':  g_string_append_c(string, '\r'); break;
+            case 't':  g_string_append_c(string, '\t'); break;
+            case 'u':
+                if (!read_hex4(scanner, &uc))
+                    goto error;
+                if (uc >= 0xd800 && uc < 0xdc00)
+                {
+                    gunichar low;
+                    if (scanner->end - scanner->pos < 2 ||
+                        scanner->pos[0] != '\\' || scanner->pos[1] != 'u')
+                        goto error;
+                    scanner->pos += 2;
+                    if (!read_hex4(scanner, &low) || low < 0xdc00 || low > 0xdfff)
+                        goto error;
+                    uc = 0x10000 + ((uc - 0xd800) << 10) + (low - 0xdc00);
+                }
+                g_string_append_unichar(string, uc);
+                break;
+            default:
+                goto error;
+            }
+            start = scanner->pos;
+            continue;
+        }
+        scanner->pos++;
+    }
+
+error:
+    if (string)
+        g_string_free(string, TRUE);
+    return NULL;
+}
+
+gboolean ipcam_json_scanner_read_int(IpcamJsonScanner *scanner, gint64 *value)
+{
+    gboolean negative = FALSE;
+    guint64 result = 0;
+    const gchar *start;
+
+    if (ipcam_json_scanner_peek(scanner) == '-')
+    {
+        negative = TRUE;
+        scanner->pos++;
+    }
+
+    start = scanner->pos;
+    while (scanner->pos < scanner->end && g_ascii_isdigit(*scanner->pos))
+    {
+        guint digit = *scanner->pos - '0';
+        if (result > (G_MAXUINT64 - digit) / 10)
+            return FALSE;
+        result = result * 10 + digit;
+        scanner->pos++;
+    }
+    if (scanner->pos == start || result > (guint64)G_MAXINT64 + negative)
+        return FALSE;
+    /* fractions and exponents are not integers */
+    if (scanner->pos < scanner->end &&
+        (*scanner->pos == '.' || *scanner->pos == 'e' || *scanner->pos == 'E'))
+        return FALSE;
+
+    *value = negative ? (gint64)(0 - result) : (gint64)result;
+    return TRUE;
+}
+
+gboolean ipcam_json_scanner_skip_string(IpcamJsonScanner *scanner)
+{
+    gsize consumed;
+
+    if (!ipcam_json_scanner_expect(scanner, '"'))
+        return FALSE;
+
+    consumed = ipcam_json_index_skip_string(scanner->pos, scanner->end - scanner->pos);
+    if (0 == consumed)
+    {
+        scanner->pos = scanner->end;
+        return FALSE;
+    }
+    scanner->pos += consumed;
+    return TRUE;
+}
+
+static const gchar *skip_digits(const gchar *p, const gchar *end)
+{
+    while (p < end && g_ascii_isdigit(*p))
+        p++;
+    return p;
+}
+
+/* A literal or a number, as the JSON grammar has them, up to a delimiter */
+static gboolean skip_scalar(IpcamJsonScanner *scanner)
+{
+    static const gchar *literals[] = { "true", "false", "null" };
+    const gchar *p = scanner->pos;
+    const gchar *end = scanner->end;
+    guint i;
+
+    for (i = 0; i < G_N_ELEMENTS(literals); i++)
+    {
+        gsize length = strlen(literals[i]);
+        if (*p != literals[i][0])
+            continue;
+        if ((gsize)(end - p) < length || 0 != memcmp(p, literals[i], length))
+            return FALSE;
+        p += length;
+        break;
+    }
+
+    if (i == G_N_ELEMENTS(literals))
+    {
+        if (p < end && *p == '-')
+            p++;
+        if (p >= end || !g_ascii_isdigit(*p))
+            return FALSE;
+        p = (*p == '0') ? p + 1 : skip_digits(p, end);
+        if (p < end && *p == '.')
+        {
+            if (++p >= end || !g_ascii_isdigit(*p))
+                return FALSE;
+            p = skip_digits(p, end);
+        }
+        if (p < end && (*p == 'e' || *p == 'E'))
+        {
+            if (++p < end && (*p == '+' || *p == '-'))
+                p++;
+            if (p >= end || !g_ascii_isdigit(*p))
+                return FALSE;
+            p = skip_digits(p, end);
+        }
+    }
+
+    if (p < end && *p != ',' && *p != '}' && *p != ']' &&
+        *p != ' ' && *p != '\t' && *p != '\n' && *p != '\r')
+        return FALSE;
+    scanner->pos = p;
+    return TRUE;
+}
+
+/*
+ * Scalars are checked against the grammar and containers for matching
+ * brackets; what is inside a container is not otherwise checked.
+ */
+gboolean ipcam_json_scanner_skip_value(IpcamJsonScanner *scanner)
+{
+    gsize consumed;
+    gchar c = ipcam_json_scanner_peek(scanner);
+
+    if (c != '{' && c != '[')
+    {
+        if (c == '"')
+            return ipcam_json_scanner_skip_string(scanner);
+        if (scanner->pos >= scanner->end)
+            return FALSE;
+        return skip_scalar(scanner);
+    }
+
+    /* Containers are skipped on the structural index, not byte by byte */
+    consumed = ipcam_json_index_skip_container(scanner->pos, scanner->end - scanner->pos);
+    if (0 == consumed)
+    {
+        scanner->pos = scanner->end;
+        return FALSE;
+    }
+    scanner->pos += consumed;
+    return TRUE;
+}
+
+gboolean ipcam_json_scanner_at_end(IpcamJsonScanner *scanner)
+{
+    skip_whitespace(scanner);
+    return scanner->pos >= scanner->end;
+}
@@ -0,0 +1,27 @@
+#ifndef __JSON_SCANNER_H__
+#define __JSON_SCANNER_H__
+
+#include <glib.h>
+
+/*
+ * A minimal pull scanner over a JSON text buffer.  It never builds a tree:
+ * callers walk the members they care about and skip the rest, so the cost
+ * of a large value that is not looked at is a single structural pass.
+ */
+typedef struct _IpcamJsonScanner
+{
+    const gchar *data;
+    const gchar *pos;
+    const gchar *end;
+} IpcamJsonScanner;
+
+void ipcam_json_scanner_init(IpcamJsonScanner *scanner, const gchar *data, gsize length);
+gchar ipcam_json_scanner_peek(IpcamJsonScanner *scanner);
+gboolean ipcam_json_scanner_expect(IpcamJsonScanner *scanner, gchar c);
+gchar *ipcam_json_scanner_read_string(IpcamJsonScanner *scanner);
+gboolean ipcam_json_scanner_read_int(IpcamJsonScanner *scanner, gint64 *value);
+gboolean ipcam_json_scanner_skip_string(IpcamJsonScanner *scanner);
+gboolean ipcam_json_scanner_skip_value(IpcamJsonScanner *scanner);
+gboolean ipcam_json_scanner_at_end(IpcamJsonScanner *scanner);
+
+#endif /* __JSON_SCANNER_H__ */
@@ -0,0 +1,145 @@
+#include "json_writer.h"
+
+static const gchar hex_digits[] = "0123456789abcdef";
+
+static void append_object_member(JsonObject *object,
+                                 const gchar *member_name,
+                                 JsonNode *member_node,
+                                 gpointer user_data);
+static void append_array_element(JsonArray *array,
+                                 guint index,
+                                 JsonNode *element_node,
+                                 gpointer user_data);
+
+void ipcam_json_writer_append_string(GString *string, const gchar *value)
+{
+    const gchar *start;
+    const gchar *p;
+
+    if (NULL == value)
+    {
+        g_string_append(string, "null");
+        return;
+    }
+
+    g_string_append_c(string, '"');
+    start = value;
+    for (p = value; *p; p++)
+    {
+        guchar c = (guchar)*p;
+        if (c >= 0x20 && c != '"' && c != '\\')
+            continue;
+
+        g_string_append_len(string, start, p - start);
+        switch (c)
+        {
+        case '"':  g_string_append(string, "\\\""); break;
+        case '\\': g_string_append(string, "\\\\"); break;
+        case '\b': g_string_append(string, "\\b"); break;
+        case '\f': g_string_append(string, "\\f"); break;
+        case '\n': g_string_append(string, "\\n"); break;
+        case '\r': g_string_append(string, "\\r"); break;
+        case '\t': g_string_append(string, "\\t"); break;
+        default:
+            g_string_append(string, "\\u00");
+            g_string_append_c(string, hex_digits[c >> 4]);
+            g_string_append_c(string, hex_digits[c & 0x0f]);
+            break;
+        }
+        start = p + 1;
+    }
+    g_string_append_len(string, start, p - start);
+    g_string_append_c(string, '"');
+}
+
+void ipcam_json_writer_append_member(GString *string, const gchar *name, const gchar *value)
+{
+    ipcam_json_writer_append_string(string, name);
+    g_string_append_c(string, ':');
+    ipcam_json_writer_append_string(string, value);
+}
+
+typedef struct _IpcamJsonWriterState
+{
+    GString *string;
+    gboolean first;
+} IpcamJsonWriterState;
+
+static void append_object_member(JsonObject *object,
+                                 const gchar *member_name,
+                                 JsonNode *member_node,
+                                 gpointer user_data)
+{
+    IpcamJsonWriterState *state = (IpcamJsonWriterState *)user_data;
+    if (!state->first)
+        g_string_append_c(state->string, ',');
+    state->first = FALSE;
+    ipcam_json_writer_append_string(state->string, member_name);
+    g_string_append_c(state->string, ':');
+    ipcam_json_writer_append_node(state->string, member_node);
+}
+
+static void append_array_element(JsonArray *array,
+                                 guint index,
+                                 JsonNode *element_node,
+                                 gpointer user_data)
+{
+    IpcamJsonWriterState *state = (IpcamJsonWriterState *)user_data;
+    if (!state->first)
+        g_string_append_c(state->string, ',');
+    state->first = FALSE;
+    ipcam_json_writer_append_node(state->string, element_node);
+}
+
+void ipcam_json_writer_append_node(GString *string, JsonNode *node)
+{
+    IpcamJsonWriterState state;
+    gchar buf[G_ASCII_DTOSTR_BUF_SIZE];
+
+    if (NULL == node)
+    {
+        g_string_append(string, "null");
+        return;
+    }
+
+    state.string = string;
+    state.first = TRUE;
+
+    switch (json_node_get_node_type(node))
+    {
+    case JSON_NODE_OBJECT:
+        g_string_append_c(string, '{');
+        json_object_foreach_member(json_node_get_object(node), append_object_member, &state);
+        g_string_append_c(string, '}');
+        break;
+    case JSON_NODE_ARRAY:
+        g_string_append_c(string, '[');
+        json_array_foreach_element(json_node_get_array(node), append_array_element, &state);
+        g_string_append_c(string, ']');
+        break;
+    case JSON_NODE_VALUE:
+        switch (json_node_get_value_type(node))
+        {
+        case G_TYPE_STRING:
+            ipcam_json_writer_append_string(string, json_node_get_string(node));
+            break;
+        case G_TYPE_INT64:
+            g_string_append_printf(string, "%" G_GINT64_FORMAT, json_node_get_int(node));
+            break;
+        case G_TYPE_DOUBLE:
+            g_string_append(string, g_ascii_dtostr(buf, sizeof(buf), json_node_get_double(node)));
+            break;
+        case G_TYPE_BOOLEAN:
+            g_string_append(string, json_node_get_boolean(node) ? "true" : "false");
+            break;
+        default:
+            g_string_append(string, "null");
+            break;
+        }
+        break;
+    case JSON_NODE_NULL:
+    default:
+        g_string_append(string, "null");
+        break;
+    }
+}
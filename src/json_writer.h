@@ -0,0 +1,15 @@
+#ifndef __JSON_WRITER_H__
+#define __JSON_WRITER_H__
+
+#include <glib.h>
+#include <json-glib/json-glib.h>
+
+/*
+ * Append JSON text straight into a GString, without going through a
+ * JsonBuilder/JsonGenerator pair.  Output is always compact.
+ */
+void ipcam_json_writer_append_string(GString *string, const gchar *value);
+void ipcam_json_writer_append_member(GString *string, const gchar *name, const gchar *value);
+void ipcam_json_writer_append_node(GString *string, JsonNode *node);
+
+#endif /* __JSON_WRITER_H__ */
@@ -1,5 +1,11 @@
 #include "messages.h"
+#include "message_pool.h"
+#include "message_schema.h"
+#include "json_scanner.h"
+#include "json_writer.h"
+#include "msgpack.h"
 #include <json-glib/json-glib.h>
+#include <zlib.h>
 #include <string.h>
 #include <assert.h>
 
@@ -15,17 +21,82 @@ enum
     N_PROPERTIES
 };
 
+/*
+ * The body is kept in whichever form it arrived in.  A received body is
+ * just its raw bytes, JSON text or MessagePack; the json-glib view is
+ * built the first time it is asked for, and the other encoding only when
+ * the body is sent on a socket that uses it.  A body may be shared between
+ * messages, so forwarding or answering a message never deep-copies it.
+ * Messages sharing a body may be used on different threads, so the forms
+ * filled in on demand are guarded by the body's mutex.  A filled form is
+ * only ever replaced once the node was handed out, and such a body is no
+ * longer shared.
+ */
+typedef struct _IpcamMessageBody
+{
+    gint ref_count;
+    /* Guards everything below */
+    GMutex mutex;
+    GBytes *raw[IPCAM_MESSAGE_ENCODING_LAST];
+    /* Deflated copies of raw, made once however many times it is sent */
+    GBytes *deflated[IPCAM_MESSAGE_ENCODING_LAST];
+    JsonNode *node;
+    gboolean exposed;
+    /* Parsing failed once, it is neither retried nor warned about again */
+    gboolean broken;
+} IpcamMessageBody;
+
+/*
+ * The last frames a message was serialized to, per encoding.  Sending
+ * the same message again, on another publisher or on a retry, hands out
+ * new references to them; zmq frames borrow the bytes, so fan-out never
+ * copies.  Any change to the message drops them.
+ */
+typedef struct _IpcamMessageWire
+{
+    GBytes *frames[2];
+    IpcamMessageFraming framing;
+    gsize threshold;
+    gsize saved;
+} IpcamMessageWire;
+
 typedef struct _IpcamMessagePrivate
 {
+    IpcamMessageKind kind;
     gchar *type;
     gchar *token;
     gchar *version;
-    JsonNode *body;
+    IpcamMessageBody *body;
+    IpcamMessagePool *pool;
+    IpcamMessageWire wire[IPCAM_MESSAGE_ENCODING_LAST];
 } IpcamMessagePrivate;
 
 G_DEFINE_TYPE_WITH_PRIVATE(IpcamMessage, ipcam_message, G_TYPE_OBJECT);
 
 static GParamSpec *obj_properties[N_PROPERTIES] = {NULL, };
+static gboolean pretty_print = FALSE;
+
+static IpcamMessageBody *ipcam_message_body_new(GBytes *raw,
+                                                IpcamMessageEncoding encoding,
+                                                JsonNode *node);
+static IpcamMessageBody *ipcam_message_body_ref(IpcamMessageBody *body);
+static void ipcam_message_body_unref(IpcamMessageBody *body);
+static JsonNode *ipcam_message_body_get_node(IpcamMessageBody *body);
+static GBytes *ipcam_message_body_get_raw(IpcamMessageBody *body, IpcamMessageEncoding encoding);
+static JsonNode *ipcam_message_expose_body(IpcamMessage *message);
+
+static IpcamMessageKind ipcam_message_kind_from_string(const gchar *type)
+{
+    if (NULL == type)
+        return IPCAM_MESSAGE_KIND_UNKNOWN;
+    if (0 == strcmp(type, "request"))
+        return IPCAM_MESSAGE_KIND_REQUEST;
+    if (0 == strcmp(type, "response"))
+        return IPCAM_MESSAGE_KIND_RESPONSE;
+    if (0 == strcmp(type, "notice"))
+        return IPCAM_MESSAGE_KIND_NOTICE;
+    return IPCAM_MESSAGE_KIND_UNKNOWN;
+}
 
 static GObject *ipcam_message_constructor(GType self_type,
                                           guint n_properties,
@@ -37,11 +108,21 @@ static GObject *ipcam_message_constructor(GType self_type,
 }
 static void ipcam_message_dispose(GObject *self)
 {
-    static gboolean first_run = TRUE;
-    if (first_run)
+    IpcamMessagePrivate *priv = ipcam_message_get_instance_private(IPCAM_MESSAGE(self));
+    IpcamMessagePool *pool = priv->pool;
+
+    G_OBJECT_CLASS(ipcam_message_parent_class)->dispose(self);
+
+    /*
+     * A pooled message goes back to its pool instead of being finalized,
+     * the pool takes a new reference on it.  Idle messages do not point
+     * back at the pool, or the two would keep each other alive.
+     */
+    if (pool)
     {
-        first_run = FALSE;
-        G_OBJECT_CLASS(ipcam_message_parent_class)->dispose(self);
+        priv->pool = NULL;
+        ipcam_message_pool_recycle(pool, IPCAM_MESSAGE(self));
+        g_object_unref(pool);
     }
 }
 static void ipcam_message_finalize(GObject *self)
@@ -52,8 +133,9 @@ static void ipcam_message_finalize(GObject *self)
     g_free(priv->version);
     if (priv->body)
     {
-        json_node_free(priv->body);
+        ipcam_message_body_unref(priv->body);
     }
+    ipcam_message_invalidate(IPCAM_MESSAGE(self));
     G_OBJECT_CLASS(ipcam_message_parent_class)->finalize(self);
 }
 static void ipcam_message_get_property(GObject *object,
@@ -82,7 +164,7 @@ static void ipcam_message_get_property(GObject *object,
         break;
     case IPCAM_MESSAGE_BODY:
         {
-            g_value_set_pointer(value, priv->body);
+            g_value_set_pointer(value, ipcam_message_expose_body(self));
         }
         break;
     default:
@@ -96,35 +178,26 @@ static void ipcam_message_set_property(GObject *object,
                                        GParamSpec *pspec)
 {
     IpcamMessage *self = IPCAM_MESSAGE(object);
-    IpcamMessagePrivate *priv = ipcam_message_get_instance_private(self);
     switch(property_id)
     {
     case IPCAM_MESSAGE_MSGTYPE:
         {
-            g_free(priv->type);
-            priv->type = g_value_dup_string(value);
-            /* g_print("ipcam message type: %s\n", priv->type); */
+            ipcam_message_set_message_type(self, g_value_get_string(value));
         }
         break;
     case IPCAM_MESSAGE_TOKEN:
         {
-            g_free(priv->token);
-            priv->token = g_value_dup_string(value);
-            /* g_print("ipcam message token: %s\n", priv->token); */
+            ipcam_message_set_token(self, g_value_get_string(value));
         }
         break;
     case IPCAM_MESSAGE_VERSION:
         {
-            g_free(priv->version);
-            priv->version = g_value_dup_string(value);
-            /* g_print("ipcam message version: %s\n", priv->version); */
+            ipcam_message_set_version(self, g_value_get_string(value));
         }
         break;
     case IPCAM_MESSAGE_BODY:
         {
-            json_node_free(priv->body);
-            priv->body = g_value_get_pointer(value);
-            /* g_print("ipcam message body: %p\n", priv->body); */
+            ipcam_message_set_body(self, g_value_get_pointer(value));
         }
         break;
     default:
@@ -135,15 +208,30 @@ static void ipcam_message_set_property(GObject *object,
 static void ipcam_message_init(IpcamMessage *self)
 {
     IpcamMessagePrivate *priv = ipcam_message_get_instance_private(self);
+    priv->kind = IPCAM_MESSAGE_KIND_UNKNOWN;
     priv->type = g_strdup("");
     priv->token = g_strdup("");
     priv->version = g_strdup("1.0");
     priv->body = NULL;
+    priv->pool = NULL;
+}
+static void ipcam_message_real_reset(IpcamMessage *self)
+{
+    IpcamMessagePrivate *priv = ipcam_message_get_instance_private(self);
+    ipcam_message_set_token(self, "");
+    ipcam_message_set_version(self, "1.0");
+    if (priv->body)
+    {
+        ipcam_message_body_unref(priv->body);
+        priv->body = NULL;
+    }
+    ipcam_message_invalidate(self);
 }
 static void ipcam_message_class_init(IpcamMessageClass *klass)
 {
     GObjectClass *this_class = G_OBJECT_CLASS(klass);
     
+    klass->reset = &ipcam_message_real_reset;
     this_class->constructor = &ipcam_message_constructor;
     this_class->dispose = &ipcam_message_dispose;
     this_class->finalize = &ipcam_message_finalize;
@@ -177,167 +265,1696 @@ static void ipcam_message_class_init(IpcamMessageClass *klass)
     g_object_class_install_properties(this_class, N_PROPERTIES, obj_properties);
 }
 
-static gboolean ipcam_message_validate_message(JsonNode *json)
+static IpcamMessageBody *ipcam_message_body_new(GBytes *raw,
+                                                IpcamMessageEncoding encoding,
+                                                JsonNode *node)
 {
-    // ToDo
-    return TRUE;
+    IpcamMessageBody *body = g_new0(IpcamMessageBody, 1);
+    body->ref_count = 1;
+    body->raw[encoding] = raw ? g_bytes_ref(raw) : NULL;
+    body->node = node;
+    body->exposed = FALSE;
+    g_mutex_init(&body->mutex);
+    return body;
 }
 
-IpcamMessage *ipcam_message_parse_from_string(const gchar *json_str)
+static IpcamMessageBody *ipcam_message_body_ref(IpcamMessageBody *body)
 {
-    IpcamMessage *message = NULL;
-    JsonParser *parser = json_parser_new();
-    JsonNode *jmsg;
+    g_atomic_int_inc(&body->ref_count);
+    return body;
+}
 
-    if (!json_parser_load_from_data(parser, json_str, -1, NULL))
+static void ipcam_message_body_unref(IpcamMessageBody *body)
+{
+    if (g_atomic_int_dec_and_test(&body->ref_count))
     {
-        g_object_unref(parser);
-        return NULL;
+        gint i;
+        for (i = 0; i < IPCAM_MESSAGE_ENCODING_LAST; i++)
+        {
+            if (body->raw[i])
+            {
+                g_bytes_unref(body->raw[i]);
+            }
+            if (body->deflated[i])
+            {
+                g_bytes_unref(body->deflated[i]);
+            }
+        }
+        if (body->node)
+        {
+            json_node_free(body->node);
+        }
+        g_mutex_clear(&body->mutex);
+        g_free(body);
     }
-    jmsg = json_parser_get_root(parser);
-    if (!ipcam_message_validate_message(jmsg))
+}
+
+/* With the body's mutex held */
+static JsonNode *ipcam_message_body_parse(IpcamMessageBody *body)
+{
+    gsize size;
+    const gchar *data;
+
+    if (body->node || body->broken)
     {
-        g_object_unref(parser);
-        return NULL;
+        return body->node;
     }
 
-    JsonObject *head = json_object_get_object_member(json_node_get_object(jmsg), "head");
-    const gchar *type = json_object_get_string_member(head, "type");
-    const gchar *token = json_object_get_string_member(head, "token");
-    const gchar *version = json_object_get_string_member(head, "version");
+    if (body->raw[IPCAM_MESSAGE_ENCODING_JSON])
+    {
+        data = g_bytes_get_data(body->raw[IPCAM_MESSAGE_ENCODING_JSON], &size);
+        if (size == 4 && 0 == strncmp(data, "null", 4))
+        {
+            body->node = json_node_new(JSON_NODE_NULL);
+        }
+        else
+        {
+            JsonParser *parser = json_parser_new();
+            if (json_parser_load_from_data(parser, data, size, NULL))
+            {
+                body->node = json_node_copy(json_parser_get_root(parser));
+            }
+            g_object_unref(parser);
+        }
+    }
+    else if (body->raw[IPCAM_MESSAGE_ENCODING_MSGPACK])
+    {
+        data = g_bytes_get_data(body->raw[IPCAM_MESSAGE_ENCODING_MSGPACK], &size);
+        body->node = ipcam_msgpack_to_json_node(data, size);
+    }
 
-    if (0 == strcmp(type, "request"))
+    if (NULL == body->node)
     {
-        const gchar *action = json_object_get_string_member(head, "action");
-        const gchar *id = json_object_get_string_member(head, "id");
-        message = g_object_new(IPCAM_REQUEST_MESSAGE_TYPE, "action", action, "id", id, NULL);
+        body->broken = TRUE;
+        g_warning("Failed to parse message body.");
     }
-    else if (0 == strcmp(type, "response"))
+    return body->node;
+}
+
+static JsonNode *ipcam_message_body_get_node(IpcamMessageBody *body)
+{
+    JsonNode *node;
+
+    g_mutex_lock(&body->mutex);
+    node = ipcam_message_body_parse(body);
+    g_mutex_unlock(&body->mutex);
+    return node;
+}
+
+/* Whether the node was handed out, so the raw forms may be stale */
+static gboolean ipcam_message_body_is_exposed(IpcamMessageBody *body)
+{
+    gboolean exposed;
+
+    g_mutex_lock(&body->mutex);
+    exposed = body->exposed && body->node;
+    g_mutex_unlock(&body->mutex);
+    return exposed;
+}
+
+/* The raw form as it is, NULL if it was not produced yet */
+static GBytes *ipcam_message_body_peek_raw(IpcamMessageBody *body, IpcamMessageEncoding encoding)
+{
+    GBytes *raw;
+
+    g_mutex_lock(&body->mutex);
+    raw = body->raw[encoding];
+    g_mutex_unlock(&body->mutex);
+    return raw;
+}
+
+/* With the body's mutex held */
+static GBytes *ipcam_message_body_fill_raw(IpcamMessageBody *body, IpcamMessageEncoding encoding)
+{
+    JsonNode *node;
+
+    /* An exposed node may have changed since the raw form was produced */
+    if (body->raw[encoding] && !(body->exposed && body->node))
     {
-        const gchar *action = json_object_get_string_member(head, "action");
-        const gchar *id = json_object_get_string_member(head, "id");
-        const gchar *code = json_object_get_string_member(head, "code");
-        message = g_object_new(IPCAM_RESPONSE_MESSAGE_TYPE, "action", action, "id", id, "code", code, NULL);
+        return body->raw[encoding];
     }
-    else if (0 == strcmp(type, "notice"))
+
+    node = ipcam_message_body_parse(body);
+    if (NULL == node)
     {
-        const gchar *event = json_object_get_string_member(head, "event");
-        message = g_object_new(IPCAM_NOTICE_MESSAGE_TYPE, "event", event, NULL);
+        return NULL;
     }
-    if (NULL != message)
+    if (body->raw[encoding])
+    {
+        g_bytes_unref(body->raw[encoding]);
+    }
+    if (body->deflated[encoding])
+    {
+        g_bytes_unref(body->deflated[encoding]);
+        body->deflated[encoding] = NULL;
+    }
+    if (encoding == IPCAM_MESSAGE_ENCODING_MSGPACK)
     {
-        JsonNode *body = json_object_get_member(json_node_get_object(jmsg), "body");
-        g_object_set(G_OBJECT(message),
-                     "token", token,
-                     "version", version,
-                     "body", json_node_copy(body),
-                     NULL);
+        GByteArray *buffer = g_byte_array_sized_new(256);
+        ipcam_msgpack_write_json_node(buffer, node);
+        body->raw[encoding] = g_byte_array_free_to_bytes(buffer);
     }
+    else
+    {
+        GString *string = g_string_sized_new(256);
+        gsize length;
 
-    g_object_unref(parser);
+        ipcam_json_writer_append_node(string, node);
+        length = string->len;
+        body->raw[encoding] = g_bytes_new_take(g_string_free(string, FALSE), length);
+    }
+    return body->raw[encoding];
+}
 
-    return message;
+static GBytes *ipcam_message_body_get_raw(IpcamMessageBody *body, IpcamMessageEncoding encoding)
+{
+    GBytes *raw;
+
+    g_mutex_lock(&body->mutex);
+    raw = ipcam_message_body_fill_raw(body, encoding);
+    g_mutex_unlock(&body->mutex);
+    return raw;
 }
 
-gboolean ipcam_message_is_request(IpcamMessage *message)
+/* A body of its own with the same content, it parses its own node */
+static IpcamMessageBody *ipcam_message_body_copy(IpcamMessageBody *body)
 {
-    g_return_val_if_fail(IPCAM_IS_MESSAGE(message), FALSE);
-    IpcamMessagePrivate *priv = ipcam_message_get_instance_private(message);
-    return (0 == strcmp(priv->type, "request"));
+    GBytes *raw = ipcam_message_body_get_raw(body, IPCAM_MESSAGE_ENCODING_JSON);
+    return raw ? ipcam_message_body_new(raw, IPCAM_MESSAGE_ENCODING_JSON, NULL) : NULL;
 }
-gboolean ipcam_message_is_response(IpcamMessage *message)
+
+/*
+ * For the getters that hand out the node, which may be modified in place:
+ * a shared body is copied first, so the change stays in this message, and
+ * the raw forms can no longer be trusted to match the node.
+ */
+static JsonNode *ipcam_message_expose_body(IpcamMessage *message)
 {
-    g_return_val_if_fail(IPCAM_IS_MESSAGE(message), FALSE);
     IpcamMessagePrivate *priv = ipcam_message_get_instance_private(message);
-    return (0 == strcmp(priv->type, "response"));
+    JsonNode *node;
+
+    if (NULL == priv->body)
+    {
+        return NULL;
+    }
+    if (g_atomic_int_get(&priv->body->ref_count) > 1)
+    {
+        IpcamMessageBody *body = ipcam_message_body_copy(priv->body);
+        if (NULL == body)
+        {
+            return NULL;
+        }
+        ipcam_message_body_unref(priv->body);
+        priv->body = body;
+    }
+    g_mutex_lock(&priv->body->mutex);
+    node = ipcam_message_body_parse(priv->body);
+    priv->body->exposed = TRUE;
+    g_mutex_unlock(&priv->body->mutex);
+    ipcam_message_invalidate(message);
+    return node;
 }
-gboolean ipcam_message_is_notice(IpcamMessage *message)
+
+/* Call after ipcam_message_body_get_raw(), which drops a stale copy */
+static GBytes *ipcam_message_body_get_deflated(IpcamMessageBody *body,
+                                               IpcamMessageEncoding encoding,
+                                               gint64 *time_us)
 {
-    g_return_val_if_fail(IPCAM_IS_MESSAGE(message), FALSE);
-    IpcamMessagePrivate *priv = ipcam_message_get_instance_private(message);
-    return (0 == strcmp(priv->type, "notice"));
+    gsize size;
+    const Bytef *data;
+    uLongf length;
+    Bytef *buffer;
+    gint64 start;
+    GBytes *deflated;
+
+    g_mutex_lock(&body->mutex);
+    if (body->deflated[encoding])
+    {
+        deflated = body->deflated[encoding];
+        g_mutex_unlock(&body->mutex);
+        return deflated;
+    }
+
+    start = g_get_monotonic_time();
+    data = g_bytes_get_data(body->raw[encoding], &size);
+    length = compressBound(size);
+    buffer = g_malloc(length);
+    if (Z_OK != compress2(buffer, &length, data, size, Z_BEST_SPEED))
+    {
+        g_mutex_unlock(&body->mutex);
+        g_free(buffer);
+        return NULL;
+    }
+    deflated = g_bytes_new_take(g_realloc(buffer, length), length);
+    body->deflated[encoding] = deflated;
+    g_mutex_unlock(&body->mutex);
+    *time_us += g_get_monotonic_time() - start;
+    return deflated;
 }
 
-const gchar *ipcam_message_to_string(IpcamMessage *message)
+/* A peer cannot make us allocate more than this by sending a small frame */
+#define IPCAM_MESSAGE_MAX_INFLATED_SIZE (16 * 1024 * 1024)
+
+static GBytes *ipcam_message_inflate(const guint8 *data, gsize size)
 {
-    g_return_val_if_fail(IPCAM_IS_MESSAGE(message), NULL);
+    z_stream stream;
+    GByteArray *buffer;
+    gint ret;
 
-    JsonBuilder *builder = json_builder_new();
-    assert(builder);
-    JsonGenerator *generator = json_generator_new();
-    assert(generator);
+    memset(&stream, 0, sizeof(stream));
+    if (Z_OK != inflateInit(&stream))
+    {
+        return NULL;
+    }
+    stream.next_in = (Bytef *)data;
+    stream.avail_in = size;
 
-    gchar *strval = NULL;
-    IpcamMessagePrivate *priv = ipcam_message_get_instance_private(message);
+    buffer = g_byte_array_sized_new(MIN(size * 4, IPCAM_MESSAGE_MAX_INFLATED_SIZE));
+    do
+    {
+        guint offset = buffer->len;
+        guint chunk = MIN(MAX(offset, 16384), IPCAM_MESSAGE_MAX_INFLATED_SIZE - offset);
+        if (0 == chunk)
+        {
+            ret = Z_MEM_ERROR;
+            break;
+        }
+        g_byte_array_set_size(buffer, offset + chunk);
+        stream.next_out = buffer->data + offset;
+        stream.avail_out = chunk;
+        ret = inflate(&stream, Z_NO_FLUSH);
+        g_byte_array_set_size(buffer, offset + chunk - stream.avail_out);
+    } while (Z_OK == ret);
+    inflateEnd(&stream);
 
-    json_builder_begin_object(builder);     /* begin root */
-    json_builder_set_member_name(builder, "head");
-    json_builder_begin_object(builder);     /* begin head */
-    json_builder_set_member_name(builder, "type");
-    json_builder_add_string_value(builder, priv->type);
-    json_builder_set_member_name(builder, "token");
-    json_builder_add_string_value(builder, priv->token);
-    json_builder_set_member_name(builder, "version");
-    json_builder_add_string_value(builder, priv->version);
-    
-    if (ipcam_message_is_notice(message))
-    {
-        g_object_get(G_OBJECT(message), "event", &strval, NULL);
-        json_builder_set_member_name(builder, "event");
-        json_builder_add_string_value(builder, strval);
-        g_free(strval);
-    }
-    else if (ipcam_message_is_request(message))
-    {
-        g_object_get(G_OBJECT(message), "action", &strval, NULL);
-        json_builder_set_member_name(builder, "action");
-        json_builder_add_string_value(builder, strval);
-        g_free(strval);
-        g_object_get(G_OBJECT(message), "id", &strval, NULL);
-        json_builder_set_member_name(builder, "id");
-        json_builder_add_string_value(builder, strval);
-        g_free(strval);
-    }
-    else if (ipcam_message_is_response(message))
-    {
-        g_object_get(G_OBJECT(message), "action", &strval, NULL);
-        json_builder_set_member_name(builder, "action");
-        json_builder_add_string_value(builder, strval);
-        g_free(strval);
-        g_object_get(G_OBJECT(message), "id", &strval, NULL);
-        json_builder_set_member_name(builder, "id");
-        json_builder_add_string_value(builder, strval);
-        g_free(strval);
-        g_object_get(G_OBJECT(message), "code", &strval, NULL);
-        json_builder_set_member_name(builder, "code");
-        json_builder_add_string_value(builder, strval);
-        g_free(strval);
+    if (Z_STREAM_END != ret || 0 != stream.avail_in)
+    {
+        g_byte_array_free(buffer, TRUE);
+        return NULL;
     }
-    else
+    return g_byte_array_free_to_bytes(buffer);
+}
+
+/*
+ * A split body frame is the bare deflated bytes.  Inside a single frame
+ * envelope the deflated body is a bin value in MessagePack and a base64
+ * string in JSON, so the envelope stays valid text.
+ */
+/* The same cheap check an inline body gets from the envelope scan */
+static gboolean ipcam_message_json_body_valid(GBytes *body)
+{
+    IpcamJsonScanner scanner;
+    gsize size;
+    const gchar *data = g_bytes_get_data(body, &size);
+
+    ipcam_json_scanner_init(&scanner, data, size);
+    return ipcam_json_scanner_skip_value(&scanner) && ipcam_json_scanner_at_end(&scanner);
+}
+
+static GBytes *ipcam_message_decompress_body(GBytes *body,
+                                             IpcamMessageEncoding encoding,
+                                             gboolean embedded,
+                                             const gchar *compression)
+{
+    gsize size;
+    const gchar *data = g_bytes_get_data(body, &size);
+
+    if (0 != g_strcmp0(compression, "zlib"))
     {
-        g_warning ("Class '%s' does not have a valid message type",
-                   G_OBJECT_TYPE_NAME(message));
+        return NULL;
     }
-    json_builder_end_object(builder);               /* end head */
-    json_builder_set_member_name(builder, "body");  /* begin body */
-    if (priv->body)
+    if (!embedded)
+    {
+        return ipcam_message_inflate((const guint8 *)data, size);
+    }
+
+    if (encoding == IPCAM_MESSAGE_ENCODING_MSGPACK)
     {
-        json_builder_add_value(builder, json_node_copy(priv->body));
+        IpcamMsgpackReader reader;
+        IpcamMsgpackValue value;
+
+        ipcam_msgpack_reader_init(&reader, data, size);
+        if (!ipcam_msgpack_read(&reader, &value) ||
+            value.type != IPCAM_MSGPACK_TYPE_BIN ||
+            reader.pos != reader.end)
+        {
+            return NULL;
+        }
+        return ipcam_message_inflate((const guint8 *)value.v.str.data, value.v.str.length);
     }
     else
     {
-        json_builder_add_null_value(builder);
+        IpcamJsonScanner scanner;
+        GBytes *plain = NULL;
+        gchar *text;
+
+        ipcam_json_scanner_init(&scanner, data, size);
+        text = ipcam_json_scanner_read_string(&scanner);
+        if (text && ipcam_json_scanner_at_end(&scanner))
+        {
+            gsize length;
+            guchar *deflated = g_base64_decode(text, &length);
+            plain = ipcam_message_inflate(deflated, length);
+            g_free(deflated);
+        }
+        if (plain && !ipcam_message_json_body_valid(plain))
+        {
+            g_bytes_unref(plain);
+            plain = NULL;
+        }
+        g_free(text);
+        return plain;
     }
-    json_builder_end_object(builder);               /* end root */
+}
 
-    JsonNode *msg_root = json_builder_get_root(builder);
-    json_generator_set_root(generator, msg_root);
-    json_generator_set_pretty(generator, TRUE);
-    
-    const gchar *string = json_generator_to_data(generator, NULL);
-    json_node_free(msg_root);
-    g_object_unref(generator);
-    g_object_unref(builder);
-    
-    return string;
+typedef struct _IpcamMessageHead
+{
+    gchar *type;
+    gchar *token;
+    gchar *version;
+    gchar *action;
+    gchar *event;
+    gchar *id;
+    gchar *code;
+    gchar *compression;
+} IpcamMessageHead;
+
+static void ipcam_message_head_clear(IpcamMessageHead *head)
+{
+    g_free(head->type);
+    g_free(head->token);
+    g_free(head->version);
+    g_free(head->action);
+    g_free(head->event);
+    g_free(head->id);
+    g_free(head->code);
+    g_free(head->compression);
+}
+
+static gchar **ipcam_message_head_field(IpcamMessageHead *head, const gchar *name)
+{
+    if (0 == strcmp(name, "type")) return &head->type;
+    if (0 == strcmp(name, "token")) return &head->token;
+    if (0 == strcmp(name, "version")) return &head->version;
+    if (0 == strcmp(name, "action")) return &head->action;
+    if (0 == strcmp(name, "event")) return &head->event;
+    if (0 == strcmp(name, "id")) return &head->id;
+    if (0 == strcmp(name, "code")) return &head->code;
+    if (0 == strcmp(name, "compression")) return &head->compression;
+    return NULL;
+}
+
+static gboolean ipcam_message_scan_head(IpcamJsonScanner *scanner, IpcamMessageHead *head)
+{
+    if (!ipcam_json_scanner_expect(scanner, '{'))
+        return FALSE;
+    if (ipcam_json_scanner_expect(scanner, '}'))
+        return TRUE;
+
+    do
+    {
+        gchar *name = ipcam_json_scanner_read_string(scanner);
+        gchar **field;
+        if (!name || !ipcam_json_scanner_expect(scanner, ':'))
+        {
+            g_free(name);
+            return FALSE;
+        }
+        field = ipcam_message_head_field(head, name);
+        g_free(name);
+        if (field && ipcam_json_scanner_peek(scanner) == '"')
+        {
+            g_free(*field);
+            *field = ipcam_json_scanner_read_string(scanner);
+            if (!*field)
+                return FALSE;
+        }
+        else if (!ipcam_json_scanner_skip_value(scanner))
+        {
+            return FALSE;
+        }
+    } while (ipcam_json_scanner_expect(scanner, ','));
+
+    return ipcam_json_scanner_expect(scanner, '}');
+}
+
+/*
+ * Scan the envelope without building a tree: the head members are decoded
+ * in place and the body is only located; its text is kept verbatim and is
+ * parsed the first time somebody asks for the body.  Locating the body
+ * checks scalars and bracket matching, so a broken scalar or unbalanced
+ * body drops the message here; any other syntax error only shows up when
+ * the body is parsed, as a NULL body.
+ */
+static gboolean ipcam_message_scan(const gchar *data,
+                                   gsize length,
+                                   IpcamMessageHead *head,
+                                   const gchar **body_start,
+                                   const gchar **body_end)
+{
+    IpcamJsonScanner scanner;
+    gboolean has_head = FALSE;
+
+    ipcam_json_scanner_init(&scanner, data, length);
+    if (!ipcam_json_scanner_expect(&scanner, '{'))
+        return FALSE;
+    if (!ipcam_json_scanner_expect(&scanner, '}'))
+    {
+        do
+        {
+            gchar *name = ipcam_json_scanner_read_string(&scanner);
+            if (!name || !ipcam_json_scanner_expect(&scanner, ':'))
+            {
+                g_free(name);
+                return FALSE;
+            }
+            if (0 == strcmp(name, "head"))
+            {
+                has_head = ipcam_message_scan_head(&scanner, head);
+                if (!has_head)
+                {
+                    g_free(name);
+                    return FALSE;
+                }
+            }
+            else if (0 == strcmp(name, "body"))
+            {
+                ipcam_json_scanner_peek(&scanner);
+                *body_start = scanner.pos;
+                if (!ipcam_json_scanner_skip_value(&scanner))
+                {
+                    g_free(name);
+                    return FALSE;
+                }
+                *body_end = scanner.pos;
+            }
+            else if (!ipcam_json_scanner_skip_value(&scanner))
+            {
+                g_free(name);
+                return FALSE;
+            }
+            g_free(name);
+        } while (ipcam_json_scanner_expect(&scanner, ','));
+
+        if (!ipcam_json_scanner_expect(&scanner, '}'))
+            return FALSE;
+    }
+
+    return has_head && ipcam_json_scanner_at_end(&scanner);
+}
+
+static gboolean ipcam_message_scan_msgpack_head(IpcamMsgpackReader *reader, IpcamMessageHead *head)
+{
+    IpcamMsgpackValue value;
+    guint32 i, count;
+
+    if (!ipcam_msgpack_read(reader, &value) || value.type != IPCAM_MSGPACK_TYPE_MAP)
+        return FALSE;
+
+    count = value.v.count;
+    for (i = 0; i < count; i++)
+    {
+        IpcamMsgpackReader saved;
+        gchar **field = NULL;
+
+        if (!ipcam_msgpack_read(reader, &value) || value.type != IPCAM_MSGPACK_TYPE_STR)
+            return FALSE;
+        if (value.v.str.length < 16)
+        {
+            gchar name[16];
+            memcpy(name, value.v.str.data, value.v.str.length);
+            name[value.v.str.length] = '\0';
+            field = ipcam_message_head_field(head, name);
+        }
+
+        saved = *reader;
+        if (!ipcam_msgpack_read(reader, &value))
+            return FALSE;
+        if (field && value.type == IPCAM_MSGPACK_TYPE_STR)
+        {
+            g_free(*field);
+            *field = g_strndup(value.v.str.data, value.v.str.length);
+        }
+        else
+        {
+            *reader = saved;
+            if (!ipcam_msgpack_skip(reader))
+                return FALSE;
+        }
+    }
+    return TRUE;
+}
+
+static gboolean ipcam_message_scan_msgpack(const gchar *data,
+                                           gsize length,
+                                           IpcamMessageHead *head,
+                                           const gchar **body_start,
+                                           const gchar **body_end)
+{
+    IpcamMsgpackReader reader;
+    IpcamMsgpackValue value;
+    gboolean has_head = FALSE;
+    guint32 i, count;
+
+    ipcam_msgpack_reader_init(&reader, data, length);
+    if (!ipcam_msgpack_read(&reader, &value) || value.type != IPCAM_MSGPACK_TYPE_MAP)
+        return FALSE;
+
+    count = value.v.count;
+    for (i = 0; i < count; i++)
+    {
+        if (!ipcam_msgpack_read(&reader, &value) || value.type != IPCAM_MSGPACK_TYPE_STR)
+            return FALSE;
+        if (ipcam_msgpack_str_equal(&value, "head"))
+        {
+            has_head = ipcam_message_scan_msgpack_head(&reader, head);
+            if (!has_head)
+                return FALSE;
+        }
+        else if (ipcam_msgpack_str_equal(&value, "body"))
+        {
+            *body_start = (const gchar *)reader.pos;
+            if (!ipcam_msgpack_skip(&reader))
+                return FALSE;
+            *body_end = (const gchar *)reader.pos;
+        }
+        else if (!ipcam_msgpack_skip(&reader))
+        {
+            return FALSE;
+        }
+    }
+
+    return has_head && reader.pos == reader.end;
+}
+
+/* Ids, tokens and names are short; anything longer is garbage */
+#define IPCAM_MESSAGE_HEAD_FIELD_MAX_LENGTH 128
+
+static gboolean ipcam_message_head_field_valid(const gchar *field, gboolean required)
+{
+    if (NULL == field)
+        return !required;
+    return strlen(field) <= IPCAM_MESSAGE_HEAD_FIELD_MAX_LENGTH;
+}
+
+static gboolean ipcam_message_validate_message(IpcamMessageHead *head)
+{
+    if (!ipcam_message_head_field_valid(head->token, FALSE) ||
+        !ipcam_message_head_field_valid(head->version, FALSE))
+    {
+        return FALSE;
+    }
+    if (head->compression && 0 != strcmp(head->compression, "zlib"))
+    {
+        return FALSE;
+    }
+
+    switch (ipcam_message_kind_from_string(head->type))
+    {
+    case IPCAM_MESSAGE_KIND_REQUEST:
+        return ipcam_message_head_field_valid(head->action, TRUE) &&
+            ipcam_message_head_field_valid(head->id, TRUE);
+    case IPCAM_MESSAGE_KIND_RESPONSE:
+        return ipcam_message_head_field_valid(head->action, TRUE) &&
+            ipcam_message_head_field_valid(head->id, TRUE) &&
+            ipcam_message_head_field_valid(head->code, FALSE);
+    case IPCAM_MESSAGE_KIND_NOTICE:
+        return ipcam_message_head_field_valid(head->event, TRUE);
+    default:
+        return FALSE;
+    }
+}
+
+IpcamMessage *ipcam_message_parse_from_string(const gchar *json_str)
+{
+    g_return_val_if_fail(json_str, NULL);
+    return ipcam_message_parse_from_data(json_str, strlen(json_str));
+}
+
+static IpcamMessage *ipcam_message_new_of_kind(IpcamMessagePool *pool, IpcamMessageKind kind)
+{
+    if (pool)
+    {
+        return ipcam_message_pool_acquire(pool, kind);
+    }
+    switch (kind)
+    {
+    case IPCAM_MESSAGE_KIND_REQUEST:
+        return g_object_new(IPCAM_REQUEST_MESSAGE_TYPE, NULL);
+    case IPCAM_MESSAGE_KIND_RESPONSE:
+        return g_object_new(IPCAM_RESPONSE_MESSAGE_TYPE, NULL);
+    case IPCAM_MESSAGE_KIND_NOTICE:
+        return g_object_new(IPCAM_NOTICE_MESSAGE_TYPE, NULL);
+    default:
+        return NULL;
+    }
+}
+
+static IpcamMessage *ipcam_message_new_from_head(IpcamMessagePool *pool,
+                                                 IpcamMessageHead *head,
+                                                 GBytes *body,
+                                                 IpcamMessageEncoding encoding)
+{
+    IpcamMessage *message = NULL;
+    IpcamMessageKind kind;
+
+    if (!ipcam_message_validate_message(head))
+    {
+        return NULL;
+    }
+
+    kind = ipcam_message_kind_from_string(head->type);
+    if (IPCAM_MESSAGE_KIND_UNKNOWN == kind)
+    {
+        return NULL;
+    }
+    message = ipcam_message_new_of_kind(pool, kind);
+
+    switch (kind)
+    {
+    case IPCAM_MESSAGE_KIND_REQUEST:
+        ipcam_request_message_set_action(IPCAM_REQUEST_MESSAGE(message), head->action);
+        ipcam_request_message_set_id(IPCAM_REQUEST_MESSAGE(message), head->id);
+        break;
+    case IPCAM_MESSAGE_KIND_RESPONSE:
+        ipcam_response_message_set_action(IPCAM_RESPONSE_MESSAGE(message), head->action);
+        ipcam_response_message_set_id(IPCAM_RESPONSE_MESSAGE(message), head->id);
+        ipcam_response_message_set_code(IPCAM_RESPONSE_MESSAGE(message), head->code);
+        break;
+    case IPCAM_MESSAGE_KIND_NOTICE:
+        ipcam_notice_message_set_event(IPCAM_NOTICE_MESSAGE(message), head->event);
+        break;
+    default:
+        break;
+    }
+    if (NULL != message)
+    {
+        IpcamMessagePrivate *priv = ipcam_message_get_instance_private(message);
+        ipcam_message_set_token(message, head->token);
+        ipcam_message_set_version(message, head->version);
+        if (body)
+        {
+            priv->body = ipcam_message_body_new(body, encoding, NULL);
+        }
+    }
+
+    return message;
+}
+
+/*
+ * When the text comes in a GBytes, typically a received zmq frame, the
+ * body is a slice of it and keeps it alive; nothing is copied.
+ */
+static IpcamMessage *ipcam_message_parse(IpcamMessagePool *pool,
+                                         GBytes *owner,
+                                         const gchar *data,
+                                         gsize length)
+{
+    IpcamMessage *message = NULL;
+    IpcamMessageHead head = {NULL, };
+    const gchar *body_start = NULL;
+    const gchar *body_end = NULL;
+    IpcamMessageEncoding encoding;
+    gboolean scanned;
+
+    g_return_val_if_fail(data, NULL);
+
+    /* A MessagePack envelope starts with a map tag, which no JSON text does */
+    if (ipcam_msgpack_is_map(data, length))
+    {
+        encoding = IPCAM_MESSAGE_ENCODING_MSGPACK;
+        scanned = ipcam_message_scan_msgpack(data, length, &head, &body_start, &body_end);
+    }
+    else
+    {
+        encoding = IPCAM_MESSAGE_ENCODING_JSON;
+        scanned = ipcam_message_scan(data, length, &head, &body_start, &body_end);
+    }
+
+    if (scanned)
+    {
+        GBytes *raw = NULL;
+        if (body_start && owner)
+        {
+            raw = g_bytes_new_from_bytes(owner, body_start - data, body_end - body_start);
+        }
+        else if (body_start)
+        {
+            raw = g_bytes_new(body_start, body_end - body_start);
+        }
+        /* A compressed body is inflated here, handlers never see it */
+        if (raw && head.compression)
+        {
+            GBytes *plain = ipcam_message_decompress_body(raw, encoding, TRUE, head.compression);
+            g_bytes_unref(raw);
+            raw = plain;
+            scanned = (NULL != plain);
+        }
+        if (scanned)
+        {
+            message = ipcam_message_new_from_head(pool, &head, raw, encoding);
+        }
+        if (raw)
+        {
+            g_bytes_unref(raw);
+        }
+    }
+
+    ipcam_message_head_clear(&head);
+
+    return message;
+}
+
+IpcamMessage *ipcam_message_pool_parse_from_data(IpcamMessagePool *pool,
+                                                 const gchar *data,
+                                                 gsize length)
+{
+    return ipcam_message_parse(pool, NULL, data, length);
+}
+
+IpcamMessage *ipcam_message_pool_parse_from_bytes(IpcamMessagePool *pool, GBytes *bytes)
+{
+    gsize length;
+    const gchar *data;
+
+    g_return_val_if_fail(bytes, NULL);
+    data = g_bytes_get_data(bytes, &length);
+    return ipcam_message_parse(pool, bytes, data, length);
+}
+
+IpcamMessage *ipcam_message_parse_from_data(const gchar *data, gsize length)
+{
+    return ipcam_message_parse(NULL, NULL, data, length);
+}
+
+IpcamMessage *ipcam_message_parse_from_bytes(GBytes *bytes)
+{
+    return ipcam_message_pool_parse_from_bytes(NULL, bytes);
+}
+
+/*
+ * Split framing: the head frame is the bare head object and the body
+ * frame, in the same encoding, is the bare body.  Only the head is
+ * scanned; the body frame is kept by reference, so a router can look at
+ * the head and forward the body without touching it.  An empty or
+ * missing body frame means the message has no body.
+ */
+IpcamMessage *ipcam_message_pool_parse_from_frames(IpcamMessagePool *pool,
+                                                   GBytes *head_frame,
+                                                   GBytes *body_frame)
+{
+    IpcamMessage *message = NULL;
+    IpcamMessageHead head = {NULL, };
+    IpcamMessageEncoding encoding;
+    gboolean scanned;
+    gsize length;
+    const gchar *data;
+
+    g_return_val_if_fail(head_frame, NULL);
+
+    data = g_bytes_get_data(head_frame, &length);
+    if (ipcam_msgpack_is_map(data, length))
+    {
+        IpcamMsgpackReader reader;
+        ipcam_msgpack_reader_init(&reader, data, length);
+        encoding = IPCAM_MESSAGE_ENCODING_MSGPACK;
+        scanned = ipcam_message_scan_msgpack_head(&reader, &head) && reader.pos == reader.end;
+    }
+    else
+    {
+        IpcamJsonScanner scanner;
+        ipcam_json_scanner_init(&scanner, data, length);
+        encoding = IPCAM_MESSAGE_ENCODING_JSON;
+        scanned = ipcam_message_scan_head(&scanner, &head) && ipcam_json_scanner_at_end(&scanner);
+    }
+
+    if (scanned)
+    {
+        GBytes *plain = NULL;
+        if (body_frame && 0 == g_bytes_get_size(body_frame))
+        {
+            body_frame = NULL;
+        }
+        if (body_frame && head.compression)
+        {
+            plain = ipcam_message_decompress_body(body_frame, encoding, FALSE, head.compression);
+            body_frame = plain;
+            scanned = (NULL != plain);
+        }
+        if (scanned)
+        {
+            message = ipcam_message_new_from_head(pool, &head, body_frame, encoding);
+        }
+        if (plain)
+        {
+            g_bytes_unref(plain);
+        }
+    }
+
+    ipcam_message_head_clear(&head);
+
+    return message;
+}
+
+IpcamMessage *ipcam_message_parse_from_frames(GBytes *head_frame, GBytes *body_frame)
+{
+    return ipcam_message_pool_parse_from_frames(NULL, head_frame, body_frame);
+}
+
+/* Subclasses call this from every setter that changes what goes on the wire */
+void ipcam_message_invalidate(IpcamMessage *message)
+{
+    g_return_if_fail(IPCAM_IS_MESSAGE(message));
+    IpcamMessagePrivate *priv = ipcam_message_get_instance_private(message);
+    gint i, j;
+
+    for (i = 0; i < IPCAM_MESSAGE_ENCODING_LAST; i++)
+    {
+        for (j = 0; j < 2; j++)
+        {
+            if (priv->wire[i].frames[j])
+            {
+                g_bytes_unref(priv->wire[i].frames[j]);
+                priv->wire[i].frames[j] = NULL;
+            }
+        }
+    }
+}
+
+void ipcam_message_reset(IpcamMessage *message)
+{
+    g_return_if_fail(IPCAM_IS_MESSAGE(message));
+    IPCAM_MESSAGE_GET_CLASS(message)->reset(message);
+}
+
+IpcamMessagePool *ipcam_message_get_pool(IpcamMessage *message)
+{
+    g_return_val_if_fail(IPCAM_IS_MESSAGE(message), NULL);
+    IpcamMessagePrivate *priv = ipcam_message_get_instance_private(message);
+    return priv->pool;
+}
+
+void ipcam_message_set_pool(IpcamMessage *message, IpcamMessagePool *pool)
+{
+    g_return_if_fail(IPCAM_IS_MESSAGE(message));
+    IpcamMessagePrivate *priv = ipcam_message_get_instance_private(message);
+    if (priv->pool == pool)
+    {
+        return;
+    }
+    if (priv->pool)
+    {
+        g_object_unref(priv->pool);
+    }
+    priv->pool = pool ? g_object_ref(pool) : NULL;
+}
+
+const gchar *ipcam_message_get_message_type(IpcamMessage *message)
+{
+    g_return_val_if_fail(IPCAM_IS_MESSAGE(message), NULL);
+    IpcamMessagePrivate *priv = ipcam_message_get_instance_private(message);
+    return priv->type;
+}
+void ipcam_message_set_message_type(IpcamMessage *message, const gchar *type)
+{
+    g_return_if_fail(IPCAM_IS_MESSAGE(message));
+    IpcamMessagePrivate *priv = ipcam_message_get_instance_private(message);
+    if (g_strcmp0(priv->type, type) != 0)
+    {
+        g_free(priv->type);
+        priv->type = g_strdup(type);
+        priv->kind = ipcam_message_kind_from_string(priv->type);
+        ipcam_message_invalidate(message);
+    }
+}
+const gchar *ipcam_message_get_token(IpcamMessage *message)
+{
+    g_return_val_if_fail(IPCAM_IS_MESSAGE(message), NULL);
+    IpcamMessagePrivate *priv = ipcam_message_get_instance_private(message);
+    return priv->token;
+}
+void ipcam_message_set_token(IpcamMessage *message, const gchar *token)
+{
+    g_return_if_fail(IPCAM_IS_MESSAGE(message));
+    IpcamMessagePrivate *priv = ipcam_message_get_instance_private(message);
+    if (g_strcmp0(priv->token, token) != 0)
+    {
+        g_free(priv->token);
+        priv->token = g_strdup(token);
+        ipcam_message_invalidate(message);
+    }
+}
+const gchar *ipcam_message_get_version(IpcamMessage *message)
+{
+    g_return_val_if_fail(IPCAM_IS_MESSAGE(message), NULL);
+    IpcamMessagePrivate *priv = ipcam_message_get_instance_private(message);
+    return priv->version;
+}
+void ipcam_message_set_version(IpcamMessage *message, const gchar *version)
+{
+    g_return_if_fail(IPCAM_IS_MESSAGE(message));
+    IpcamMessagePrivate *priv = ipcam_message_get_instance_private(message);
+    if (g_strcmp0(priv->version, version) != 0)
+    {
+        g_free(priv->version);
+        priv->version = g_strdup(version);
+        ipcam_message_invalidate(message);
+    }
+}
+IpcamMessageKind ipcam_message_get_kind(IpcamMessage *message)
+{
+    g_return_val_if_fail(IPCAM_IS_MESSAGE(message), IPCAM_MESSAGE_KIND_UNKNOWN);
+    IpcamMessagePrivate *priv = ipcam_message_get_instance_private(message);
+    return priv->kind;
+}
+gboolean ipcam_message_is_request(IpcamMessage *message)
+{
+    g_return_val_if_fail(IPCAM_IS_MESSAGE(message), FALSE);
+    IpcamMessagePrivate *priv = ipcam_message_get_instance_private(message);
+    return priv->kind == IPCAM_MESSAGE_KIND_REQUEST;
+}
+gboolean ipcam_message_is_response(IpcamMessage *message)
+{
+    g_return_val_if_fail(IPCAM_IS_MESSAGE(message), FALSE);
+    IpcamMessagePrivate *priv = ipcam_message_get_instance_private(message);
+    return priv->kind == IPCAM_MESSAGE_KIND_RESPONSE;
+}
+gboolean ipcam_message_is_notice(IpcamMessage *message)
+{
+    g_return_val_if_fail(IPCAM_IS_MESSAGE(message), FALSE);
+    IpcamMessagePrivate *priv = ipcam_message_get_instance_private(message);
+    return priv->kind == IPCAM_MESSAGE_KIND_NOTICE;
+}
+
+JsonNode *ipcam_message_get_body(IpcamMessage *message)
+{
+    g_return_val_if_fail(IPCAM_IS_MESSAGE(message), NULL);
+    return ipcam_message_expose_body(message);
+}
+
+void ipcam_message_set_body(IpcamMessage *message, JsonNode *body)
+{
+    g_return_if_fail(IPCAM_IS_MESSAGE(message));
+    IpcamMessagePrivate *priv = ipcam_message_get_instance_private(message);
+    if (priv->body)
+    {
+        ipcam_message_body_unref(priv->body);
+    }
+    priv->body = body ? ipcam_message_body_new(NULL, IPCAM_MESSAGE_ENCODING_JSON, body) : NULL;
+    ipcam_message_invalidate(message);
+}
+
+GBytes *ipcam_message_get_body_bytes(IpcamMessage *message)
+{
+    g_return_val_if_fail(IPCAM_IS_MESSAGE(message), NULL);
+    IpcamMessagePrivate *priv = ipcam_message_get_instance_private(message);
+    return priv->body ? ipcam_message_body_get_raw(priv->body, IPCAM_MESSAGE_ENCODING_JSON) : NULL;
+}
+
+void ipcam_message_set_body_bytes(IpcamMessage *message, GBytes *bytes)
+{
+    ipcam_message_set_encoded_body(message, bytes, IPCAM_MESSAGE_ENCODING_JSON);
+}
+
+GBytes *ipcam_message_get_encoded_body(IpcamMessage *message, IpcamMessageEncoding encoding)
+{
+    g_return_val_if_fail(IPCAM_IS_MESSAGE(message), NULL);
+    g_return_val_if_fail(encoding < IPCAM_MESSAGE_ENCODING_LAST, NULL);
+    IpcamMessagePrivate *priv = ipcam_message_get_instance_private(message);
+    return priv->body ? ipcam_message_body_get_raw(priv->body, encoding) : NULL;
+}
+
+void ipcam_message_set_encoded_body(IpcamMessage *message,
+                                    GBytes *bytes,
+                                    IpcamMessageEncoding encoding)
+{
+    g_return_if_fail(IPCAM_IS_MESSAGE(message));
+    g_return_if_fail(encoding < IPCAM_MESSAGE_ENCODING_LAST);
+    IpcamMessagePrivate *priv = ipcam_message_get_instance_private(message);
+    if (priv->body)
+    {
+        ipcam_message_body_unref(priv->body);
+    }
+    priv->body = bytes ? ipcam_message_body_new(bytes, encoding, NULL) : NULL;
+    ipcam_message_invalidate(message);
+}
+
+void ipcam_message_share_body(IpcamMessage *message, IpcamMessage *source)
+{
+    g_return_if_fail(IPCAM_IS_MESSAGE(message));
+    g_return_if_fail(IPCAM_IS_MESSAGE(source));
+    IpcamMessagePrivate *priv = ipcam_message_get_instance_private(message);
+    IpcamMessagePrivate *source_priv = ipcam_message_get_instance_private(source);
+    if (priv->body == source_priv->body)
+    {
+        return;
+    }
+    if (priv->body)
+    {
+        ipcam_message_body_unref(priv->body);
+    }
+    priv->body = NULL;
+    if (source_priv->body)
+    {
+        /* Whoever got an exposed node may still change it, so it is copied */
+        if (ipcam_message_body_is_exposed(source_priv->body))
+            priv->body = ipcam_message_body_copy(source_priv->body);
+        else
+            priv->body = ipcam_message_body_ref(source_priv->body);
+    }
+    ipcam_message_invalidate(message);
+}
+
+void ipcam_message_set_pretty_print(gboolean pretty)
+{
+    pretty_print = pretty;
+}
+
+static gchar *ipcam_message_prettify(gchar *compact)
+{
+    JsonParser *parser = json_parser_new();
+    gchar *string = compact;
+
+    if (json_parser_load_from_data(parser, compact, -1, NULL))
+    {
+        JsonGenerator *generator = json_generator_new();
+        json_generator_set_root(generator, json_parser_get_root(parser));
+        json_generator_set_pretty(generator, TRUE);
+        string = json_generator_to_data(generator, NULL);
+        g_object_unref(generator);
+        g_free(compact);
+    }
+    g_object_unref(parser);
+
+    return string;
+}
+
+#define IPCAM_MESSAGE_HEAD_MAX_FIELDS 7
+
+static guint ipcam_message_get_head_fields(IpcamMessage *message,
+                                           gboolean deflated,
+                                           const gchar *names[],
+                                           const gchar *values[])
+{
+    IpcamMessagePrivate *priv = ipcam_message_get_instance_private(message);
+    guint n = 0;
+
+    names[n] = "type";    values[n++] = priv->type;
+    names[n] = "token";   values[n++] = priv->token;
+    names[n] = "version"; values[n++] = priv->version;
+
+    switch (priv->kind)
+    {
+    case IPCAM_MESSAGE_KIND_NOTICE:
+        names[n] = "event"; values[n++] = ipcam_notice_message_get_event(IPCAM_NOTICE_MESSAGE(message));
+        break;
+    case IPCAM_MESSAGE_KIND_REQUEST:
+        names[n] = "action"; values[n++] = ipcam_request_message_get_action(IPCAM_REQUEST_MESSAGE(message));
+        names[n] = "id";     values[n++] = ipcam_request_message_get_id(IPCAM_REQUEST_MESSAGE(message));
+        break;
+    case IPCAM_MESSAGE_KIND_RESPONSE:
+        names[n] = "action"; values[n++] = ipcam_response_message_get_action(IPCAM_RESPONSE_MESSAGE(message));
+        names[n] = "id";     values[n++] = ipcam_response_message_get_id(IPCAM_RESPONSE_MESSAGE(message));
+        names[n] = "code";   values[n++] = ipcam_response_message_get_code(IPCAM_RESPONSE_MESSAGE(message));
+        break;
+    default:
+        g_warning ("Class '%s' does not have a valid message type",
+                   G_OBJECT_TYPE_NAME(message));
+        break;
+    }
+
+    if (deflated)
+    {
+        names[n] = "compression"; values[n++] = "zlib";
+    }
+
+    return n;
+}
+
+static void ipcam_message_append_json_head(IpcamMessage *message, gboolean deflated, GString *string)
+{
+    const gchar *names[IPCAM_MESSAGE_HEAD_MAX_FIELDS];
+    const gchar *values[IPCAM_MESSAGE_HEAD_MAX_FIELDS];
+    guint i, n;
+
+    n = ipcam_message_get_head_fields(message, deflated, names, values);
+    g_string_append_c(string, '{');
+    for (i = 0; i < n; i++)
+    {
+        if (i > 0)
+            g_string_append_c(string, ',');
+        ipcam_json_writer_append_member(string, names[i], values[i]);
+    }
+    g_string_append_c(string, '}');
+}
+
+static void ipcam_message_append_msgpack_head(IpcamMessage *message, gboolean deflated, GByteArray *buffer)
+{
+    const gchar *names[IPCAM_MESSAGE_HEAD_MAX_FIELDS];
+    const gchar *values[IPCAM_MESSAGE_HEAD_MAX_FIELDS];
+    guint i, n;
+
+    n = ipcam_message_get_head_fields(message, deflated, names, values);
+    ipcam_msgpack_write_map_header(buffer, n);
+    for (i = 0; i < n; i++)
+    {
+        ipcam_msgpack_write_str(buffer, names[i], -1);
+        ipcam_msgpack_write_str(buffer, values[i], -1);
+    }
+}
+
+/*
+ * The body as it goes on the wire: the raw form, or its deflated copy when
+ * the body reaches the threshold and deflating actually made it smaller.
+ */
+static GBytes *ipcam_message_get_wire_body(IpcamMessage *message,
+                                           IpcamMessageEncoding encoding,
+                                           IpcamMessageCompression *compression,
+                                           gboolean *deflated)
+{
+    IpcamMessagePrivate *priv = ipcam_message_get_instance_private(message);
+    GBytes *raw;
+    gsize size;
+
+    *deflated = FALSE;
+    if (compression)
+    {
+        compression->saved = 0;
+        compression->time_us = 0;
+    }
+    if (NULL == priv->body)
+    {
+        return NULL;
+    }
+    raw = ipcam_message_body_get_raw(priv->body, encoding);
+    if (NULL == raw)
+    {
+        return NULL;
+    }
+
+    size = g_bytes_get_size(raw);
+    if (compression && compression->threshold > 0 && size >= compression->threshold)
+    {
+        GBytes *packed = ipcam_message_body_get_deflated(priv->body, encoding, &compression->time_us);
+        if (packed && g_bytes_get_size(packed) < size)
+        {
+            compression->saved = size - g_bytes_get_size(packed);
+            *deflated = TRUE;
+            return packed;
+        }
+    }
+    return raw;
+}
+
+static GString *ipcam_message_build_json(IpcamMessage *message, IpcamMessageCompression *compression)
+{
+    gboolean deflated;
+    GBytes *body = ipcam_message_get_wire_body(message, IPCAM_MESSAGE_ENCODING_JSON, compression, &deflated);
+    gsize body_size = body ? g_bytes_get_size(body) : 4;
+    GString *string = g_string_sized_new(160 + (deflated ? body_size * 4 / 3 + 4 : body_size));
+
+    g_string_append(string, "{\"head\":");
+    ipcam_message_append_json_head(message, deflated, string);
+
+    /* The body is spliced in as is, it is never re-parsed or copied as a tree */
+    g_string_append(string, ",\"body\":");
+    if (body && deflated)
+    {
+        gsize size;
+        gchar *text;
+        const guchar *data = g_bytes_get_data(body, &size);
+
+        text = g_base64_encode(data, size);
+        g_string_append_c(string, '"');
+        g_string_append(string, text);
+        g_string_append_c(string, '"');
+        g_free(text);
+    }
+    else if (body)
+    {
+        gsize size;
+        const gchar *data = g_bytes_get_data(body, &size);
+        g_string_append_len(string, data, size);
+    }
+    else
+    {
+        g_string_append(string, "null");
+    }
+    g_string_append_c(string, '}');
+
+    return string;
+}
+
+const gchar *ipcam_message_to_string(IpcamMessage *message)
+{
+    g_return_val_if_fail(IPCAM_IS_MESSAGE(message), NULL);
+
+    if (pretty_print)
+    {
+        GString *string = ipcam_message_build_json(message, NULL);
+        return ipcam_message_prettify(g_string_free(string, FALSE));
+    }
+    else
+    {
+        GBytes *bytes = ipcam_message_serialize(message, IPCAM_MESSAGE_ENCODING_JSON);
+        gsize size;
+        const gchar *data = g_bytes_get_data(bytes, &size);
+        gchar *string = g_strndup(data, size);
+        g_bytes_unref(bytes);
+        return string;
+    }
+}
+
+static GBytes *ipcam_message_serialize_single(IpcamMessage *message,
+                                              IpcamMessageEncoding encoding,
+                                              IpcamMessageCompression *compression)
+{
+    if (encoding == IPCAM_MESSAGE_ENCODING_MSGPACK)
+    {
+        gboolean deflated;
+        GBytes *body = ipcam_message_get_wire_body(message, encoding, compression, &deflated);
+        GByteArray *buffer = g_byte_array_sized_new(96 + (body ? g_bytes_get_size(body) : 1));
+
+        ipcam_msgpack_write_map_header(buffer, 2);
+        ipcam_msgpack_write_str(buffer, "head", 4);
+        ipcam_message_append_msgpack_head(message, deflated, buffer);
+        ipcam_msgpack_write_str(buffer, "body", 4);
+        if (body)
+        {
+            gsize size;
+            gconstpointer data = g_bytes_get_data(body, &size);
+            if (deflated)
+                ipcam_msgpack_write_bin(buffer, data, size);
+            else
+                g_byte_array_append(buffer, data, size);
+        }
+        else
+        {
+            ipcam_msgpack_write_nil(buffer);
+        }
+        return g_byte_array_free_to_bytes(buffer);
+    }
+    else
+    {
+        GString *string = ipcam_message_build_json(message, compression);
+        gsize length = string->len;
+        return g_bytes_new_take(g_string_free(string, FALSE), length);
+    }
+}
+
+static GBytes *ipcam_message_serialize_head_frame(IpcamMessage *message,
+                                                  IpcamMessageEncoding encoding,
+                                                  gboolean deflated)
+{
+    if (encoding == IPCAM_MESSAGE_ENCODING_MSGPACK)
+    {
+        GByteArray *buffer = g_byte_array_sized_new(96);
+        ipcam_message_append_msgpack_head(message, deflated, buffer);
+        return g_byte_array_free_to_bytes(buffer);
+    }
+    else
+    {
+        GString *string = g_string_sized_new(128);
+        gsize length;
+
+        ipcam_message_append_json_head(message, deflated, string);
+        length = string->len;
+        return g_bytes_new_take(g_string_free(string, FALSE), length);
+    }
+}
+
+GBytes *ipcam_message_serialize(IpcamMessage *message, IpcamMessageEncoding encoding)
+{
+    GBytes *frames[2] = {NULL, NULL};
+
+    g_return_val_if_fail(IPCAM_IS_MESSAGE(message), NULL);
+    ipcam_message_serialize_frames(message, encoding, IPCAM_MESSAGE_FRAMING_SINGLE, NULL, frames);
+    return frames[0];
+}
+
+/*
+ * Fills frames with one or two new references, according to framing, and
+ * returns how many.  With a compression threshold large bodies are sent
+ * deflated and the head says so; parsing inflates them again.
+ */
+guint ipcam_message_serialize_frames(IpcamMessage *message,
+                                     IpcamMessageEncoding encoding,
+                                     IpcamMessageFraming framing,
+                                     IpcamMessageCompression *compression,
+                                     GBytes *frames[2])
+{
+    g_return_val_if_fail(IPCAM_IS_MESSAGE(message), 0);
+    g_return_val_if_fail(encoding < IPCAM_MESSAGE_ENCODING_LAST, 0);
+    IpcamMessagePrivate *priv = ipcam_message_get_instance_private(message);
+    IpcamMessageWire *wire = &priv->wire[encoding];
+    gsize threshold = compression ? compression->threshold : 0;
+    /* A handed out body node may be changed behind our back */
+    gboolean cacheable = (NULL == priv->body || !ipcam_message_body_is_exposed(priv->body));
+    guint n;
+
+    if (cacheable && wire->frames[0] && wire->framing == framing && wire->threshold == threshold)
+    {
+        if (compression)
+        {
+            compression->saved = wire->saved;
+            compression->time_us = 0;
+        }
+        frames[0] = g_bytes_ref(wire->frames[0]);
+        if (wire->frames[1])
+            frames[1] = g_bytes_ref(wire->frames[1]);
+        return wire->frames[1] ? 2 : 1;
+    }
+
+    if (IPCAM_MESSAGE_FRAMING_SPLIT == framing)
+    {
+        gboolean deflated;
+        GBytes *body = ipcam_message_get_wire_body(message, encoding, compression, &deflated);
+
+        frames[0] = ipcam_message_serialize_head_frame(message, encoding, deflated);
+        frames[1] = body ? g_bytes_ref(body) : g_bytes_new_static("", 0);
+        n = 2;
+    }
+    else
+    {
+        frames[0] = ipcam_message_serialize_single(message, encoding, compression);
+        n = 1;
+    }
+
+    if (cacheable)
+    {
+        if (wire->frames[0])
+            g_bytes_unref(wire->frames[0]);
+        if (wire->frames[1])
+            g_bytes_unref(wire->frames[1]);
+        wire->frames[0] = g_bytes_ref(frames[0]);
+        wire->frames[1] = (n > 1) ? g_bytes_ref(frames[1]) : NULL;
+        wire->framing = framing;
+        wire->threshold = threshold;
+        wire->saved = compression ? compression->saved : 0;
+    }
+    return n;
+}
+
+GBytes *ipcam_message_serialize_head(IpcamMessage *message, IpcamMessageEncoding encoding)
+{
+    g_return_val_if_fail(IPCAM_IS_MESSAGE(message), NULL);
+    return ipcam_message_serialize_head_frame(message, encoding, FALSE);
+}
+
+GBytes *ipcam_message_serialize_body(IpcamMessage *message, IpcamMessageEncoding encoding)
+{
+    g_return_val_if_fail(IPCAM_IS_MESSAGE(message), NULL);
+    GBytes *body = ipcam_message_get_encoded_body(message, encoding);
+    return body ? g_bytes_ref(body) : g_bytes_new_static("", 0);
+}
+
+IpcamMessageEncoding ipcam_message_encoding_from_string(const gchar *name)
+{
+    if (name && (0 == g_ascii_strcasecmp(name, "msgpack") ||
+                 0 == g_ascii_strcasecmp(name, "messagepack")))
+    {
+        return IPCAM_MESSAGE_ENCODING_MSGPACK;
+    }
+    return IPCAM_MESSAGE_ENCODING_JSON;
+}
+
+IpcamMessageFraming ipcam_message_framing_from_string(const gchar *name)
+{
+    if (name && 0 == g_ascii_strcasecmp(name, "split"))
+    {
+        return IPCAM_MESSAGE_FRAMING_SPLIT;
+    }
+    return IPCAM_MESSAGE_FRAMING_SINGLE;
+}
+
+/*
+ * Request ids are a random per process prefix and a counter, so making
+ * one is an atomic increment.  The 64 bit value is the key the pending
+ * request tables use, the hex string only exists for the wire.  A key is
+ * never 0, which stands for an id this process did not generate.
+ */
+static guint32 ipcam_message_id_prefix(void)
+{
+    static gsize prefix = 0;
+
+    if (g_once_init_enter(&prefix))
+    {
+        g_once_init_leave(&prefix, (gsize)(g_random_int() | 1));
+    }
+    return (guint32)prefix;
+}
+
+guint64 ipcam_message_id_generate(gchar id[IPCAM_MESSAGE_ID_LENGTH + 1])
+{
+    static const gchar digits[] = "0123456789abcdef";
+    static gint counter = 0;
+    guint32 serial = (guint32)g_atomic_int_add(&counter, 1) + 1;
+    guint64 key = ((guint64)ipcam_message_id_prefix() << 32) | serial;
+    guint64 value = key;
+    gint i;
+
+    for (i = IPCAM_MESSAGE_ID_LENGTH - 1; i >= 0; i--)
+    {
+        id[i] = digits[value & 0xf];
+        value >>= 4;
+    }
+    id[IPCAM_MESSAGE_ID_LENGTH] = '\0';
+
+    return key;
+}
+
+guint64 ipcam_message_id_to_key(const gchar *id)
+{
+    guint64 key = 0;
+    gint i;
+
+    if (NULL == id)
+        return 0;
+
+    for (i = 0; i < IPCAM_MESSAGE_ID_LENGTH; i++)
+    {
+        gchar c = id[i];
+        if (c >= '0' && c <= '9')
+            key = (key << 4) | (c - '0');
+        else if (c >= 'a' && c <= 'f')
+            key = (key << 4) | (c - 'a' + 10);
+        else
+            return 0;
+    }
+    return id[IPCAM_MESSAGE_ID_LENGTH] == '\0' ? key : 0;
+}
+
+/*
+ * Field lookups straight on the raw body, so handlers that only need a
+ * couple of values never build a tree.  A path is a dot separated list
+ * of object member names, e.g. "items.device_name".
+ */
+static const gchar *next_segment(const gchar *path, gsize *length)
+{
+    const gchar *dot = strchr(path, '.');
+    *length = dot ? (gsize)(dot - path) : strlen(path);
+    return dot ? dot + 1 : NULL;
+}
+
+static gboolean lookup_msgpack(GBytes *raw, const gchar *path, IpcamMsgpackValue *result)
+{
+    IpcamMsgpackReader reader;
+    gsize size;
+    gconstpointer data = g_bytes_get_data(raw, &size);
+
+    ipcam_msgpack_reader_init(&reader, data, size);
+    while (path)
+    {
+        IpcamMsgpackValue value;
+        gsize length;
+        const gchar *segment = path;
+        guint32 i, count;
+        gboolean found = FALSE;
+
+        path = next_segment(path, &length);
+        if (!ipcam_msgpack_read(&reader, &value) || value.type != IPCAM_MSGPACK_TYPE_MAP)
+            return FALSE;
+        count = value.v.count;
+        for (i = 0; i < count && !found; i++)
+        {
+            if (!ipcam_msgpack_read(&reader, &value))
+                return FALSE;
+            if (value.type == IPCAM_MSGPACK_TYPE_STR &&
+                value.v.str.length == length &&
+                0 == memcmp(value.v.str.data, segment, length))
+                found = TRUE;
+            else if (!ipcam_msgpack_skip(&reader))
+                return FALSE;
+        }
+        if (!found)
+            return FALSE;
+    }
+    return ipcam_msgpack_read(&reader, result);
+}
+
+static gboolean lookup_json(GBytes *raw, const gchar *path, IpcamJsonScanner *scanner)
+{
+    gsize size;
+    const gchar *data = g_bytes_get_data(raw, &size);
+
+    ipcam_json_scanner_init(scanner, data, size);
+    while (path)
+    {
+        gsize length;
+        const gchar *segment = path;
+        gboolean found = FALSE;
+
+        path = next_segment(path, &length);
+        if (!ipcam_json_scanner_expect(scanner, '{') || ipcam_json_scanner_expect(scanner, '}'))
+            return FALSE;
+        do
+        {
+            gchar *name = ipcam_json_scanner_read_string(scanner);
+            if (!name || !ipcam_json_scanner_expect(scanner, ':'))
+            {
+                g_free(name);
+                return FALSE;
+            }
+            found = (strlen(name) == length && 0 == strncmp(name, segment, length));
+            g_free(name);
+            if (!found && !ipcam_json_scanner_skip_value(scanner))
+                return FALSE;
+        } while (!found && ipcam_json_scanner_expect(scanner, ','));
+        if (!found)
+            return FALSE;
+    }
+    return TRUE;
+}
+
+static JsonNode *lookup_node(JsonNode *node, const gchar *path)
+{
+    while (node && path)
+    {
+        gsize length;
+        const gchar *segment = path;
+        gchar *name;
+
+        path = next_segment(path, &length);
+        if (!JSON_NODE_HOLDS_OBJECT(node))
+            return NULL;
+        name = g_strndup(segment, length);
+        node = json_object_get_member(json_node_get_object(node), name);
+        g_free(name);
+    }
+    return node;
+}
+
+static IpcamMessageBody *ipcam_message_get_raw_body(IpcamMessage *message)
+{
+    IpcamMessagePrivate *priv = ipcam_message_get_instance_private(message);
+    IpcamMessageBody *body = priv->body;
+    if (NULL == body || ipcam_message_body_is_exposed(body))
+        return NULL;
+    return body;
+}
+
+/*
+ * Checks the body in the form it arrived in; a body that was only ever
+ * a json-glib node is written out as JSON first.  No body validates as
+ * null.
+ */
+gboolean ipcam_message_validate_body(IpcamMessage *message, const IpcamMessageSchema *schema)
+{
+    g_return_val_if_fail(IPCAM_IS_MESSAGE(message), FALSE);
+    g_return_val_if_fail(schema, FALSE);
+    IpcamMessagePrivate *priv = ipcam_message_get_instance_private(message);
+    IpcamMessageBody *body = ipcam_message_get_raw_body(message);
+    GBytes *packed = body ? ipcam_message_body_peek_raw(body, IPCAM_MESSAGE_ENCODING_MSGPACK) : NULL;
+    const gchar *data;
+    gsize size;
+
+    if (packed)
+    {
+        data = g_bytes_get_data(packed, &size);
+        return ipcam_message_schema_validate_msgpack(schema, data, size);
+    }
+    if (priv->body)
+    {
+        GBytes *raw = ipcam_message_body_get_raw(priv->body, IPCAM_MESSAGE_ENCODING_JSON);
+        if (NULL == raw)
+            return FALSE;
+        data = g_bytes_get_data(raw, &size);
+        return ipcam_message_schema_validate_json(schema, data, size);
+    }
+    return ipcam_message_schema_validate_json(schema, "null", 4);
+}
+
+gboolean ipcam_message_body_lookup_string(IpcamMessage *message, const gchar *path, gchar **value)
+{
+    g_return_val_if_fail(IPCAM_IS_MESSAGE(message), FALSE);
+    g_return_val_if_fail(path && value, FALSE);
+    IpcamMessagePrivate *priv = ipcam_message_get_instance_private(message);
+    IpcamMessageBody *body = ipcam_message_get_raw_body(message);
+    GBytes *packed = body ? ipcam_message_body_peek_raw(body, IPCAM_MESSAGE_ENCODING_MSGPACK) : NULL;
+    GBytes *text = body ? ipcam_message_body_peek_raw(body, IPCAM_MESSAGE_ENCODING_JSON) : NULL;
+
+    if (packed)
+    {
+        IpcamMsgpackValue result;
+        if (!lookup_msgpack(packed, path, &result) ||
+            result.type != IPCAM_MSGPACK_TYPE_STR)
+            return FALSE;
+        *value = g_strndup(result.v.str.data, result.v.str.length);
+        return TRUE;
+    }
+    if (text)
+    {
+        IpcamJsonScanner scanner;
+        if (!lookup_json(text, path, &scanner) ||
+            ipcam_json_scanner_peek(&scanner) != '"')
+            return FALSE;
+        *value = ipcam_json_scanner_read_string(&scanner);
+        return NULL != *value;
+    }
+    if (priv->body)
+    {
+        JsonNode *node = lookup_node(ipcam_message_body_get_node(priv->body), path);
+        if (node && JSON_NODE_HOLDS_VALUE(node) && json_node_get_value_type(node) == G_TYPE_STRING)
+        {
+            *value = g_strdup(json_node_get_string(node));
+            return TRUE;
+        }
+    }
+    return FALSE;
+}
+
+gboolean ipcam_message_body_lookup_int(IpcamMessage *message, const gchar *path, gint64 *value)
+{
+    g_return_val_if_fail(IPCAM_IS_MESSAGE(message), FALSE);
+    g_return_val_if_fail(path && value, FALSE);
+    IpcamMessagePrivate *priv = ipcam_message_get_instance_private(message);
+    IpcamMessageBody *body = ipcam_message_get_raw_body(message);
+    GBytes *packed = body ? ipcam_message_body_peek_raw(body, IPCAM_MESSAGE_ENCODING_MSGPACK) : NULL;
+    GBytes *text = body ? ipcam_message_body_peek_raw(body, IPCAM_MESSAGE_ENCODING_JSON) : NULL;
+
+    if (packed)
+    {
+        IpcamMsgpackValue result;
+        if (!lookup_msgpack(packed, path, &result) ||
+            result.type != IPCAM_MSGPACK_TYPE_INT)
+            return FALSE;
+        *value = result.v.i;
+        return TRUE;
+    }
+    if (text)
+    {
+        IpcamJsonScanner scanner;
+        return lookup_json(text, path, &scanner) &&
+            ipcam_json_scanner_read_int(&scanner, value);
+    }
+    if (priv->body)
+    {
+        JsonNode *node = lookup_node(ipcam_message_body_get_node(priv->body), path);
+        if (node && JSON_NODE_HOLDS_VALUE(node) && json_node_get_value_type(node) == G_TYPE_INT64)
+        {
+            *value = json_node_get_int(node);
+            return TRUE;
+        }
+    }
+    return FALSE;
 }
@@ -3,6 +3,7 @@
 
 #include <glib.h>
 #include <glib-object.h>
+#include <json-glib/json-glib.h>
 
 #define IPCAM_MESSAGE_TYPE (ipcam_message_get_type())
 #define IPCAM_MESSAGE(obj) (G_TYPE_CHECK_INSTANCE_CAST((obj), IPCAM_MESSAGE_TYPE, IpcamMessage))
@@ -11,8 +12,46 @@
 #define IPCAM_IS_MESSAGE_CLASS(klass) (G_TYPE_CHECK_CLASS_TYPE((klass), IPCAM_MESSAGE_TYPE))
 #define IPCAM_MESSAGE_GET_CLASS(obj) (G_TYPE_INSTANCE_GET_CLASS((obj), IPCAM_MESSAGE_TYPE, IpcamMessageClass))
 
+typedef enum
+{
+    IPCAM_MESSAGE_ENCODING_JSON = 0,
+    IPCAM_MESSAGE_ENCODING_MSGPACK,
+    IPCAM_MESSAGE_ENCODING_LAST
+} IpcamMessageEncoding;
+
+/* Whole envelope in one frame, or head and body in two frames */
+typedef enum
+{
+    IPCAM_MESSAGE_FRAMING_SINGLE = 0,
+    IPCAM_MESSAGE_FRAMING_SPLIT
+} IpcamMessageFraming;
+
+/*
+ * Bodies of at least threshold bytes are deflated before they are sent,
+ * when that makes them smaller; a threshold of 0 never compresses.  After
+ * serializing, saved and time_us say what the compression bought and cost.
+ */
+typedef struct _IpcamMessageCompression
+{
+    gsize threshold;
+    gsize saved;
+    gint64 time_us;
+} IpcamMessageCompression;
+
+/* Generated request ids: 8 hex digits of process prefix, 8 of counter */
+#define IPCAM_MESSAGE_ID_LENGTH 16
+
+typedef enum
+{
+    IPCAM_MESSAGE_KIND_UNKNOWN = 0,
+    IPCAM_MESSAGE_KIND_REQUEST,
+    IPCAM_MESSAGE_KIND_RESPONSE,
+    IPCAM_MESSAGE_KIND_NOTICE
+} IpcamMessageKind;
+
 typedef struct _IpcamMessage IpcamMessage;
 typedef struct _IpcamMessageClass IpcamMessageClass;
+typedef struct _IpcamMessagePool IpcamMessagePool;
 
 struct _IpcamMessage
 {
@@ -22,13 +61,59 @@ struct _IpcamMessage
 struct _IpcamMessageClass
 {
     GObjectClass parent_class;
+    /* Put the message back in its just constructed state */
+    void (*reset)(IpcamMessage *self);
 };
 
 GType ipcam_message_get_type(void);
 IpcamMessage *ipcam_message_parse_from_string(const gchar *json_str);
+IpcamMessage *ipcam_message_parse_from_data(const gchar *data, gsize length);
+IpcamMessage *ipcam_message_parse_from_bytes(GBytes *bytes);
+IpcamMessage *ipcam_message_parse_from_frames(GBytes *head_frame, GBytes *body_frame);
+void ipcam_message_reset(IpcamMessage *message);
+void ipcam_message_invalidate(IpcamMessage *message);
+IpcamMessagePool *ipcam_message_get_pool(IpcamMessage *message);
+void ipcam_message_set_pool(IpcamMessage *message, IpcamMessagePool *pool);
+const gchar *ipcam_message_get_message_type(IpcamMessage *message);
+void ipcam_message_set_message_type(IpcamMessage *message, const gchar *type);
+const gchar *ipcam_message_get_token(IpcamMessage *message);
+void ipcam_message_set_token(IpcamMessage *message, const gchar *token);
+const gchar *ipcam_message_get_version(IpcamMessage *message);
+void ipcam_message_set_version(IpcamMessage *message, const gchar *version);
+IpcamMessageKind ipcam_message_get_kind(IpcamMessage *message);
 gboolean ipcam_message_is_request(IpcamMessage *message);
 gboolean ipcam_message_is_response(IpcamMessage *message);
 gboolean ipcam_message_is_notice(IpcamMessage *message);
+/*
+ * Owned by the message and may be modified; a shared body is copied first.
+ * NULL when there is no body, and also when a received body fails to
+ * parse: the body is parsed only here, after the message was dispatched,
+ * so handlers must expect NULL.  A failed parse is not retried.
+ */
+JsonNode *ipcam_message_get_body(IpcamMessage *message);
+void ipcam_message_set_body(IpcamMessage *message, JsonNode *body);
+GBytes *ipcam_message_get_body_bytes(IpcamMessage *message);
+void ipcam_message_set_body_bytes(IpcamMessage *message, GBytes *bytes);
+GBytes *ipcam_message_get_encoded_body(IpcamMessage *message, IpcamMessageEncoding encoding);
+void ipcam_message_set_encoded_body(IpcamMessage *message,
+                                    GBytes *bytes,
+                                    IpcamMessageEncoding encoding);
+void ipcam_message_share_body(IpcamMessage *message, IpcamMessage *source);
+gboolean ipcam_message_body_lookup_string(IpcamMessage *message, const gchar *path, gchar **value);
+gboolean ipcam_message_body_lookup_int(IpcamMessage *message, const gchar *path, gint64 *value);
 const gchar *ipcam_message_to_string(IpcamMessage *message);
+void ipcam_message_set_pretty_print(gboolean pretty);
+GBytes *ipcam_message_serialize(IpcamMessage *message, IpcamMessageEncoding encoding);
+guint ipcam_message_serialize_frames(IpcamMessage *message,
+                                     IpcamMessageEncoding encoding,
+                                     IpcamMessageFraming framing,
+                                     IpcamMessageCompression *compression,
+                                     GBytes *frames[2]);
+GBytes *ipcam_message_serialize_head(IpcamMessage *message, IpcamMessageEncoding encoding);
+GBytes *ipcam_message_serialize_body(IpcamMessage *message, IpcamMessageEncoding encoding);
+IpcamMessageEncoding ipcam_message_encoding_from_string(const gchar *name);
+IpcamMessageFraming ipcam_message_framing_from_string(const gchar *name);
+guint64 ipcam_message_id_generate(gchar id[IPCAM_MESSAGE_ID_LENGTH + 1]);
+guint64 ipcam_message_id_to_key(const gchar *id);
 
 #endif /* __MESSAGE_H__ */
@@ -1,49 +1,97 @@
 #include "message_manager.h"
+#include "messages.h"
+#include "deadline_queue.h"
 #include <assert.h>
 
+/*
+ * Both tables are keyed by the 64 bit form of the request id, the key
+ * lives inside the value so inserting allocates nothing extra.
+ */
 typedef struct _IpcamMessageWaiterHashValue
 {
+	guint64 id;
 	GCond condition;
 	IpcamMessage *message;
 } IpcamMessageWaiterHashValue;
 
 typedef struct _IpcamMessageManagerHashValue
 {
-    gint time;
-    guint timeout;
+    IpcamDeadlineEntry entry;   /* first, so an expired entry is its value */
+    guint64 id;
     GObject *obj;
     MsgHandler callback;
+    IpcamFuture *future;
 } IpcamMessageManagerHashValue;
 
 typedef IpcamMessageManagerHashValue hash_value;
 
-typedef struct _IpcamMessageManagerPrivate
+/* A future still pending here will never get its response */
+static void hash_value_free(hash_value *value)
+{
+    if (value->future)
+    {
+        ipcam_future_fail(value->future, IPCAM_FUTURE_CANCELLED);
+        ipcam_future_unref(value->future);
+    }
+    g_free(value);
+}
+
+/*
+ * Pending requests are spread over shards by the low bits of their id,
+ * which come from a counter, so consecutive requests land on different
+ * shards and threads sending at the same time rarely share a lock.
+ */
+#define MESSAGE_MANAGER_SHARDS 16
+
+typedef struct _IpcamMessageManagerShard
 {
-    GHashTable *msg_hash;
-	GHashTable *waiter_hash;
 	GMutex mutex;
+	GHashTable *msg_hash;
+	GHashTable *waiter_hash;
+	/* Pending requests by deadline, so expiring them never walks msg_hash */
+	IpcamDeadlineQueue *deadlines;
+} IpcamMessageManagerShard;
+
+typedef struct _IpcamMessageManagerPrivate
+{
+	IpcamMessageManagerShard shards[MESSAGE_MANAGER_SHARDS];
+	IpcamMessageReleaseFunc release_func;
+	gpointer release_data;
 } IpcamMessageManagerPrivate;
 
 G_DEFINE_TYPE_WITH_PRIVATE(IpcamMessageManager, ipcam_message_manager, G_TYPE_OBJECT);
 
+static gboolean ipcam_message_manager_add(IpcamMessageManager *message_manager,
+                                          IpcamMessage *message,
+                                          GObject *obj,
+                                          MsgHandler handler,
+                                          IpcamFuture *future,
+                                          gint64 timeout_ms);
+
+static inline IpcamMessageManagerShard *get_shard(IpcamMessageManagerPrivate *priv, guint64 msg_id)
+{
+	return &priv->shards[msg_id & (MESSAGE_MANAGER_SHARDS - 1)];
+}
+
 static void ipcam_message_manager_dispose(GObject *self)
 {
-    static gboolean first_run = TRUE;
-    if (first_run)
-    {
-        first_run = FALSE;
-        G_OBJECT_CLASS(ipcam_message_manager_parent_class)->dispose(self);
-    }
+    G_OBJECT_CLASS(ipcam_message_manager_parent_class)->dispose(self);
 }
 
 static void ipcam_message_manager_finalize(GObject *self)
 {
     IpcamMessageManagerPrivate *priv =
             ipcam_message_manager_get_instance_private(IPCAM_MESSAGE_MANAGER(self));
+    gint i;
 
-    g_hash_table_unref(priv->msg_hash);
-	g_hash_table_unref(priv->waiter_hash);
-	g_mutex_clear(&priv->mutex);
+	for (i = 0; i < MESSAGE_MANAGER_SHARDS; i++)
+	{
+		IpcamMessageManagerShard *shard = &priv->shards[i];
+		ipcam_deadline_queue_free(shard->deadlines);
+		g_hash_table_unref(shard->msg_hash);
+		g_hash_table_unref(shard->waiter_hash);
+		g_mutex_clear(&shard->mutex);
+	}
 
 	G_OBJECT_CLASS(ipcam_message_manager_parent_class)->finalize(self);
 }
@@ -51,11 +99,19 @@ static void ipcam_message_manager_finalize(GObject *self)
 static void ipcam_message_manager_init(IpcamMessageManager *self)
 {
     IpcamMessageManagerPrivate *priv = ipcam_message_manager_get_instance_private(self);
-    priv->msg_hash = g_hash_table_new_full(g_str_hash, g_str_equal, g_free, g_free);
-    g_assert(priv->msg_hash);
-	priv->waiter_hash = g_hash_table_new_full(g_str_hash, g_str_equal, g_free, NULL);
-	g_assert(priv->waiter_hash);
-	g_mutex_init(&priv->mutex);
+    gint i;
+
+	for (i = 0; i < MESSAGE_MANAGER_SHARDS; i++)
+	{
+		IpcamMessageManagerShard *shard = &priv->shards[i];
+		shard->msg_hash = g_hash_table_new_full(g_int64_hash, g_int64_equal, NULL,
+		                                        (GDestroyNotify)hash_value_free);
+		g_assert(shard->msg_hash);
+		shard->waiter_hash = g_hash_table_new(g_int64_hash, g_int64_equal);
+		g_assert(shard->waiter_hash);
+		shard->deadlines = ipcam_deadline_queue_new();
+		g_mutex_init(&shard->mutex);
+	}
 }
 
 static void ipcam_message_manager_class_init(IpcamMessageManagerClass *klass)
@@ -65,44 +121,79 @@ static void ipcam_message_manager_class_init(IpcamMessageManagerClass *klass)
     this_class->finalize = &ipcam_message_manager_finalize;
 }
 
-static time_t get_monotonic_time(void)
-{
-    struct timespec tsNow;
-
-    if (clock_gettime(CLOCK_MONOTONIC, &tsNow) == 0) {
-        return tsNow.tv_sec;
-    }
-
-    return time(NULL);
-}
-
+/* timeout is in seconds */
 gboolean ipcam_message_manager_register(IpcamMessageManager *message_manager,
                                         IpcamMessage *message,
                                         GObject *obj,
                                         MsgHandler handler,
                                         guint timeout)
+{
+    return ipcam_message_manager_register_ms(message_manager, message, obj, handler,
+                                             (gint64)timeout * 1000);
+}
+
+gboolean ipcam_message_manager_register_ms(IpcamMessageManager *message_manager,
+                                           IpcamMessage *message,
+                                           GObject *obj,
+                                           MsgHandler handler,
+                                           gint64 timeout_ms)
+{
+    return ipcam_message_manager_add(message_manager, message, obj, handler, NULL, timeout_ms);
+}
+
+/*
+ * The future is completed with the response, or fails on timeout.  A
+ * timeout_ms of 0 or less sets no deadline, as ipcam_future_wait() then
+ * waits for ever too; the future still fails if the request is cancelled.
+ */
+gboolean ipcam_message_manager_register_future(IpcamMessageManager *message_manager,
+                                               IpcamMessage *message,
+                                               IpcamFuture *future,
+                                               gint64 timeout_ms)
+{
+    g_return_val_if_fail(future, FALSE);
+    return ipcam_message_manager_add(message_manager, message, NULL, NULL, future, timeout_ms);
+}
+
+static gboolean ipcam_message_manager_add(IpcamMessageManager *message_manager,
+                                          IpcamMessage *message,
+                                          GObject *obj,
+                                          MsgHandler handler,
+                                          IpcamFuture *future,
+                                          gint64 timeout_ms)
 {
     g_return_val_if_fail(ipcam_message_is_request(message), FALSE);
 
     gboolean ret = FALSE;
     IpcamMessageManagerPrivate *priv = ipcam_message_manager_get_instance_private(message_manager);
-    gchar *msg_id;
-    g_object_get(G_OBJECT(message), "id", &msg_id, NULL);
+    guint64 msg_id = ipcam_request_message_get_id_key(IPCAM_REQUEST_MESSAGE(message));
+    IpcamMessageManagerShard *shard;
+
+    if (0 == msg_id)
+    {
+        g_warning("Request id '%s' was not generated here, its response cannot be matched.\n",
+                  ipcam_request_message_get_id(IPCAM_REQUEST_MESSAGE(message)));
+        return FALSE;
+    }
 
-	g_mutex_lock(&priv->mutex);
-    if (!g_hash_table_contains(priv->msg_hash, msg_id))
+	shard = get_shard(priv, msg_id);
+	g_mutex_lock(&shard->mutex);
+    if (!g_hash_table_contains(shard->msg_hash, &msg_id))
     {
-        hash_value *value = g_new(hash_value, 1);
-        value->time = get_monotonic_time();
-        value->timeout = timeout;
+        hash_value *value = g_new0(hash_value, 1);
+        value->id = msg_id;
         value->obj = obj;
         value->callback = handler;
+        value->future = future ? ipcam_future_ref(future) : NULL;
 
-        ret = g_hash_table_insert(priv->msg_hash, (gpointer)g_strdup(msg_id), (gpointer)value);
+        ret = g_hash_table_insert(shard->msg_hash, &value->id, (gpointer)value);
+        /* Handlers keep the old rule, a timeout of 0 expires at the next check */
+        if (NULL == future || timeout_ms > 0)
+            ipcam_deadline_queue_push(shard->deadlines, &value->entry,
+                                      g_get_monotonic_time() + MAX(timeout_ms, 0) * G_TIME_SPAN_MILLISECOND);
     }
-	g_mutex_unlock(&priv->mutex);
+	g_mutex_unlock(&shard->mutex);
 
-    g_free(msg_id);
     return ret;
 }
 
@@ -113,43 +204,48 @@ gboolean ipcam_message_manager_wait_for(IpcamMessageManager *message_manager,
 {
 	IpcamMessageManagerPrivate *priv = ipcam_message_manager_get_instance_private(message_manager);
 	IpcamMessageWaiterHashValue *waiter = NULL;
+	IpcamMessageManagerShard *shard;
 	gboolean ret = FALSE;
-
-	message_manager = g_object_ref(message_manager);
+	guint64 msg_id;
 
 	g_assert(IPCAM_IS_MESSAGE_MANAGER(message_manager) && message_id && response);
 
-	if (g_hash_table_lookup(priv->waiter_hash, (gconstpointer)message_id)) {
-		g_hash_table_unref(priv->waiter_hash);
-		g_warning("There is already a thread waiting for message '%s'.\n", message_id);
+	msg_id = ipcam_message_id_to_key(message_id);
+	if (0 == msg_id) {
+		g_warning("Request id '%s' was not generated here, its response cannot be matched.\n", message_id);
 		return FALSE;
 	}
 
-	waiter = g_new0(IpcamMessageWaiterHashValue, 1);
-	if (waiter == NULL) {
-		g_hash_table_unref(priv->waiter_hash);
-		g_error("Out of memory\n");
+	message_manager = g_object_ref(message_manager);
+
+	shard = get_shard(priv, msg_id);
+	g_mutex_lock(&shard->mutex);
+
+	if (g_hash_table_contains(shard->waiter_hash, &msg_id)) {
+		g_mutex_unlock(&shard->mutex);
+		g_object_unref(message_manager);
+		g_warning("There is already a thread waiting for message '%s'.\n", message_id);
 		return FALSE;
 	}
 
+	waiter = g_new0(IpcamMessageWaiterHashValue, 1);
+	waiter->id = msg_id;
 	waiter->message = NULL;
 	g_cond_init(&waiter->condition);
 
-	g_mutex_lock(&priv->mutex);
-
-	g_hash_table_insert(priv->waiter_hash, (gpointer)g_strdup(message_id), waiter);
+	g_hash_table_insert(shard->waiter_hash, &waiter->id, waiter);
 
 	if (timeout_ms > 0) {
 		gint64 endtime = g_get_monotonic_time () + timeout_ms * G_TIME_SPAN_MILLISECOND;
-		ret = g_cond_wait_until (&waiter->condition, &priv->mutex, endtime);
+		ret = g_cond_wait_until (&waiter->condition, &shard->mutex, endtime);
 	}
 	else {
-		g_cond_wait (&waiter->condition, &priv->mutex);
+		g_cond_wait (&waiter->condition, &shard->mutex);
 	}
 
-	g_hash_table_remove(priv->waiter_hash, message_id);
+	g_hash_table_remove(shard->waiter_hash, &msg_id);
 
-	g_mutex_unlock(&priv->mutex);
+	g_mutex_unlock(&shard->mutex);
 
 	g_object_unref(message_manager);
 
@@ -161,69 +257,155 @@ gboolean ipcam_message_manager_wait_for(IpcamMessageManager *message_manager,
 	return (ret && *response);
 }
 
-static void clear(gpointer key, gpointer value, gpointer user_data)
+gboolean ipcam_message_manager_handle(IpcamMessageManager *message_manager, IpcamMessage *message)
 {
-    hash_value *val = (hash_value *)value;
-    gint now = *(gint *)user_data;
-
-    if ((now - val->time >= val->timeout) && val->callback)
-        val->callback(val->obj, NULL, TRUE);
-}
+    g_return_val_if_fail(ipcam_message_is_response(message), FALSE);
 
-static gboolean remove(gpointer key, gpointer value, gpointer user_data)
-{
     gboolean ret = FALSE;
-    hash_value *val = (hash_value *)value;
-    gint now = *(gint *)user_data;
+    IpcamMessageManagerPrivate *priv = ipcam_message_manager_get_instance_private(message_manager);
+    guint64 msg_id = ipcam_response_message_get_id_key(IPCAM_RESPONSE_MESSAGE(message));
+    IpcamMessageWaiterHashValue *waiter;
+    IpcamMessageManagerShard *shard;
+    hash_value *value;
+
+	/* Not one of our ids, nobody here can be waiting for it */
+	if (0 == msg_id)
+		return FALSE;
+
+	shard = get_shard(priv, msg_id);
+	g_mutex_lock(&shard->mutex);
+	waiter = g_hash_table_lookup(shard->waiter_hash, &msg_id);
+	if (waiter) {
+		waiter->message = g_object_ref(message);
+		g_cond_broadcast(&waiter->condition);
+	}
+    value = (hash_value *)g_hash_table_lookup(shard->msg_hash, &msg_id);
+    if (value)
+    {
+		ipcam_deadline_queue_remove(shard->deadlines, &value->entry);
+		g_hash_table_steal(shard->msg_hash, &msg_id);
+		ret = TRUE;
+    }
+	g_mutex_unlock(&shard->mutex);
+
+	/* Unlocked, so the handler may register or wait for other requests */
+	if (value)
+	{
+		if (value->callback)
+			value->callback(value->obj, message, FALSE);
+		if (value->future)
+			ipcam_future_complete(value->future, message);
+		hash_value_free(value);
+		if (priv->release_func)
+			priv->release_func(msg_id, priv->release_data);
+	}
 
-    if (now - val->time >= val->timeout)
-        ret = TRUE;
-    
     return ret;
 }
 
-gboolean ipcam_message_manager_handle(IpcamMessageManager *message_manager, IpcamMessage *message)
+/*
+ * Times out every request whose deadline has passed and returns the next
+ * deadline (monotonic microseconds), or IPCAM_DEADLINE_QUEUE_NONE when
+ * nothing is pending.  Each expiry costs O(log n), requests that are
+ * still pending are not looked at.
+ */
+gint64 ipcam_message_manager_expire(IpcamMessageManager *message_manager, gint64 now)
 {
-    g_return_val_if_fail(ipcam_message_is_response(message), FALSE);
-
-    gboolean ret = FALSE;
     IpcamMessageManagerPrivate *priv = ipcam_message_manager_get_instance_private(message_manager);
-    gchar *msg_id;
-    g_object_get(G_OBJECT(message), "id", &msg_id, NULL);
+    GSList *expired = NULL, *item;
+    IpcamDeadlineEntry *entry;
+    gint64 next = IPCAM_DEADLINE_QUEUE_NONE;
+    gint i;
 
-	g_mutex_lock(&priv->mutex);
-	if (g_hash_table_contains(priv->waiter_hash, msg_id))
+	/* Take them out under each shard lock, time them out after */
+	for (i = 0; i < MESSAGE_MANAGER_SHARDS; i++)
 	{
-		IpcamMessageWaiterHashValue *waiter = g_hash_table_lookup(priv->waiter_hash, msg_id);
-		if (waiter) {
-			waiter->message = g_object_ref(message);
-			g_cond_broadcast(&waiter->condition);
+		IpcamMessageManagerShard *shard = &priv->shards[i];
+
+		g_mutex_lock(&shard->mutex);
+		while ((entry = ipcam_deadline_queue_pop_expired(shard->deadlines, now)))
+		{
+			hash_value *value = (hash_value *)entry;
+			g_hash_table_steal(shard->msg_hash, &value->id);
+			expired = g_slist_prepend(expired, value);
 		}
+		next = MIN(next, ipcam_deadline_queue_next(shard->deadlines));
+		g_mutex_unlock(&shard->mutex);
 	}
-    if (g_hash_table_contains(priv->msg_hash, msg_id))
-    {
-        hash_value *value = (hash_value *)g_hash_table_lookup(priv->msg_hash, (gconstpointer)msg_id);
-        assert(value);
+
+	for (item = expired; item; item = item->next)
+	{
+		hash_value *value = (hash_value *)item->data;
 		if (value->callback)
-			value->callback(value->obj, message, FALSE);
+			value->callback(value->obj, NULL, TRUE);
+		if (value->future)
+			ipcam_future_fail(value->future, IPCAM_FUTURE_TIMEOUT);
+		if (priv->release_func)
+			priv->release_func(value->id, priv->release_data);
+		hash_value_free(value);
+	}
+	g_slist_free(expired);
 
-		ret = g_hash_table_remove(priv->msg_hash, (gpointer)msg_id);
-    }
-	g_mutex_unlock(&priv->mutex);
+	return next;
+}
 
-    g_free(msg_id);
-    return ret;
+gboolean ipcam_message_manager_is_pending(IpcamMessageManager *message_manager, guint64 msg_id)
+{
+    IpcamMessageManagerPrivate *priv = ipcam_message_manager_get_instance_private(message_manager);
+    IpcamMessageManagerShard *shard = get_shard(priv, msg_id);
+    gboolean ret;
+
+	g_mutex_lock(&shard->mutex);
+	ret = g_hash_table_contains(shard->msg_hash, &msg_id);
+	g_mutex_unlock(&shard->mutex);
+
+	return ret;
 }
 
-void ipcam_message_manager_clear(IpcamMessageManager *message_manager)
+/*
+ * Forgets a request without calling its handler, for one that could not
+ * be sent after all.  Its future, if any, is cancelled.
+ */
+gboolean ipcam_message_manager_cancel(IpcamMessageManager *message_manager, IpcamMessage *message)
 {
-    gint now = get_monotonic_time();
+    g_return_val_if_fail(ipcam_message_is_request(message), FALSE);
+
     IpcamMessageManagerPrivate *priv = ipcam_message_manager_get_instance_private(message_manager);
+    guint64 msg_id = ipcam_request_message_get_id_key(IPCAM_REQUEST_MESSAGE(message));
+    IpcamMessageManagerShard *shard = get_shard(priv, msg_id);
+    hash_value *value;
+
+	g_mutex_lock(&shard->mutex);
+	value = (hash_value *)g_hash_table_lookup(shard->msg_hash, &msg_id);
+	if (value)
+	{
+		ipcam_deadline_queue_remove(shard->deadlines, &value->entry);
+		g_hash_table_steal(shard->msg_hash, &msg_id);
+	}
+	g_mutex_unlock(&shard->mutex);
 
-	g_mutex_lock(&priv->mutex);
+	if (!value)
+		return FALSE;
+	hash_value_free(value);
+	if (priv->release_func)
+		priv->release_func(msg_id, priv->release_data);
+	return TRUE;
+}
 
-	g_hash_table_foreach(priv->msg_hash, (GHFunc)clear, (gpointer)&now);
-    g_hash_table_foreach_remove(priv->msg_hash, (GHRFunc)remove, (gpointer)&now);
+/*
+ * Set once before any request is registered; called on the thread that
+ * released the request, with no lock held.
+ */
+void ipcam_message_manager_set_release_func(IpcamMessageManager *message_manager,
+                                            IpcamMessageReleaseFunc func,
+                                            gpointer user_data)
+{
+    IpcamMessageManagerPrivate *priv = ipcam_message_manager_get_instance_private(message_manager);
+    priv->release_func = func;
+    priv->release_data = user_data;
+}
 
-	g_mutex_unlock(&priv->mutex);
+void ipcam_message_manager_clear(IpcamMessageManager *message_manager)
+{
+    ipcam_message_manager_expire(message_manager, g_get_monotonic_time());
 }
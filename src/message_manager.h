@@ -4,6 +4,7 @@
 #include <glib.h>
 #include <glib-object.h>
 #include "message.h"
+#include "future.h"
 
 #define IPCAM_MESSAGE_MANAGER_TYPE (ipcam_message_manager_get_type())
 #define IPCAM_MESSAGE_MANAGER(obj) (G_TYPE_CHECK_INSTANCE_CAST((obj), IPCAM_MESSAGE_MANAGER_TYPE, IpcamMessageManager))
@@ -16,6 +17,8 @@ typedef struct _IpcamMessageManager IpcamMessageManager;
 typedef struct _IpcamMessageManagerClass IpcamMessageManagerClass;
 
 typedef void (*MsgHandler)(GObject *obj, IpcamMessage* msg, gboolean timeout);
+/* Told when a request is answered, times out or is cancelled */
+typedef void (*IpcamMessageReleaseFunc)(guint64 msg_id, gpointer user_data);
 
 struct _IpcamMessageManager
 {
@@ -33,11 +36,26 @@ gboolean ipcam_message_manager_register(IpcamMessageManager *message_manager,
                                         GObject *obj,
                                         MsgHandler handler,
                                         guint timeout);
+gboolean ipcam_message_manager_register_ms(IpcamMessageManager *message_manager,
+                                           IpcamMessage *message,
+                                           GObject *obj,
+                                           MsgHandler handler,
+                                           gint64 timeout_ms);
+gboolean ipcam_message_manager_register_future(IpcamMessageManager *message_manager,
+                                               IpcamMessage *message,
+                                               IpcamFuture *future,
+                                               gint64 timeout_ms);
 gboolean ipcam_message_manager_wait_for(IpcamMessageManager *message_manager,
                                         const char *message_id,
                                         gint64 timeout_ms,
                                         IpcamMessage **response);
 gboolean ipcam_message_manager_handle(IpcamMessageManager *message_manager, IpcamMessage *message);
+gboolean ipcam_message_manager_is_pending(IpcamMessageManager *message_manager, guint64 msg_id);
+gboolean ipcam_message_manager_cancel(IpcamMessageManager *message_manager, IpcamMessage *message);
+void ipcam_message_manager_set_release_func(IpcamMessageManager *message_manager,
+                                            IpcamMessageReleaseFunc func,
+                                            gpointer user_data);
+gint64 ipcam_message_manager_expire(IpcamMessageManager *message_manager, gint64 now);
 void ipcam_message_manager_clear(IpcamMessageManager *message_manager);
 
 #endif /* __MESSAGE_MANAGER_H__ */
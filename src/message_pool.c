@@ -0,0 +1,212 @@
+#include "message_pool.h"
+#include "messages.h"
+
+#define IPCAM_MESSAGE_POOL_DEFAULT_MAX_IDLE 64
+
+enum
+{
+    PROP_0,
+
+    IPCAM_MESSAGE_POOL_MAX_IDLE = 1,
+
+    N_PROPERTIES
+};
+
+/*
+ * Idle instances are kept per message kind.  A message taken from the
+ * pool holds a reference on it; when its last reference goes away its
+ * dispose hands it back here instead of finalizing it, so a service in
+ * steady state never instantiates a message type.
+ */
+typedef struct _IpcamMessagePoolPrivate
+{
+    GQueue idle[IPCAM_MESSAGE_KIND_NOTICE + 1];
+    guint max_idle;
+    guint64 hits;
+    guint64 misses;
+    GMutex mutex;
+} IpcamMessagePoolPrivate;
+
+G_DEFINE_TYPE_WITH_PRIVATE(IpcamMessagePool, ipcam_message_pool, G_TYPE_OBJECT);
+
+static GParamSpec *obj_properties[N_PROPERTIES] = {NULL, };
+
+static void ipcam_message_pool_finalize(GObject *self)
+{
+    IpcamMessagePoolPrivate *priv = ipcam_message_pool_get_instance_private(IPCAM_MESSAGE_POOL(self));
+    gint kind;
+
+    /* Idle messages no longer point at the pool, so this really frees them */
+    for (kind = 0; kind <= IPCAM_MESSAGE_KIND_NOTICE; kind++)
+    {
+        IpcamMessage *message;
+        while ((message = g_queue_pop_head(&priv->idle[kind])))
+        {
+            g_object_unref(message);
+        }
+    }
+    g_mutex_clear(&priv->mutex);
+
+    G_OBJECT_CLASS(ipcam_message_pool_parent_class)->finalize(self);
+}
+static void ipcam_message_pool_get_property(GObject *object,
+                                            guint property_id,
+                                            GValue *value,
+                                            GParamSpec *pspec)
+{
+    IpcamMessagePool *self = IPCAM_MESSAGE_POOL(object);
+    IpcamMessagePoolPrivate *priv = ipcam_message_pool_get_instance_private(self);
+    switch(property_id)
+    {
+    case IPCAM_MESSAGE_POOL_MAX_IDLE:
+        {
+            g_value_set_uint(value, priv->max_idle);
+        }
+        break;
+    default:
+        G_OBJECT_WARN_INVALID_PROPERTY_ID(object, property_id, pspec);
+        break;
+    }
+}
+static void ipcam_message_pool_set_property(GObject *object,
+                                            guint property_id,
+                                            const GValue *value,
+                                            GParamSpec *pspec)
+{
+    IpcamMessagePool *self = IPCAM_MESSAGE_POOL(object);
+    IpcamMessagePoolPrivate *priv = ipcam_message_pool_get_instance_private(self);
+    switch(property_id)
+    {
+    case IPCAM_MESSAGE_POOL_MAX_IDLE:
+        {
+            g_mutex_lock(&priv->mutex);
+            priv->max_idle = g_value_get_uint(value);
+            g_mutex_unlock(&priv->mutex);
+        }
+        break;
+    default:
+        G_OBJECT_WARN_INVALID_PROPERTY_ID(object, property_id, pspec);
+        break;
+    }
+}
+static void ipcam_message_pool_init(IpcamMessagePool *self)
+{
+    IpcamMessagePoolPrivate *priv = ipcam_message_pool_get_instance_private(self);
+    gint kind;
+
+    for (kind = 0; kind <= IPCAM_MESSAGE_KIND_NOTICE; kind++)
+    {
+        g_queue_init(&priv->idle[kind]);
+    }
+    priv->max_idle = IPCAM_MESSAGE_POOL_DEFAULT_MAX_IDLE;
+    priv->hits = 0;
+    priv->misses = 0;
+    g_mutex_init(&priv->mutex);
+}
+static void ipcam_message_pool_class_init(IpcamMessagePoolClass *klass)
+{
+    GObjectClass *this_class = G_OBJECT_CLASS(klass);
+    this_class->finalize = &ipcam_message_pool_finalize;
+    this_class->get_property = &ipcam_message_pool_get_property;
+    this_class->set_property = &ipcam_message_pool_set_property;
+
+    obj_properties[IPCAM_MESSAGE_POOL_MAX_IDLE] =
+        g_param_spec_uint("max-idle",
+                          "Maximum idle messages",
+                          "How many idle messages of each kind the pool keeps",
+                          0, G_MAXUINT,
+                          IPCAM_MESSAGE_POOL_DEFAULT_MAX_IDLE, // default value
+                          G_PARAM_READWRITE);
+
+    g_object_class_install_properties(this_class, N_PROPERTIES, obj_properties);
+}
+
+static GType ipcam_message_pool_type_of_kind(IpcamMessageKind kind)
+{
+    switch (kind)
+    {
+    case IPCAM_MESSAGE_KIND_REQUEST:
+        return IPCAM_REQUEST_MESSAGE_TYPE;
+    case IPCAM_MESSAGE_KIND_RESPONSE:
+        return IPCAM_RESPONSE_MESSAGE_TYPE;
+    case IPCAM_MESSAGE_KIND_NOTICE:
+        return IPCAM_NOTICE_MESSAGE_TYPE;
+    default:
+        return G_TYPE_INVALID;
+    }
+}
+
+IpcamMessage *ipcam_message_pool_acquire(IpcamMessagePool *pool, IpcamMessageKind kind)
+{
+    g_return_val_if_fail(IPCAM_IS_MESSAGE_POOL(pool), NULL);
+    g_return_val_if_fail(kind > IPCAM_MESSAGE_KIND_UNKNOWN && kind <= IPCAM_MESSAGE_KIND_NOTICE, NULL);
+    IpcamMessagePoolPrivate *priv = ipcam_message_pool_get_instance_private(pool);
+    IpcamMessage *message;
+
+    g_mutex_lock(&priv->mutex);
+    message = g_queue_pop_head(&priv->idle[kind]);
+    if (message)
+        priv->hits++;
+    else
+        priv->misses++;
+    g_mutex_unlock(&priv->mutex);
+
+    if (NULL == message)
+    {
+        message = g_object_new(ipcam_message_pool_type_of_kind(kind), NULL);
+    }
+    ipcam_message_set_pool(message, pool);
+    return message;
+}
+
+/*
+ * Called from the message's dispose.  Returns TRUE if the pool took the
+ * message back, in which case it has been re-referenced and reset.
+ */
+gboolean ipcam_message_pool_recycle(IpcamMessagePool *pool, IpcamMessage *message)
+{
+    g_return_val_if_fail(IPCAM_IS_MESSAGE_POOL(pool), FALSE);
+    IpcamMessagePoolPrivate *priv = ipcam_message_pool_get_instance_private(pool);
+    IpcamMessageKind kind = ipcam_message_get_kind(message);
+    gboolean ret = FALSE;
+
+    if (kind == IPCAM_MESSAGE_KIND_UNKNOWN)
+        return FALSE;
+
+    g_mutex_lock(&priv->mutex);
+    ret = g_queue_get_length(&priv->idle[kind]) < priv->max_idle;
+    g_mutex_unlock(&priv->mutex);
+
+    if (ret)
+    {
+        g_object_ref(message);
+        ipcam_message_reset(message);
+
+        g_mutex_lock(&priv->mutex);
+        g_queue_push_head(&priv->idle[kind], message);
+        g_mutex_unlock(&priv->mutex);
+    }
+    return ret;
+}
+
+void ipcam_message_pool_get_stats(IpcamMessagePool *pool, guint64 *hits, guint64 *misses, guint *idle)
+{
+    g_return_if_fail(IPCAM_IS_MESSAGE_POOL(pool));
+    IpcamMessagePoolPrivate *priv = ipcam_message_pool_get_instance_private(pool);
+    gint kind;
+
+    g_mutex_lock(&priv->mutex);
+    if (hits)
+        *hits = priv->hits;
+    if (misses)
+        *misses = priv->misses;
+    if (idle)
+    {
+        *idle = 0;
+        for (kind = 0; kind <= IPCAM_MESSAGE_KIND_NOTICE; kind++)
+        {
+            *idle += g_queue_get_length(&priv->idle[kind]);
+        }
+    }
+    g_mutex_unlock(&priv->mutex);
+}
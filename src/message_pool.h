@@ -0,0 +1,35 @@
+#ifndef __MESSAGE_POOL_H__
+#define __MESSAGE_POOL_H__
+
+#include <glib.h>
+#include <glib-object.h>
+#include "message.h"
+
+#define IPCAM_MESSAGE_POOL_TYPE (ipcam_message_pool_get_type())
+#define IPCAM_MESSAGE_POOL(obj) (G_TYPE_CHECK_INSTANCE_CAST((obj), IPCAM_MESSAGE_POOL_TYPE, IpcamMessagePool))
+#define IPCAM_MESSAGE_POOL_CLASS(klass) (G_TYPE_CHECK_CLASS_CAST((klass), IPCAM_MESSAGE_POOL_TYPE, IpcamMessagePoolClass))
+#define IPCAM_IS_MESSAGE_POOL(obj) (G_TYPE_CHECK_INSTANCE_TYPE((obj), IPCAM_MESSAGE_POOL_TYPE))
+#define IPCAM_IS_MESSAGE_POOL_CLASS(klass) (G_TYPE_CHECK_CLASS_TYPE((klass), IPCAM_MESSAGE_POOL_TYPE))
+#define IPCAM_MESSAGE_POOL_GET_CLASS(obj) (G_TYPE_INSTANCE_GET_CLASS((obj), IPCAM_MESSAGE_POOL_TYPE, IpcamMessagePoolClass))
+
+typedef struct _IpcamMessagePoolClass IpcamMessagePoolClass;
+
+struct _IpcamMessagePool
+{
+    GObject parent;
+};
+
+struct _IpcamMessagePoolClass
+{
+    GObjectClass parent_class;
+};
+
+GType ipcam_message_pool_get_type(void);
+IpcamMessage *ipcam_message_pool_acquire(IpcamMessagePool *pool, IpcamMessageKind kind);
+gboolean ipcam_message_pool_recycle(IpcamMessagePool *pool, IpcamMessage *message);
+IpcamMessage *ipcam_message_pool_parse_from_data(IpcamMessagePool *pool, const gchar *data, gsize length);
+IpcamMessage *ipcam_message_pool_parse_from_bytes(IpcamMessagePool *pool, GBytes *bytes);
+IpcamMessage *ipcam_message_pool_parse_from_frames(IpcamMessagePool *pool, GBytes *head_frame, GBytes *body_frame);
+void ipcam_message_pool_get_stats(IpcamMessagePool *pool, guint64 *hits, guint64 *misses, guint *idle);
+
+#endif /* __MESSAGE_POOL_H__ */
@@ -0,0 +1,554 @@
+#include <string.h>
+#include "message_schema.h"
+#include "json_scanner.h"
+#include "msgpack.h"
+
+#define IPCAM_MESSAGE_SCHEMA_MAX_DEPTH 16
+/* Required members are tracked in a 64 bit mask */
+#define IPCAM_MESSAGE_SCHEMA_MAX_PROPERTIES 64
+
+enum
+{
+    SCHEMA_TYPE_NULL = 1 << 0,
+    SCHEMA_TYPE_BOOLEAN = 1 << 1,
+    SCHEMA_TYPE_INTEGER = 1 << 2,
+    SCHEMA_TYPE_NUMBER = 1 << 3,
+    SCHEMA_TYPE_STRING = 1 << 4,
+    SCHEMA_TYPE_ARRAY = 1 << 5,
+    SCHEMA_TYPE_OBJECT = 1 << 6
+};
+
+typedef struct _IpcamMessageSchemaProperty
+{
+    gchar *name;
+    gsize length;
+    IpcamMessageSchema *schema;     /* NULL accepts any value */
+} IpcamMessageSchemaProperty;
+
+struct _IpcamMessageSchema
+{
+    guint types;                    /* 0 accepts any type */
+    GArray *properties;
+    guint64 required;
+    gboolean closed;
+    IpcamMessageSchema *items;
+    gint64 max_length;              /* -1 when unbounded */
+    gint64 max_items;
+    gboolean has_minimum;
+    gint64 minimum;
+    gboolean has_maximum;
+    gint64 maximum;
+};
+
+static const struct
+{
+    const gchar *name;
+    guint type;
+} schema_types[] =
+{
+    {"null", SCHEMA_TYPE_NULL},
+    {"boolean", SCHEMA_TYPE_BOOLEAN},
+    {"integer", SCHEMA_TYPE_INTEGER},
+    {"number", SCHEMA_TYPE_NUMBER | SCHEMA_TYPE_INTEGER},
+    {"string", SCHEMA_TYPE_STRING},
+    {"array", SCHEMA_TYPE_ARRAY},
+    {"object", SCHEMA_TYPE_OBJECT}
+};
+
+/* compiling */
+
+static guint schema_type_from_string(const gchar *name)
+{
+    guint i;
+    for (i = 0; i < G_N_ELEMENTS(schema_types); i++)
+    {
+        if (0 == strcmp(name, schema_types[i].name))
+            return schema_types[i].type;
+    }
+    return 0;
+}
+
+static gboolean compile_types(IpcamJsonScanner *scanner, guint *types)
+{
+    gchar *name;
+    guint type;
+
+    if (ipcam_json_scanner_peek(scanner) != '[')
+    {
+        name = ipcam_json_scanner_read_string(scanner);
+        type = name ? schema_type_from_string(name) : 0;
+        g_free(name);
+        *types |= type;
+        return type != 0;
+    }
+
+    ipcam_json_scanner_expect(scanner, '[');
+    if (ipcam_json_scanner_expect(scanner, ']'))
+        return TRUE;
+    do
+    {
+        name = ipcam_json_scanner_read_string(scanner);
+        type = name ? schema_type_from_string(name) : 0;
+        g_free(name);
+        if (0 == type)
+            return FALSE;
+        *types |= type;
+    } while (ipcam_json_scanner_expect(scanner, ','));
+    return ipcam_json_scanner_expect(scanner, ']');
+}
+
+static IpcamMessageSchemaProperty *find_property(const IpcamMessageSchema *schema,
+                                                 const gchar *name,
+                                                 gsize length,
+                                                 guint *index)
+{
+    guint i;
+
+    if (NULL == schema->properties)
+        return NULL;
+    for (i = 0; i < schema->properties->len; i++)
+    {
+        IpcamMessageSchemaProperty *property =
+            &g_array_index(schema->properties, IpcamMessageSchemaProperty, i);
+        if (property->length == length && 0 == memcmp(property->name, name, length))
+        {
+            if (index)
+                *index = i;
+            return property;
+        }
+    }
+    return NULL;
+}
+
+static IpcamMessageSchemaProperty *add_property(IpcamMessageSchema *schema, const gchar *name)
+{
+    IpcamMessageSchemaProperty *property = find_property(schema, name, strlen(name), NULL);
+    IpcamMessageSchemaProperty new_property;
+
+    if (property)
+        return property;
+    if (NULL == schema->properties)
+        schema->properties = g_array_new(FALSE, FALSE, sizeof(IpcamMessageSchemaProperty));
+    if (schema->properties->len >= IPCAM_MESSAGE_SCHEMA_MAX_PROPERTIES)
+        return NULL;
+
+    new_property.name = g_strdup(name);
+    new_property.length = strlen(name);
+    new_property.schema = NULL;
+    g_array_append_val(schema->properties, new_property);
+    return &g_array_index(schema->properties, IpcamMessageSchemaProperty, schema->properties->len - 1);
+}
+
+static IpcamMessageSchema *compile_node(IpcamJsonScanner *scanner, guint depth);
+
+static gboolean compile_properties(IpcamJsonScanner *scanner, IpcamMessageSchema *schema, guint depth)
+{
+    if (!ipcam_json_scanner_expect(scanner, '{'))
+        return FALSE;
+    if (ipcam_json_scanner_expect(scanner, '}'))
+        return TRUE;
+    do
+    {
+        IpcamMessageSchemaProperty *property;
+        IpcamMessageSchema *child;
+        gchar *name = ipcam_json_scanner_read_string(scanner);
+
+        if (NULL == name || !ipcam_json_scanner_expect(scanner, ':'))
+        {
+            g_free(name);
+            return FALSE;
+        }
+        child = compile_node(scanner, depth + 1);
+        property = child ? add_property(schema, name) : NULL;
+        g_free(name);
+        if (NULL == property)
+        {
+            ipcam_message_schema_free(child);
+            return FALSE;
+        }
+        ipcam_message_schema_free(property->schema);
+        property->schema = child;
+    } while (ipcam_json_scanner_expect(scanner, ','));
+    return ipcam_json_scanner_expect(scanner, '}');
+}
+
+static gboolean compile_required(IpcamJsonScanner *scanner, GPtrArray *names)
+{
+    if (!ipcam_json_scanner_expect(scanner, '['))
+        return FALSE;
+    if (ipcam_json_scanner_expect(scanner, ']'))
+        return TRUE;
+    do
+    {
+        gchar *name = ipcam_json_scanner_read_string(scanner);
+        if (NULL == name)
+            return FALSE;
+        g_ptr_array_add(names, name);
+    } while (ipcam_json_scanner_expect(scanner, ','));
+    return ipcam_json_scanner_expect(scanner, ']');
+}
+
+static gboolean compile_boolean(IpcamJsonScanner *scanner, gboolean *value)
+{
+    gchar c = ipcam_json_scanner_peek(scanner);
+    const gchar *word = (c == 't') ? "true" : "false";
+    gsize length = strlen(word);
+
+    if ((gsize)(scanner->end - scanner->pos) < length || 0 != memcmp(scanner->pos, word, length))
+        return FALSE;
+    scanner->pos += length;
+    *value = (c == 't');
+    return TRUE;
+}
+
+static gboolean compile_keyword(IpcamJsonScanner *scanner,
+                                IpcamMessageSchema *schema,
+                                const gchar *keyword,
+                                GPtrArray *required,
+                                guint depth)
+{
+    if (0 == strcmp(keyword, "type"))
+        return compile_types(scanner, &schema->types);
+    if (0 == strcmp(keyword, "properties"))
+        return compile_properties(scanner, schema, depth);
+    if (0 == strcmp(keyword, "required"))
+        return compile_required(scanner, required);
+    if (0 == strcmp(keyword, "additionalProperties"))
+    {
+        gboolean allowed;
+        if (!compile_boolean(scanner, &allowed))
+            return FALSE;
+        schema->closed = !allowed;
+        return TRUE;
+    }
+    if (0 == strcmp(keyword, "items"))
+    {
+        ipcam_message_schema_free(schema->items);
+        schema->items = compile_node(scanner, depth + 1);
+        return schema->items != NULL;
+    }
+    if (0 == strcmp(keyword, "maxLength"))
+        return ipcam_json_scanner_read_int(scanner, &schema->max_length) && schema->max_length >= 0;
+    if (0 == strcmp(keyword, "maxItems"))
+        return ipcam_json_scanner_read_int(scanner, &schema->max_items) && schema->max_items >= 0;
+    if (0 == strcmp(keyword, "minimum"))
+        return (schema->has_minimum = ipcam_json_scanner_read_int(scanner, &schema->minimum));
+    if (0 == strcmp(keyword, "maximum"))
+        return (schema->has_maximum = ipcam_json_scanner_read_int(scanner, &schema->maximum));
+
+    return ipcam_json_scanner_skip_value(scanner);
+}
+
+static IpcamMessageSchema *compile_node(IpcamJsonScanner *scanner, guint depth)
+{
+    IpcamMessageSchema *schema;
+    GPtrArray *required;
+    gboolean ok = TRUE;
+    guint i;
+
+    if (depth > IPCAM_MESSAGE_SCHEMA_MAX_DEPTH || !ipcam_json_scanner_expect(scanner, '{'))
+        return NULL;
+
+    schema = g_new0(IpcamMessageSchema, 1);
+    schema->max_length = -1;
+    schema->max_items = -1;
+    required = g_ptr_array_new_with_free_func(g_free);
+
+    if (!ipcam_json_scanner_expect(scanner, '}'))
+    {
+        do
+        {
+            gchar *keyword = ipcam_json_scanner_read_string(scanner);
+            ok = keyword && ipcam_json_scanner_expect(scanner, ':') &&
+                compile_keyword(scanner, schema, keyword, required, depth);
+            g_free(keyword);
+        } while (ok && ipcam_json_scanner_expect(scanner, ','));
+        ok = ok && ipcam_json_scanner_expect(scanner, '}');
+    }
+
+    /* "required" may come before "properties", so it is resolved last */
+    for (i = 0; ok && i < required->len; i++)
+    {
+        guint index;
+        ok = NULL != add_property(schema, g_ptr_array_index(required, i));
+        if (ok)
+        {
+            const gchar *name = g_ptr_array_index(required, i);
+            find_property(schema, name, strlen(name), &index);
+            schema->required |= G_GUINT64_CONSTANT(1) << index;
+        }
+    }
+    g_ptr_array_free(required, TRUE);
+
+    if (!ok)
+    {
+        ipcam_message_schema_free(schema);
+        return NULL;
+    }
+    return schema;
+}
+
+IpcamMessageSchema *ipcam_message_schema_new(const gchar *definition)
+{
+    IpcamJsonScanner scanner;
+    IpcamMessageSchema *schema;
+
+    g_return_val_if_fail(definition, NULL);
+
+    ipcam_json_scanner_init(&scanner, definition, strlen(definition));
+    schema = compile_node(&scanner, 0);
+    if (schema && !ipcam_json_scanner_at_end(&scanner))
+    {
+        ipcam_message_schema_free(schema);
+        schema = NULL;
+    }
+    if (NULL == schema)
+    {
+        g_warning("Invalid message schema near offset %d.\n", (gint)(scanner.pos - scanner.data));
+    }
+    return schema;
+}
+
+void ipcam_message_schema_free(IpcamMessageSchema *schema)
+{
+    guint i;
+
+    if (NULL == schema)
+        return;
+    if (schema->properties)
+    {
+        for (i = 0; i < schema->properties->len; i++)
+        {
+            IpcamMessageSchemaProperty *property =
+                &g_array_index(schema->properties, IpcamMessageSchemaProperty, i);
+            g_free(property->name);
+            ipcam_message_schema_free(property->schema);
+        }
+        g_array_free(schema->properties, TRUE);
+    }
+    ipcam_message_schema_free(schema->items);
+    g_free(schema);
+}
+
+/* validation */
+
+static gboolean allows(const IpcamMessageSchema *schema, guint type)
+{
+    return 0 == schema->types || 0 != (schema->types & type);
+}
+
+static gboolean check_integer(const IpcamMessageSchema *schema, gint64 value)
+{
+    return (!schema->has_minimum || value >= schema->minimum) &&
+        (!schema->has_maximum || value <= schema->maximum);
+}
+
+static gboolean check_required(const IpcamMessageSchema *schema, guint64 seen)
+{
+    return (seen & schema->required) == schema->required;
+}
+
+static gboolean skip_json_literal(IpcamJsonScanner *scanner, const gchar *word)
+{
+    gsize length = strlen(word);
+    if ((gsize)(scanner->end - scanner->pos) < length || 0 != memcmp(scanner->pos, word, length))
+        return FALSE;
+    scanner->pos += length;
+    return TRUE;
+}
+
+static gboolean validate_json(const IpcamMessageSchema *schema, IpcamJsonScanner *scanner);
+
+static gboolean validate_json_object(const IpcamMessageSchema *schema, IpcamJsonScanner *scanner)
+{
+    guint64 seen = 0;
+
+    ipcam_json_scanner_expect(scanner, '{');
+    if (ipcam_json_scanner_expect(scanner, '}'))
+        return check_required(schema, seen);
+
+    do
+    {
+        IpcamMessageSchemaProperty *property;
+        const gchar *name;
+        guint index;
+
+        /* Keys are matched as written, an escaped key matches no property */
+        if (ipcam_json_scanner_peek(scanner) != '"')
+            return FALSE;
+        name = scanner->pos + 1;
+        if (!ipcam_json_scanner_skip_string(scanner))
+            return FALSE;
+        property = find_property(schema, name, scanner->pos - 1 - name, &index);
+        if (!ipcam_json_scanner_expect(scanner, ':'))
+            return FALSE;
+
+        if (property)
+        {
+            if (!validate_json(property->schema, scanner))
+                return FALSE;
+            seen |= G_GUINT64_CONSTANT(1) << index;
+        }
+        else if (schema->closed || !ipcam_json_scanner_skip_value(scanner))
+        {
+            return FALSE;
+        }
+    } while (ipcam_json_scanner_expect(scanner, ','));
+
+    return ipcam_json_scanner_expect(scanner, '}') && check_required(schema, seen);
+}
+
+static gboolean validate_json_array(const IpcamMessageSchema *schema, IpcamJsonScanner *scanner)
+{
+    gint64 count = 0;
+
+    ipcam_json_scanner_expect(scanner, '[');
+    if (ipcam_json_scanner_expect(scanner, ']'))
+        return TRUE;
+
+    do
+    {
+        if (schema->max_items >= 0 && ++count > schema->max_items)
+            return FALSE;
+        if (!validate_json(schema->items, scanner))
+            return FALSE;
+    } while (ipcam_json_scanner_expect(scanner, ','));
+
+    return ipcam_json_scanner_expect(scanner, ']');
+}
+
+static gboolean validate_json(const IpcamMessageSchema *schema, IpcamJsonScanner *scanner)
+{
+    gchar c = ipcam_json_scanner_peek(scanner);
+
+    if (NULL == schema)
+        return ipcam_json_scanner_skip_value(scanner);
+
+    switch (c)
+    {
+    case '{':
+        return allows(schema, SCHEMA_TYPE_OBJECT) && validate_json_object(schema, scanner);
+    case '[':
+        return allows(schema, SCHEMA_TYPE_ARRAY) && validate_json_array(schema, scanner);
+    case '"':
+        {
+            const gchar *start = scanner->pos;
+            if (!allows(schema, SCHEMA_TYPE_STRING) || !ipcam_json_scanner_skip_string(scanner))
+                return FALSE;
+            return schema->max_length < 0 || scanner->pos - start - 2 <= schema->max_length;
+        }
+    case 't':
+        return allows(schema, SCHEMA_TYPE_BOOLEAN) && skip_json_literal(scanner, "true");
+    case 'f':
+        return allows(schema, SCHEMA_TYPE_BOOLEAN) && skip_json_literal(scanner, "false");
+    case 'n':
+        return allows(schema, SCHEMA_TYPE_NULL) && skip_json_literal(scanner, "null");
+    case '-':
+    case '0': case '1': case '2': case '3': case '4':
+    case '5': case '6': case '7': case '8': case '9':
+        {
+            IpcamJsonScanner probe = *scanner;
+            gint64 value;
+            if (ipcam_json_scanner_read_int(&probe, &value))
+            {
+                *scanner = probe;
+                return allows(schema, SCHEMA_TYPE_INTEGER) && check_integer(schema, value);
+            }
+            return allows(schema, SCHEMA_TYPE_NUMBER) && ipcam_json_scanner_skip_value(scanner);
+        }
+    default:
+        return FALSE;
+    }
+}
+
+gboolean ipcam_message_schema_validate_json(const IpcamMessageSchema *schema,
+                                            const gchar *data,
+                                            gsize length)
+{
+    IpcamJsonScanner scanner;
+
+    g_return_val_if_fail(schema, FALSE);
+    ipcam_json_scanner_init(&scanner, data, length);
+    return validate_json(schema, &scanner) && ipcam_json_scanner_at_end(&scanner);
+}
+
+static gboolean validate_msgpack(const IpcamMessageSchema *schema, IpcamMsgpackReader *reader)
+{
+    IpcamMsgpackValue value;
+    guint32 i;
+
+    if (NULL == schema)
+        return ipcam_msgpack_skip(reader);
+    if (!ipcam_msgpack_read(reader, &value))
+        return FALSE;
+
+    switch (value.type)
+    {
+    case IPCAM_MSGPACK_TYPE_NIL:
+        return allows(schema, SCHEMA_TYPE_NULL);
+    case IPCAM_MSGPACK_TYPE_BOOLEAN:
+        return allows(schema, SCHEMA_TYPE_BOOLEAN);
+    case IPCAM_MSGPACK_TYPE_INT:
+        return allows(schema, SCHEMA_TYPE_INTEGER) && check_integer(schema, value.v.i);
+    case IPCAM_MSGPACK_TYPE_UINT:
+        /* only ever above G_MAXINT64 */
+        return allows(schema, SCHEMA_TYPE_INTEGER) && !schema->has_maximum;
+    case IPCAM_MSGPACK_TYPE_FLOAT:
+        return allows(schema, SCHEMA_TYPE_NUMBER);
+    case IPCAM_MSGPACK_TYPE_STR:
+    case IPCAM_MSGPACK_TYPE_BIN:
+        return allows(schema, SCHEMA_TYPE_STRING) &&
+            (schema->max_length < 0 || value.v.str.length <= schema->max_length);
+    case IPCAM_MSGPACK_TYPE_ARRAY:
+        /* The count is up front, an oversized array is refused unread */
+        if (!allows(schema, SCHEMA_TYPE_ARRAY) ||
+            (schema->max_items >= 0 && value.v.count > schema->max_items))
+            return FALSE;
+        for (i = 0; i < value.v.count; i++)
+        {
+            if (!validate_msgpack(schema->items, reader))
+                return FALSE;
+        }
+        return TRUE;
+    case IPCAM_MSGPACK_TYPE_MAP:
+        {
+            guint64 seen = 0;
+            if (!allows(schema, SCHEMA_TYPE_OBJECT))
+                return FALSE;
+            for (i = 0; i < value.v.count; i++)
+            {
+                IpcamMessageSchemaProperty *property = NULL;
+                IpcamMsgpackValue key;
+                guint index;
+
+                if (!ipcam_msgpack_read(reader, &key) || key.type != IPCAM_MSGPACK_TYPE_STR)
+                    return FALSE;
+                property = find_property(schema, key.v.str.data, key.v.str.length, &index);
+                if (property)
+                {
+                    if (!validate_msgpack(property->schema, reader))
+                        return FALSE;
+                    seen |= G_GUINT64_CONSTANT(1) << index;
+                }
+                else if (schema->closed || !ipcam_msgpack_skip(reader))
+                {
+                    return FALSE;
+                }
+            }
+            return check_required(schema, seen);
+        }
+    default:
+        return 0 == schema->types;
+    }
+}
+
+gboolean ipcam_message_schema_validate_msgpack(const IpcamMessageSchema *schema,
+                                               const gchar *data,
+                                               gsize length)
+{
+    IpcamMsgpackReader reader;
+
+    g_return_val_if_fail(schema, FALSE);
+    ipcam_msgpack_reader_init(&reader, data, length);
+    return validate_msgpack(schema, &reader) && reader.pos == reader.end;
+}
@@ -0,0 +1,30 @@
+#ifndef __MESSAGE_SCHEMA_H__
+#define __MESSAGE_SCHEMA_H__
+
+#include <glib.h>
+#include "message.h"
+
+/*
+ * A message body schema, written as a small subset of JSON Schema:
+ * "type" (a name or a list of names), "properties", "required",
+ * "additionalProperties": false, "items", "maxLength", "maxItems",
+ * "minimum" and "maximum".  Other keywords are ignored.  "maxLength"
+ * counts bytes as encoded on the wire.
+ *
+ * The definition is compiled once; validation is a single pass over the
+ * raw body, JSON text or MessagePack, that builds nothing and stops at
+ * the first violation.  Values the schema does not describe are skipped.
+ */
+typedef struct _IpcamMessageSchema IpcamMessageSchema;
+
+IpcamMessageSchema *ipcam_message_schema_new(const gchar *definition);
+void ipcam_message_schema_free(IpcamMessageSchema *schema);
+gboolean ipcam_message_schema_validate_json(const IpcamMessageSchema *schema,
+                                            const gchar *data,
+                                            gsize length);
+gboolean ipcam_message_schema_validate_msgpack(const IpcamMessageSchema *schema,
+                                               const gchar *data,
+                                               gsize length);
+gboolean ipcam_message_validate_body(IpcamMessage *message, const IpcamMessageSchema *schema);
+
+#endif /* __MESSAGE_SCHEMA_H__ */
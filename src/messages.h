@@ -5,5 +5,6 @@
 #include <notice_message.h>
 #include <request_message.h>
 #include <response_message.h>
+#include <message_pool.h>
 
 #endif /* __MESSAGES_H__ */
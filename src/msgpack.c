@@ -0,0 +1,545 @@
+#include <string.h>
+#include "msgpack.h"
+
+#define MSGPACK_MAX_DEPTH 64
+
+static void write_byte(GByteArray *buffer, guint8 byte)
+{
+    g_byte_array_append(buffer, &byte, 1);
+}
+
+static void write_be(GByteArray *buffer, guint8 tag, guint64 value, guint size)
+{
+    guint8 bytes[9];
+    guint i;
+
+    bytes[0] = tag;
+    for (i = 0; i < size; i++)
+    {
+        bytes[size - i] = (guint8)(value >> (i * 8));
+    }
+    g_byte_array_append(buffer, bytes, size + 1);
+}
+
+static guint64 read_be(const guint8 *data, guint size)
+{
+    guint64 value = 0;
+    guint i;
+
+    for (i = 0; i < size; i++)
+    {
+        value = (value << 8) | data[i];
+    }
+    return value;
+}
+
+void ipcam_msgpack_write_nil(GByteArray *buffer)
+{
+    write_byte(buffer, 0xc0);
+}
+
+void ipcam_msgpack_write_boolean(GByteArray *buffer, gboolean value)
+{
+    write_byte(buffer, value ? 0xc3 : 0xc2);
+}
+
+void ipcam_msgpack_write_int(GByteArray *buffer, gint64 value)
+{
+    if (value >= 0)
+    {
+        if (value < 128)
+            write_byte(buffer, (guint8)value);
+        else if (value <= G_MAXUINT8)
+            write_be(buffer, 0xcc, value, 1);
+        else if (value <= G_MAXUINT16)
+            write_be(buffer, 0xcd, value, 2);
+        else if (value <= G_MAXUINT32)
+            write_be(buffer, 0xce, value, 4);
+        else
+            write_be(buffer, 0xcf, value, 8);
+    }
+    else
+    {
+        if (value >= -32)
+            write_byte(buffer, (guint8)(gint8)value);
+        else if (value >= G_MININT8)
+            write_be(buffer, 0xd0, (guint64)value, 1);
+        else if (value >= G_MININT16)
+            write_be(buffer, 0xd1, (guint64)value, 2);
+        else if (value >= G_MININT32)
+            write_be(buffer, 0xd2, (guint64)value, 4);
+        else
+            write_be(buffer, 0xd3, (guint64)value, 8);
+    }
+}
+
+void ipcam_msgpack_write_double(GByteArray *buffer, gdouble value)
+{
+    guint64 bits;
+    memcpy(&bits, &value, sizeof(bits));
+    write_be(buffer, 0xcb, bits, 8);
+}
+
+void ipcam_msgpack_write_str(GByteArray *buffer, const gchar *value, gssize length)
+{
+    if (NULL == value)
+    {
+        ipcam_msgpack_write_nil(buffer);
+        return;
+    }
+    if (length < 0)
+        length = strlen(value);
+
+    if (length < 32)
+        write_byte(buffer, 0xa0 | (guint8)length);
+    else if (length <= G_MAXUINT8)
+        write_be(buffer, 0xd9, length, 1);
+    else if (length <= G_MAXUINT16)
+        write_be(buffer, 0xda, length, 2);
+    else
+        write_be(buffer, 0xdb, length, 4);
+    g_byte_array_append(buffer, (const guint8 *)value, length);
+}
+
+void ipcam_msgpack_write_bin(GByteArray *buffer, gconstpointer data, gsize length)
+{
+    if (length <= G_MAXUINT8)
+        write_be(buffer, 0xc4, length, 1);
+    else if (length <= G_MAXUINT16)
+        write_be(buffer, 0xc5, length, 2);
+    else
+        write_be(buffer, 0xc6, length, 4);
+    g_byte_array_append(buffer, data, length);
+}
+
+void ipcam_msgpack_write_array_header(GByteArray *buffer, guint32 count)
+{
+    if (count < 16)
+        write_byte(buffer, 0x90 | (guint8)count);
+    else if (count <= G_MAXUINT16)
+        write_be(buffer, 0xdc, count, 2);
+    else
+        write_be(buffer, 0xdd, count, 4);
+}
+
+void ipcam_msgpack_write_map_header(GByteArray *buffer, guint32 count)
+{
+    if (count < 16)
+        write_byte(buffer, 0x80 | (guint8)count);
+    else if (count <= G_MAXUINT16)
+        write_be(buffer, 0xde, count, 2);
+    else
+        write_be(buffer, 0xdf, count, 4);
+}
+
+static void write_object_member(JsonObject *object,
+                                const gchar *member_name,
+                                JsonNode *member_node,
+                                gpointer user_data)
+{
+    GByteArray *buffer = (GByteArray *)user_data;
+    ipcam_msgpack_write_str(buffer, member_name, -1);
+    ipcam_msgpack_write_json_node(buffer, member_node);
+}
+
+static void write_array_element(JsonArray *array,
+                                guint index,
+                                JsonNode *element_node,
+                                gpointer user_data)
+{
+    ipcam_msgpack_write_json_node((GByteArray *)user_data, element_node);
+}
+
+void ipcam_msgpack_write_json_node(GByteArray *buffer, JsonNode *node)
+{
+    if (NULL == node)
+    {
+        ipcam_msgpack_write_nil(buffer);
+        return;
+    }
+
+    switch (json_node_get_node_type(node))
+    {
+    case JSON_NODE_OBJECT:
+        {
+            JsonObject *object = json_node_get_object(node);
+            ipcam_msgpack_write_map_header(buffer, json_object_get_size(object));
+            json_object_foreach_member(object, write_object_member, buffer);
+        }
+        break;
+    case JSON_NODE_ARRAY:
+        {
+            JsonArray *array = json_node_get_array(node);
+            ipcam_msgpack_write_array_header(buffer, json_array_get_length(array));
+            json_array_foreach_element(array, write_array_element, buffer);
+        }
+        break;
+    case JSON_NODE_VALUE:
+        switch (json_node_get_value_type(node))
+        {
+        case G_TYPE_STRING:
+            ipcam_msgpack_write_str(buffer, json_node_get_string(node), -1);
+            break;
+        case G_TYPE_INT64:
+            ipcam_msgpack_write_int(buffer, json_node_get_int(node));
+            break;
+        case G_TYPE_DOUBLE:
+            ipcam_msgpack_write_double(buffer, json_node_get_double(node));
+            break;
+        case G_TYPE_BOOLEAN:
+            ipcam_msgpack_write_boolean(buffer, json_node_get_boolean(node));
+            break;
+        default:
+            ipcam_msgpack_write_nil(buffer);
+            break;
+        }
+        break;
+    case JSON_NODE_NULL:
+    default:
+        ipcam_msgpack_write_nil(buffer);
+        break;
+    }
+}
+
+void ipcam_msgpack_reader_init(IpcamMsgpackReader *reader, gconstpointer data, gsize length)
+{
+    reader->pos = (const guint8 *)data;
+    reader->end = (const guint8 *)data + length;
+}
+
+static gboolean read_payload(IpcamMsgpackReader *reader,
+                             IpcamMsgpackValue *value,
+                             IpcamMsgpackType type,
+                             guint length_size,
+                             guint32 fixed_length)
+{
+    guint32 length = fixed_length;
+
+    if (length_size)
+    {
+        if ((gsize)(reader->end - reader->pos) < length_size)
+            return FALSE;
+        length = (guint32)read_be(reader->pos, length_size);
+        reader->pos += length_size;
+    }
+    if (type == IPCAM_MSGPACK_TYPE_EXT)
+    {
+        /* skip the ext type byte, the payload is opaque to us */
+        if (reader->pos >= reader->end)
+            return FALSE;
+        reader->pos++;
+    }
+    if ((gsize)(reader->end - reader->pos) < length)
+        return FALSE;
+
+    value->type = type;
+    value->v.str.data = (const gchar *)reader->pos;
+    value->v.str.length = length;
+    reader->pos += length;
+    return TRUE;
+}
+
+static gboolean read_fixed(IpcamMsgpackReader *reader, guint size, guint64 *bits)
+{
+    if ((gsize)(reader->end - reader->pos) < size)
+        return FALSE;
+    *bits = read_be(reader->pos, size);
+    reader->pos += size;
+    return TRUE;
+}
+
+gboolean ipcam_msgpack_read(IpcamMsgpackReader *reader, IpcamMsgpackValue *value)
+{
+    guint8 tag;
+    guint64 bits = 0;
+
+    value->type = IPCAM_MSGPACK_TYPE_INVALID;
+    if (reader->pos >= reader->end)
+        return FALSE;
+
+    tag = *reader->pos++;
+    if (tag <= 0x7f)
+    {
+        value->type = IPCAM_MSGPACK_TYPE_INT;
+        value->v.i = tag;
+        return TRUE;
+    }
+    if (tag >= 0xe0)
+    {
+        value->type = IPCAM_MSGPACK_TYPE_INT;
+        value->v.i = (gint8)tag;
+        return TRUE;
+    }
+    if ((tag & 0xf0) == 0x80)
+    {
+        value->type = IPCAM_MSGPACK_TYPE_MAP;
+        value->v.count = tag & 0x0f;
+        return TRUE;
+    }
+    if ((tag & 0xf0) == 0x90)
+    {
+        value->type = IPCAM_MSGPACK_TYPE_ARRAY;
+        value->v.count = tag & 0x0f;
+        return TRUE;
+    }
+    if ((tag & 0xe0) == 0xa0)
+    {
+        return read_payload(reader, value, IPCAM_MSGPACK_TYPE_STR, 0, tag & 0x1f);
+    }
+
+    switch (tag)
+    {
+    case 0xc0:
+        value->type = IPCAM_MSGPACK_TYPE_NIL;
+        return TRUE;
+    case 0xc2:
+    case 0xc3:
+        value->type = IPCAM_MSGPACK_TYPE_BOOLEAN;
+        value->v.boolean = (tag == 0xc3);
+        return TRUE;
+    case 0xc4: return read_payload(reader, value, IPCAM_MSGPACK_TYPE_BIN, 1, 0);
+    case 0xc5: return read_payload(reader, value, IPCAM_MSGPACK_TYPE_BIN, 2, 0);
+    case 0xc6: return read_payload(reader, value, IPCAM_MSGPACK_TYPE_BIN, 4, 0);
+    case 0xc7: return read_payload(reader, value, IPCAM_MSGPACK_TYPE_EXT, 1, 0);
+    case 0xc8: return read_payload(reader, value, IPCAM_MSGPACK_TYPE_EXT, 2, 0);
+    case 0xc9: return read_payload(reader, value, IPCAM_MSGPACK_TYPE_EXT, 4, 0);
+    case 0xca:
+        {
+            guint32 bits32;
+            gfloat f;
+            if (!read_fixed(reader, 4, &bits))
+                return FALSE;
+            bits32 = (guint32)bits;
+            memcpy(&f, &bits32, sizeof(f));
+            value->type = IPCAM_MSGPACK_TYPE_FLOAT;
+            value->v.f = f;
+        }
+        return TRUE;
+    case 0xcb:
+        if (!read_fixed(reader, 8, &bits))
+            return FALSE;
+        value->type = IPCAM_MSGPACK_TYPE_FLOAT;
+        memcpy(&value->v.f, &bits, sizeof(value->v.f));
+        return TRUE;
+    case 0xcc:
+    case 0xcd:
+    case 0xce:
+    case 0xcf:
+        if (!read_fixed(reader, 1 << (tag - 0xcc), &bits))
+            return FALSE;
+        if (bits > G_MAXINT64)
+        {
+            value->type = IPCAM_MSGPACK_TYPE_UINT;
+            value->v.u = bits;
+        }
+        else
+        {
+            value->type = IPCAM_MSGPACK_TYPE_INT;
+            value->v.i = (gint64)bits;
+        }
+        return TRUE;
+    case 0xd0:
+        if (!read_fixed(reader, 1, &bits))
+            return FALSE;
+        value->type = IPCAM_MSGPACK_TYPE_INT;
+        value->v.i = (gint8)bits;
+        return TRUE;
+    case 0xd1:
+        if (!read_fixed(reader, 2, &bits))
+            return FALSE;
+        value->type = IPCAM_MSGPACK_TYPE_INT;
+        value->v.i = (gint16)bits;
+        return TRUE;
+    case 0xd2:
+        if (!read_fixed(reader, 4, &bits))
+            return FALSE;
+        value->type = IPCAM_MSGPACK_TYPE_INT;
+        value->v.i = (gint32)bits;
+        return TRUE;
+    case 0xd3:
+        if (!read_fixed(reader, 8, &bits))
+            return FALSE;
+        value->type = IPCAM_MSGPACK_TYPE_INT;
+        value->v.i = (gint64)bits;
+        return TRUE;
+    case 0xd4: return read_payload(reader, value, IPCAM_MSGPACK_TYPE_EXT, 0, 1);
+    case 0xd5: return read_payload(reader, value, IPCAM_MSGPACK_TYPE_EXT, 0, 2);
+    case 0xd6: return read_payload(reader, value, IPCAM_MSGPACK_TYPE_EXT, 0, 4);
+    case 0xd7: return read_payload(reader, value, IPCAM_MSGPACK_TYPE_EXT, 0, 8);
+    case 0xd8: return read_payload(reader, value, IPCAM_MSGPACK_TYPE_EXT, 0, 16);
+    case 0xd9: return read_payload(reader, value, IPCAM_MSGPACK_TYPE_STR, 1, 0);
+    case 0xda: return read_payload(reader, value, IPCAM_MSGPACK_TYPE_STR, 2, 0);
+    case 0xdb: return read_payload(reader, value, IPCAM_MSGPACK_TYPE_STR, 4, 0);
+    case 0xdc:
+    case 0xdd:
+        if (!read_fixed(reader, tag == 0xdc ? 2 : 4, &bits))
+            return FALSE;
+        value->type = IPCAM_MSGPACK_TYPE_ARRAY;
+        value->v.count = (guint32)bits;
+        return TRUE;
+    case 0xde:
+    case 0xdf:
+        if (!read_fixed(reader, tag == 0xde ? 2 : 4, &bits))
+            return FALSE;
+        value->type = IPCAM_MSGPACK_TYPE_MAP;
+        value->v.count = (guint32)bits;
+        return TRUE;
+    default:
+        /* 0xc1 is never used */
+        return FALSE;
+    }
+}
+
+gboolean ipcam_msgpack_skip(IpcamMsgpackReader *reader)
+{
+    /* iterative, so hostile nesting cannot exhaust the stack */
+    guint64 pending = 1;
+    IpcamMsgpackValue value;
+
+    while (pending > 0)
+    {
+        if (!ipcam_msgpack_read(reader, &value))
+            return FALSE;
+        pending--;
+        if (value.type == IPCAM_MSGPACK_TYPE_ARRAY)
+            pending += value.v.count;
+        else if (value.type == IPCAM_MSGPACK_TYPE_MAP)
+            pending += (guint64)value.v.count * 2;
+        /* every element needs at least one byte */
+        if (pending > (guint64)(reader->end - reader->pos))
+            return FALSE;
+    }
+    return TRUE;
+}
+
+gboolean ipcam_msgpack_str_equal(const IpcamMsgpackValue *value, const gchar *string)
+{
+    return value->type == IPCAM_MSGPACK_TYPE_STR &&
+        strlen(string) == value->v.str.length &&
+        0 == memcmp(value->v.str.data, string, value->v.str.length);
+}
+
+static JsonNode *read_json_node(IpcamMsgpackReader *reader, guint depth)
+{
+    IpcamMsgpackValue value;
+    JsonNode *node = NULL;
+    guint32 i;
+
+    if (depth > MSGPACK_MAX_DEPTH || !ipcam_msgpack_read(reader, &value))
+        return NULL;
+
+    switch (value.type)
+    {
+    case IPCAM_MSGPACK_TYPE_NIL:
+    case IPCAM_MSGPACK_TYPE_EXT:
+        node = json_node_new(JSON_NODE_NULL);
+        break;
+    case IPCAM_MSGPACK_TYPE_BOOLEAN:
+        node = json_node_new(JSON_NODE_VALUE);
+        json_node_set_boolean(node, value.v.boolean);
+        break;
+    case IPCAM_MSGPACK_TYPE_INT:
+        node = json_node_new(JSON_NODE_VALUE);
+        json_node_set_int(node, value.v.i);
+        break;
+    case IPCAM_MSGPACK_TYPE_UINT:
+        node = json_node_new(JSON_NODE_VALUE);
+        json_node_set_double(node, (gdouble)value.v.u);
+        break;
+    case IPCAM_MSGPACK_TYPE_FLOAT:
+        node = json_node_new(JSON_NODE_VALUE);
+        json_node_set_double(node, value.v.f);
+        break;
+    case IPCAM_MSGPACK_TYPE_STR:
+        {
+            gchar *string = g_strndup(value.v.str.data, value.v.str.length);
+            node = json_node_new(JSON_NODE_VALUE);
+            json_node_set_string(node, string);
+            g_free(string);
+        }
+        break;
+    case IPCAM_MSGPACK_TYPE_BIN:
+        {
+            /* JSON has no binary type, hand it over as base64 text */
+            gchar *string = g_base64_encode((const guchar *)value.v.str.data, value.v.str.length);
+            node = json_node_new(JSON_NODE_VALUE);
+            json_node_set_string(node, string);
+            g_free(string);
+        }
+        break;
+    case IPCAM_MSGPACK_TYPE_ARRAY:
+        {
+            JsonArray *array = json_array_new();
+            for (i = 0; i < value.v.count; i++)
+            {
+                JsonNode *element = read_json_node(reader, depth + 1);
+                if (NULL == element)
+                {
+                    json_array_unref(array);
+                    return NULL;
+                }
+                json_array_add_element(array, element);
+            }
+            node = json_node_new(JSON_NODE_ARRAY);
+            json_node_take_array(node, array);
+        }
+        break;
+    case IPCAM_MSGPACK_TYPE_MAP:
+        {
+            JsonObject *object = json_object_new();
+            for (i = 0; i < value.v.count; i++)
+            {
+                IpcamMsgpackValue key;
+                JsonNode *member;
+                gchar *name;
+
+                if (!ipcam_msgpack_read(reader, &key))
+                {
+                    json_object_unref(object);
+                    return NULL;
+                }
+                if (key.type == IPCAM_MSGPACK_TYPE_STR)
+                    name = g_strndup(key.v.str.data, key.v.str.length);
+                else if (key.type == IPCAM_MSGPACK_TYPE_INT)
+                    name = g_strdup_printf("%" G_GINT64_FORMAT, key.v.i);
+                else
+                {
+                    json_object_unref(object);
+                    return NULL;
+                }
+                member = read_json_node(reader, depth + 1);
+                if (NULL == member)
+                {
+                    g_free(name);
+                    json_object_unref(object);
+                    return NULL;
+                }
+                json_object_set_member(object, name, member);
+                g_free(name);
+            }
+            node = json_node_new(JSON_NODE_OBJECT);
+            json_node_take_object(node, object);
+        }
+        break;
+    default:
+        break;
+    }
+
+    return node;
+}
+
+JsonNode *ipcam_msgpack_to_json_node(gconstpointer data, gsize length)
+{
+    IpcamMsgpackReader reader;
+    ipcam_msgpack_reader_init(&reader, data, length);
+    return read_json_node(&reader, 0);
+}
+
+gboolean ipcam_msgpack_is_map(gconstpointer data, gsize length)
+{
+    guint8 tag;
+    if (length == 0)
+        return FALSE;
+    tag = *(const guint8 *)data;
+    return (tag & 0xf0) == 0x80 || tag == 0xde || tag == 0xdf;
+}
@@ -0,0 +1,68 @@
+#ifndef __MSGPACK_H__
+#define __MSGPACK_H__
+
+#include <glib.h>
+#include <json-glib/json-glib.h>
+
+/*
+ * Just enough MessagePack to carry IpcamMessage envelopes: a writer that
+ * appends to a GByteArray, a pull reader that never allocates, and
+ * converters to and from json-glib nodes.
+ */
+typedef enum
+{
+    IPCAM_MSGPACK_TYPE_INVALID = 0,
+    IPCAM_MSGPACK_TYPE_NIL,
+    IPCAM_MSGPACK_TYPE_BOOLEAN,
+    IPCAM_MSGPACK_TYPE_INT,
+    IPCAM_MSGPACK_TYPE_UINT,
+    IPCAM_MSGPACK_TYPE_FLOAT,
+    IPCAM_MSGPACK_TYPE_STR,
+    IPCAM_MSGPACK_TYPE_BIN,
+    IPCAM_MSGPACK_TYPE_ARRAY,
+    IPCAM_MSGPACK_TYPE_MAP,
+    IPCAM_MSGPACK_TYPE_EXT
+} IpcamMsgpackType;
+
+typedef struct _IpcamMsgpackValue
+{
+    IpcamMsgpackType type;
+    union
+    {
+        gboolean boolean;
+        gint64 i;
+        guint64 u;
+        gdouble f;
+        guint32 count;              /* map pairs or array elements */
+        struct
+        {
+            const gchar *data;      /* borrowed, not NUL terminated */
+            guint32 length;
+        } str;                      /* also bin and ext payloads */
+    } v;
+} IpcamMsgpackValue;
+
+typedef struct _IpcamMsgpackReader
+{
+    const guint8 *pos;
+    const guint8 *end;
+} IpcamMsgpackReader;
+
+void ipcam_msgpack_write_nil(GByteArray *buffer);
+void ipcam_msgpack_write_boolean(GByteArray *buffer, gboolean value);
+void ipcam_msgpack_write_int(GByteArray *buffer, gint64 value);
+void ipcam_msgpack_write_double(GByteArray *buffer, gdouble value);
+void ipcam_msgpack_write_str(GByteArray *buffer, const gchar *value, gssize length);
+void ipcam_msgpack_write_bin(GByteArray *buffer, gconstpointer data, gsize length);
+void ipcam_msgpack_write_array_header(GByteArray *buffer, guint32 count);
+void ipcam_msgpack_write_map_header(GByteArray *buffer, guint32 count);
+void ipcam_msgpack_write_json_node(GByteArray *buffer, JsonNode *node);
+
+void ipcam_msgpack_reader_init(IpcamMsgpackReader *reader, gconstpointer data, gsize length);
+gboolean ipcam_msgpack_read(IpcamMsgpackReader *reader, IpcamMsgpackValue *value);
+gboolean ipcam_msgpack_skip(IpcamMsgpackReader *reader);
+gboolean ipcam_msgpack_str_equal(const IpcamMsgpackValue *value, const gchar *string);
+JsonNode *ipcam_msgpack_to_json_node(gconstpointer data, gsize length);
+gboolean ipcam_msgpack_is_map(gconstpointer data, gsize length);
+
+#endif /* __MSGPACK_H__ */
@@ -12,6 +12,7 @@ enum
 typedef struct _IpcamNoticeMessagePrivate
 {
     gchar *event;
+    GQuark event_quark;
 } IpcamNoticeMessagePrivate;
 
 G_DEFINE_TYPE_WITH_PRIVATE(IpcamNoticeMessage, ipcam_notice_message, IPCAM_MESSAGE_TYPE);
@@ -49,14 +50,11 @@ static void ipcam_notice_message_set_property(GObject *object,
                                        GParamSpec *pspec)
 {
     IpcamNoticeMessage *self = IPCAM_NOTICE_MESSAGE(object);
-    IpcamNoticeMessagePrivate *priv = ipcam_notice_message_get_instance_private(self);
     switch(property_id)
     {
     case IPCAM_NOTICE_MESSAGE_EVENT:
         {
-            g_free(priv->event);
-            priv->event = g_value_dup_string(value);
-            //g_print("ipcam notice message event: %s\n", priv->event);
+            ipcam_notice_message_set_event(self, g_value_get_string(value));
         }
         break;
     default:
@@ -66,11 +64,18 @@ static void ipcam_notice_message_set_property(GObject *object,
 }
 static void ipcam_notice_message_init(IpcamNoticeMessage *self)
 {
-    g_object_set(G_OBJECT(self), "type", "notice", "event", "", NULL);
+    ipcam_message_set_message_type(IPCAM_MESSAGE(self), "notice");
+    ipcam_notice_message_set_event(self, "");
+}
+static void ipcam_notice_message_reset(IpcamMessage *self)
+{
+    IPCAM_MESSAGE_CLASS(ipcam_notice_message_parent_class)->reset(self);
+    ipcam_notice_message_set_event(IPCAM_NOTICE_MESSAGE(self), "");
 }
 static void ipcam_notice_message_class_init(IpcamNoticeMessageClass *klass)
 {
     GObjectClass *this_class = G_OBJECT_CLASS(klass);
+    IPCAM_MESSAGE_CLASS(klass)->reset = &ipcam_notice_message_reset;
     this_class->finalize = &ipcam_notice_message_finalize;
     this_class->get_property = &ipcam_notice_message_get_property;
     this_class->set_property = &ipcam_notice_message_set_property;
@@ -84,3 +89,31 @@ static void ipcam_notice_message_class_init(IpcamNoticeMessageClass *klass)
     
     g_object_class_install_properties(this_class, N_PROPERTIES, obj_properties);
 }
+
+const gchar *ipcam_notice_message_get_event(IpcamNoticeMessage *notice_message)
+{
+	IpcamNoticeMessagePrivate *priv = ipcam_notice_message_get_instance_private(notice_message);
+
+	return priv->event;
+}
+
+GQuark ipcam_notice_message_get_event_quark(IpcamNoticeMessage *notice_message)
+{
+	IpcamNoticeMessagePrivate *priv = ipcam_notice_message_get_instance_private(notice_message);
+
+	return priv->event_quark;
+}
+
+void ipcam_notice_message_set_event(IpcamNoticeMessage *notice_message, const gchar *event)
+{
+	IpcamNoticeMessagePrivate *priv = ipcam_notice_message_get_instance_private(notice_message);
+
+	if (g_strcmp0(priv->event, event) != 0)
+	{
+		g_free(priv->event);
+		priv->event = g_strdup(event);
+		/* Only names somebody registered are interned, peers cannot grow the table */
+		priv->event_quark = priv->event ? g_quark_try_string(priv->event) : 0;
+		ipcam_message_invalidate(IPCAM_MESSAGE(notice_message));
+	}
+}
@@ -24,5 +24,8 @@ struct _IpcamNoticeMessageClass
 };
 
 GType ipcam_notice_message_get_type(void);
+const gchar *ipcam_notice_message_get_event(IpcamNoticeMessage *notice_message);
+GQuark ipcam_notice_message_get_event_quark(IpcamNoticeMessage *notice_message);
+void ipcam_notice_message_set_event(IpcamNoticeMessage *notice_message, const gchar *event);
 
 #endif /* __NOTICE_MESSAGE_H__ */
@@ -1,6 +1,6 @@
-#include <czmq.h>
 #include "request_message.h"
 #include "response_message.h"
+#include "message_pool.h"
 
 enum
 {
@@ -15,7 +15,9 @@ enum
 typedef struct _IpcamRequestMessagePrivate
 {
     gchar *action;
+    GQuark action_quark;
     gchar *id;
+    guint64 id_key;
 } IpcamRequestMessagePrivate;
 
 G_DEFINE_TYPE_WITH_PRIVATE(IpcamRequestMessage, ipcam_request_message, IPCAM_MESSAGE_TYPE);
@@ -24,12 +26,8 @@ static GParamSpec *obj_properties[N_PROPERTIES] = {NULL, };
 
 static void ipcam_request_message_dispose(GObject *self)
 {
-    static gboolean first_run = TRUE;
-    if (first_run)
-    {
-        first_run = FALSE;
-        G_OBJECT_CLASS(ipcam_request_message_parent_class)->dispose(self);
-    }
+    /* Always chain up, the base class may hand the message back to its pool */
+    G_OBJECT_CLASS(ipcam_request_message_parent_class)->dispose(self);
 }
 static void ipcam_request_message_finalize(GObject *self)
 {
@@ -68,21 +66,16 @@ static void ipcam_request_message_set_property(GObject *object,
                                                GParamSpec *pspec)
 {
     IpcamRequestMessage *self = IPCAM_REQUEST_MESSAGE(object);
-    IpcamRequestMessagePrivate *priv = ipcam_request_message_get_instance_private(self);
     switch(property_id)
     {
     case IPCAM_REQUEST_MESSAGE_ACTION:
         {
-            g_free(priv->action);
-            priv->action = g_value_dup_string(value);
-            /* g_print("ipcam request message action: %s\n", priv->action); */
+            ipcam_request_message_set_action(self, g_value_get_string(value));
         }
         break;
     case IPCAM_REQUEST_MESSAGE_ID:
         {
-            g_free(priv->id);
-            priv->id = g_value_dup_string(value);
-            /* g_print("ipcam request message id: %s\n", priv->id); */
+            ipcam_request_message_set_id(self, g_value_get_string(value));
         }
         break;
     default:
@@ -90,16 +83,31 @@ static void ipcam_request_message_set_property(GObject *object,
         break;
     }
 }
+static void ipcam_request_message_new_id(IpcamRequestMessage *self)
+{
+    IpcamRequestMessagePrivate *priv = ipcam_request_message_get_instance_private(self);
+    gchar message_id[IPCAM_MESSAGE_ID_LENGTH + 1];
+
+    priv->id_key = ipcam_message_id_generate(message_id);
+    g_free(priv->id);
+    priv->id = g_strdup(message_id);
+}
 static void ipcam_request_message_init(IpcamRequestMessage *self)
 {
-    zuuid_t *uuid = zuuid_new();
-    gchar *message_id = zuuid_str(uuid);
-    g_object_set(G_OBJECT(self), "type", "request", "id", message_id, "action", "", NULL);
-    zuuid_destroy(&uuid);
+    ipcam_message_set_message_type(IPCAM_MESSAGE(self), "request");
+    ipcam_request_message_new_id(self);
+    ipcam_request_message_set_action(self, "");
+}
+static void ipcam_request_message_reset(IpcamMessage *self)
+{
+    IPCAM_MESSAGE_CLASS(ipcam_request_message_parent_class)->reset(self);
+    ipcam_request_message_new_id(IPCAM_REQUEST_MESSAGE(self));
+    ipcam_request_message_set_action(IPCAM_REQUEST_MESSAGE(self), "");
 }
 static void ipcam_request_message_class_init(IpcamRequestMessageClass *klass)
 {
     GObjectClass *this_class = G_OBJECT_CLASS(klass);
+    IPCAM_MESSAGE_CLASS(klass)->reset = &ipcam_request_message_reset;
 
     this_class->dispose = &ipcam_request_message_dispose;
     this_class->finalize = &ipcam_request_message_finalize;
@@ -124,11 +132,13 @@ static void ipcam_request_message_class_init(IpcamRequestMessageClass *klass)
 IpcamMessage *ipcam_request_message_get_response_message(IpcamRequestMessage *request_message, const gchar *code)
 {
     IpcamRequestMessagePrivate *priv = ipcam_request_message_get_instance_private(request_message);
-    IpcamMessage *message = g_object_new(IPCAM_RESPONSE_MESSAGE_TYPE,
-                                         "action", priv->action,
-                                         "id", priv->id,
-                                         "code", code,
-                                         NULL);
+    IpcamMessagePool *pool = ipcam_message_get_pool(IPCAM_MESSAGE(request_message));
+    IpcamMessage *message = pool ?
+        ipcam_message_pool_acquire(pool, IPCAM_MESSAGE_KIND_RESPONSE) :
+        g_object_new(IPCAM_RESPONSE_MESSAGE_TYPE, NULL);
+    ipcam_response_message_set_action(IPCAM_RESPONSE_MESSAGE(message), priv->action);
+    ipcam_response_message_set_id(IPCAM_RESPONSE_MESSAGE(message), priv->id);
+    ipcam_response_message_set_code(IPCAM_RESPONSE_MESSAGE(message), code);
     return message;
 }
 
@@ -145,3 +155,44 @@ const gchar *ipcam_request_message_get_id(IpcamRequestMessage *request_message)
 
 	return priv->id;
 }
+
+guint64 ipcam_request_message_get_id_key(IpcamRequestMessage *request_message)
+{
+	IpcamRequestMessagePrivate *priv = ipcam_request_message_get_instance_private(request_message);
+
+	return priv->id_key;
+}
+
+GQuark ipcam_request_message_get_action_quark(IpcamRequestMessage *request_message)
+{
+	IpcamRequestMessagePrivate *priv = ipcam_request_message_get_instance_private(request_message);
+
+	return priv->action_quark;
+}
+
+void ipcam_request_message_set_action(IpcamRequestMessage *request_message, const gchar *action)
+{
+	IpcamRequestMessagePrivate *priv = ipcam_request_message_get_instance_private(request_message);
+
+	if (g_strcmp0(priv->action, action) != 0)
+	{
+		g_free(priv->action);
+		priv->action = g_strdup(action);
+		/* Only names somebody registered are interned, peers cannot grow the table */
+		priv->action_quark = priv->action ? g_quark_try_string(priv->action) : 0;
+		ipcam_message_invalidate(IPCAM_MESSAGE(request_message));
+	}
+}
+
+void ipcam_request_message_set_id(IpcamRequestMessage *request_message, const gchar *id)
+{
+	IpcamRequestMessagePrivate *priv = ipcam_request_message_get_instance_private(request_message);
+
+	if (g_strcmp0(priv->id, id) != 0)
+	{
+		g_free(priv->id);
+		priv->id = g_strdup(id);
+		priv->id_key = ipcam_message_id_to_key(priv->id);
+		ipcam_message_invalidate(IPCAM_MESSAGE(request_message));
+	}
+}
@@ -27,5 +27,9 @@ GType ipcam_request_message_get_type(void);
 IpcamMessage *ipcam_request_message_get_response_message(IpcamRequestMessage *request_message, const gchar *code);
 const gchar *ipcam_request_message_get_action(IpcamRequestMessage *request_message);
 const gchar *ipcam_request_message_get_id(IpcamRequestMessage *request_message);
+guint64 ipcam_request_message_get_id_key(IpcamRequestMessage *request_message);
+GQuark ipcam_request_message_get_action_quark(IpcamRequestMessage *request_message);
+void ipcam_request_message_set_action(IpcamRequestMessage *request_message, const gchar *action);
+void ipcam_request_message_set_id(IpcamRequestMessage *request_message, const gchar *id);
 
 #endif /* __REQUEST_MESSAGE_H__ */
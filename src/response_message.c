@@ -15,7 +15,9 @@ enum
 typedef struct _IpcamResponseMessagePrivate
 {
     gchar *action;
+    GQuark action_quark;
     gchar *id;
+    guint64 id_key;
     gchar *code;
 } IpcamResponseMessagePrivate;
 
@@ -66,28 +68,21 @@ static void ipcam_response_message_set_property(GObject *object,
                                                 GParamSpec *pspec)
 {
     IpcamResponseMessage *self = IPCAM_RESPONSE_MESSAGE(object);
-    IpcamResponseMessagePrivate *priv = ipcam_response_message_get_instance_private(self);
     switch(property_id)
     {
     case IPCAM_RESPONSE_MESSAGE_ACTION:
         {
-            g_free(priv->action);
-            priv->action = g_value_dup_string(value);
-            /* g_print("ipcam response message action: %s\n", priv->action); */
+            ipcam_response_message_set_action(self, g_value_get_string(value));
         }
         break;
     case IPCAM_RESPONSE_MESSAGE_ID:
         {
-            g_free(priv->id);
-            priv->id = g_value_dup_string(value);
-            /* g_print("ipcam response message id: %s\n", priv->id); */
+            ipcam_response_message_set_id(self, g_value_get_string(value));
         }
         break;
     case IPCAM_RESPONSE_MESSAGE_CODE:
         {
-            g_free(priv->code);
-            priv->code = g_value_dup_string(value);
-            /* g_print("ipcam response message code: %s\n", priv->code); */
+            ipcam_response_message_set_code(self, g_value_get_string(value));
         }
         break;
     default:
@@ -97,11 +92,22 @@ static void ipcam_response_message_set_property(GObject *object,
 }
 static void ipcam_response_message_init(IpcamResponseMessage *self)
 {
-    g_object_set(G_OBJECT(self), "type", "response", "action", "", "id", "", "code", "", NULL);
+    ipcam_message_set_message_type(IPCAM_MESSAGE(self), "response");
+    ipcam_response_message_set_action(self, "");
+    ipcam_response_message_set_id(self, "");
+    ipcam_response_message_set_code(self, "");
+}
+static void ipcam_response_message_reset(IpcamMessage *self)
+{
+    IPCAM_MESSAGE_CLASS(ipcam_response_message_parent_class)->reset(self);
+    ipcam_response_message_set_action(IPCAM_RESPONSE_MESSAGE(self), "");
+    ipcam_response_message_set_id(IPCAM_RESPONSE_MESSAGE(self), "");
+    ipcam_response_message_set_code(IPCAM_RESPONSE_MESSAGE(self), "");
 }
 static void ipcam_response_message_class_init(IpcamResponseMessageClass *klass)
 {
     GObjectClass *this_class = G_OBJECT_CLASS(klass);
+    IPCAM_MESSAGE_CLASS(klass)->reset = &ipcam_response_message_reset;
     this_class->finalize = &ipcam_response_message_finalize;
     this_class->get_property = &ipcam_response_message_get_property;
     this_class->set_property = &ipcam_response_message_set_property;
@@ -154,3 +160,58 @@ const gchar *ipcam_response_message_get_code(IpcamResponseMessage *request_messa
 
 	return priv->code;
 }
+
+guint64 ipcam_response_message_get_id_key(IpcamResponseMessage *response_message)
+{
+	IpcamResponseMessagePrivate *priv = ipcam_response_message_get_instance_private(response_message);
+
+	return priv->id_key;
+}
+
+GQuark ipcam_response_message_get_action_quark(IpcamResponseMessage *response_message)
+{
+	IpcamResponseMessagePrivate *priv = ipcam_response_message_get_instance_private(response_message);
+
+	return priv->action_quark;
+}
+
+void ipcam_response_message_set_action(IpcamResponseMessage *response_message, const gchar *action)
+{
+	IpcamResponseMessagePrivate *priv = ipcam_response_message_get_instance_private(response_message);
+
+	if (g_strcmp0(priv->action, action) != 0)
+	{
+		g_free(priv->action);
+		priv->action = g_strdup(action);
+		priv->action_quark = priv->action ? g_quark_try_string(priv->action) : 0;
+		ipcam_message_invalidate(IPCAM_MESSAGE(response_message));
+	}
+}
+
+void ipcam_response_message_set_id(IpcamResponseMessage *response_message, const gchar *id)
+{
+	IpcamResponseMessagePrivate *priv = ipcam_response_message_get_instance_private(response_message);
+
+	if (g_strcmp0(priv->id, id) != 0)
+	{
+		g_free(priv->id);
+		priv->id = g_strdup(id);
+		priv->id_key = ipcam_message_id_to_key(priv->id);
+		ipcam_message_invalidate(IPCAM_MESSAGE(response_message));
+	}
+}
+
+void ipcam_response_message_set_code(IpcamResponseMessage *response_message, const gchar *code)
+{
+	IpcamResponseMessagePrivate *priv = ipcam_response_message_get_instance_private(response_message);
+
+	/* No code is the empty one, as a fresh response has */
+	if (NULL == code)
+		code = "";
+	if (g_strcmp0(priv->code, code) != 0)
+	{
+		g_free(priv->code);
+		priv->code = g_strdup(code);
+		ipcam_message_invalidate(IPCAM_MESSAGE(response_message));
+	}
+}
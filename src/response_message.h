@@ -27,6 +27,11 @@ GType ipcam_response_message_get_type(void);
 gboolean ipcam_response_message_has_error(IpcamResponseMessage *response_message);
 const gchar *ipcam_response_message_get_action(IpcamResponseMessage *response_message);
 const gchar *ipcam_response_message_get_id(IpcamResponseMessage *response_message);
+guint64 ipcam_response_message_get_id_key(IpcamResponseMessage *response_message);
 const gchar *ipcam_response_message_get_code(IpcamResponseMessage *response_message);
+GQuark ipcam_response_message_get_action_quark(IpcamResponseMessage *response_message);
+void ipcam_response_message_set_action(IpcamResponseMessage *response_message, const gchar *action);
+void ipcam_response_message_set_id(IpcamResponseMessage *response_message, const gchar *id);
+void ipcam_response_message_set_code(IpcamResponseMessage *response_message, const gchar *code);
 
 #endif /* __RESPONSE_MESSAGE_H__ */
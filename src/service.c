@@ -1,18 +1,39 @@
 #include <assert.h>
+#include <string.h>
 #include <czmq.h>
 #include "service.h"
 #include "socket_manager.h"
 
+/*
+ * A socket with a batch_count setting above 1 collects outgoing messages
+ * per destination and sends them as one multipart message, in the batch
+ * format described in service.h.
+ */
+
+typedef struct _IpcamServiceBatch
+{
+    gchar *name;
+    gchar *client_id;
+    GByteArray *marker;
+    GPtrArray *frames;      /* slot 0 is kept for the marker */
+    gsize size;
+    gint64 deadline;        /* monotonic time the batch must be sent by */
+} IpcamServiceBatch;
+
 typedef struct _IpcamServicePrivate
 {
     IpcamSocketManager *socket_manager;
     GList *publish_lists;
+    GHashTable *batch_hash;
+    GMutex batch_mutex;
 } IpcamServicePrivate;
 
 G_DEFINE_TYPE_WITH_PRIVATE(IpcamService, ipcam_service, IPCAM_BASE_SERVICE_TYPE);
 
 static void ipcam_service_stop_impl(IpcamBaseService *service);
 static void ipcam_service_on_read_impl(IpcamBaseService *service, void *mq_socket);
+static void ipcam_service_prepare_poll_impl(IpcamBaseService *service, gint *timeout);
+static void ipcam_service_batch_free(IpcamServiceBatch *batch);
 
 static GObject *ipcam_service_constructor(GType self_type,
                                           guint n_properties,
@@ -37,6 +58,8 @@ static void ipcam_service_finalize(GObject *self)
     IpcamServicePrivate *priv = ipcam_service_get_instance_private(IPCAM_SERVICE(self));
 
     g_list_free_full(priv->publish_lists, g_free);
+    g_hash_table_destroy(priv->batch_hash);
+    g_mutex_clear(&priv->batch_mutex);
 
     G_OBJECT_CLASS(ipcam_service_parent_class)->finalize(self);
 }
@@ -45,6 +68,9 @@ static void ipcam_service_init(IpcamService *self)
     IpcamServicePrivate *priv = ipcam_service_get_instance_private(IPCAM_SERVICE(self));
     priv->socket_manager = g_object_new(IPCAM_SOCKET_MANAGER_TYPE, NULL);
     priv->publish_lists = NULL;
+    priv->batch_hash = g_hash_table_new_full(g_str_hash, g_str_equal, g_free,
+                                             (GDestroyNotify)ipcam_service_batch_free);
+    g_mutex_init(&priv->batch_mutex);
 }
 static void ipcam_service_class_init(IpcamServiceClass *klass)
 {
@@ -57,9 +83,12 @@ static void ipcam_service_class_init(IpcamServiceClass *klass)
     IpcamBaseServiceClass *base_service_class = IPCAM_BASE_SERVICE_CLASS(klass);
     base_service_class->stop = &ipcam_service_stop_impl;
     base_service_class->on_read = &ipcam_service_on_read_impl;
+    base_service_class->prepare_poll = &ipcam_service_prepare_poll_impl;
 
     klass->server_receive_string = NULL;
     klass->client_receive_string = NULL;
+    klass->server_receive_bytes = NULL;
+    klass->client_receive_bytes = NULL;
 }
 static void ipcam_service_server_receive_string(IpcamService *self, const gchar *name, const gchar *client_id, const gchar *string)
 {
@@ -69,7 +98,8 @@ static void ipcam_service_server_receive_string(IpcamService *self, const gchar
         g_warning ("Class '%s' does not override the mandatory "
                    "IpcamServiceClass.server_receive_string() virtual function.",
                    G_OBJECT_TYPE_NAME(self));
-}static void ipcam_service_client_receive_string(IpcamService *self, const gchar *name, const gchar *string)
+}
+static void ipcam_service_client_receive_string(IpcamService *self, const gchar *name, const gchar *string)
 {
     if (IPCAM_SERVICE_GET_CLASS(self)->client_receive_string != NULL)
         IPCAM_SERVICE_GET_CLASS(self)->client_receive_string(self, name, string);
@@ -78,43 +108,197 @@ static void ipcam_service_server_receive_string(IpcamService *self, const gchar
                    "IpcamServiceClass.client_receive_string() virtual function.",
                    G_OBJECT_TYPE_NAME(self));
 }
+static void ipcam_service_server_receive_bytes(IpcamService *self, const gchar *name, GBytes *client_id, GBytes *data[])
+{
+    if (IPCAM_SERVICE_GET_CLASS(self)->server_receive_bytes != NULL)
+    {
+        IPCAM_SERVICE_GET_CLASS(self)->server_receive_bytes(self, name, client_id, data);
+    }
+    else if (data[0])
+    {
+        gsize size;
+        const gchar *bytes = g_bytes_get_data(data[0], &size);
+        gchar *string = g_strndup(bytes, size);
+        bytes = g_bytes_get_data(client_id, &size);
+        gchar *id = g_strndup(bytes, size);
+        ipcam_service_server_receive_string(self, name, id, string);
+        g_free(id);
+        g_free(string);
+    }
+}
+static void ipcam_service_client_receive_bytes(IpcamService *self, const gchar *name, GBytes *data[])
+{
+    if (IPCAM_SERVICE_GET_CLASS(self)->client_receive_bytes != NULL)
+    {
+        IPCAM_SERVICE_GET_CLASS(self)->client_receive_bytes(self, name, data);
+    }
+    else if (data[0])
+    {
+        gsize size;
+        const gchar *bytes = g_bytes_get_data(data[0], &size);
+        gchar *string = g_strndup(bytes, size);
+        ipcam_service_client_receive_string(self, name, string);
+        g_free(string);
+    }
+}
 static void ipcam_service_stop_impl(IpcamBaseService *self)
 {
     IpcamService *service = IPCAM_SERVICE(self);
     IpcamServicePrivate *priv = ipcam_service_get_instance_private(service);
+    ipcam_service_flush(service);
     ipcam_socket_manager_close_all_socket(priv->socket_manager);
 }
+static void free_received_frame(gpointer frame)
+{
+    zframe_destroy((zframe_t **)&frame);
+}
+static GBytes *zmq_frame_to_bytes(zframe_t *frame)
+{
+    /* The bytes own the frame, nothing is copied out of zmq's buffer */
+    return g_bytes_new_with_free_func(zframe_data(frame), zframe_size(frame),
+                                      free_received_frame, frame);
+}
+static GBytes **zmq_msg_to_bytes(zmsg_t *msg)
+{
+    GBytes **data = g_new0(GBytes *, zmsg_size(msg) + 1);
+    zframe_t *frame;
+    gint i = 0;
+
+    /* Frames are binary, MessagePack bodies may hold NUL bytes */
+    while ((frame = zmsg_pop(msg)))
+    {
+        data[i++] = zmq_frame_to_bytes(frame);
+    }
+    return data;
+}
+static void free_bytes_list(GBytes **data)
+{
+    gint i;
+    for (i = 0; data[i]; i++)
+    {
+        g_bytes_unref(data[i]);
+    }
+    g_free(data);
+}
+static void ipcam_service_dispatch(IpcamService *service,
+                                   const gchar *name,
+                                   gint type,
+                                   GBytes *client_id,
+                                   GBytes *data[])
+{
+    if (IPCAM_SOCKET_TYPE_SERVER == type)
+    {
+        ipcam_service_server_receive_bytes(service, name, client_id, data);
+    }
+    else
+    {
+        ipcam_service_client_receive_bytes(service, name, data);
+    }
+}
+static gboolean ipcam_service_is_batch(GBytes *data[])
+{
+    gsize size;
+    const guint8 *marker;
+
+    if (NULL == data[0])
+        return FALSE;
+    marker = g_bytes_get_data(data[0], &size);
+    return size > 1 && IPCAM_SERVICE_BATCH_MARKER == marker[0];
+}
+/*
+ * The whole batch is handed up from the one read that received it.  The
+ * counts come from the peer, so they are checked against the frames
+ * before anything is dispatched: a malformed batch is dropped whole.
+ */
+static void ipcam_service_dispatch_batch(IpcamService *service,
+                                         const gchar *name,
+                                         gint type,
+                                         GBytes *client_id,
+                                         GBytes *data[])
+{
+    GBytes *message[IPCAM_SERVICE_BATCH_MAX_FRAMES + 1];
+    GBytes **frames = data + 1;
+    const guint8 *counts;
+    gsize size, left = 0, total = 0, i;
+
+    counts = g_bytes_get_data(data[0], &size);
+    while (frames[left])
+        left++;
+
+    for (i = 1; i < size && total <= left; i++)
+    {
+        if (0 == counts[i])
+            break;
+        total += counts[i];
+    }
+    if (i < size || total != left)
+    {
+        g_warning("Malformed message batch on '%s'.\n", name);
+        return;
+    }
+
+    for (i = 1; i < size; i++)
+    {
+        guint count = counts[i];
+        memcpy(message, frames, count * sizeof(GBytes *));
+        message[count] = NULL;
+        ipcam_service_dispatch(service, name, type, client_id, message);
+        frames += count;
+    }
+}
 static void ipcam_service_on_read_impl(IpcamBaseService *self, void *mq_socket)
 {
     gchar *name = NULL;
-    gchar *string = NULL;
-    gchar *client_id = NULL;
+    GBytes *client_id = NULL;
+    GBytes **data = NULL;
+    zmsg_t *msg = NULL;
     gint type;
     IpcamService *service = IPCAM_SERVICE(self);
     IpcamServicePrivate *priv = ipcam_service_get_instance_private(service);
     ipcam_socket_manager_get_by_socket(priv->socket_manager, mq_socket, &name, &type);
     g_return_if_fail(name);
 
+    msg = zmsg_recv(mq_socket);
+    if (NULL == msg)
+    {
+        g_free(name);
+        return;
+    }
+
     switch(type)
     {
     case IPCAM_SOCKET_TYPE_SERVER:
-        client_id = zstr_recv(mq_socket);
-        string = zstr_recv(mq_socket);
-        ipcam_service_server_receive_string(service, name, client_id, string);
+    {
+        zframe_t *identity = zmsg_pop(msg);
+        if (identity)
+        {
+            client_id = zmq_frame_to_bytes(identity);
+            data = zmq_msg_to_bytes(msg);
+        }
         break;
+    }
     case IPCAM_SOCKET_TYPE_SUBSCRIBER:
     case IPCAM_SOCKET_TYPE_CLIENT:
-        string = zstr_recv(mq_socket);
-        ipcam_service_client_receive_string(service, name, string);
+        data = zmq_msg_to_bytes(msg);
         break;
     default:
         g_print("unkonw type\n");
         break;
     }
+
+    if (data && ipcam_service_is_batch(data))
+    {
+        ipcam_service_dispatch_batch(service, name, type, client_id, data);
+    }
+    else if (data)
+    {
+        ipcam_service_dispatch(service, name, type, client_id, data);
+    }
     
     g_free(name);
-    zstr_free(&string);
-    zstr_free(&client_id);
+    if (data) free_bytes_list(data);
+    if (client_id) g_bytes_unref(client_id);
+    zmsg_destroy(&msg);
 }
 static gint zmq_send_strings(void *socket, const gchar *strings[])
 {
@@ -156,6 +340,244 @@ gboolean ipcam_service_send_strings(IpcamService *service,
     }
     return ret;
 }
+static void free_frame_bytes(void *data, void *arg)
+{
+    g_bytes_unref((GBytes *)arg);
+}
+static gint zmq_send_bytes(void *socket, GBytes *frames[])
+{
+    zmsg_t *msg = zmsg_new();
+    gint i = 0;
+    while (frames[i])
+    {
+        /* The frame borrows the bytes, so a forwarded body is never copied */
+        gsize size;
+        gpointer data = (gpointer)g_bytes_get_data(frames[i], &size);
+        zframe_t *frame = zframe_new_zero_copy(data, size, free_frame_bytes, g_bytes_ref(frames[i]));
+        zmsg_append(msg, &frame);
+        i++;
+    }
+    gint ret = zmsg_send(&msg, socket);
+    return ret;
+}
+gboolean ipcam_service_send_bytes(IpcamService *service,
+                                  const gchar *name,
+                                  GBytes *frames[],
+                                  const gchar *client_id)
+{
+    gboolean ret = FALSE;
+    gint type;
+    void *mq_socket = NULL;
+    IpcamServicePrivate *priv = ipcam_service_get_instance_private(service);
+    g_return_val_if_fail(ipcam_socket_manager_get_by_name(priv->socket_manager, name, &type, &mq_socket), FALSE);
+    switch(type)
+    {
+    case IPCAM_SOCKET_TYPE_SERVER:
+        g_return_val_if_fail(client_id, FALSE);
+        zstr_sendm(mq_socket, client_id);
+        zmq_send_bytes(mq_socket, frames);
+        ret = TRUE;
+        break;
+    case IPCAM_SOCKET_TYPE_PUBLISHER:
+    case IPCAM_SOCKET_TYPE_CLIENT:
+        zmq_send_bytes(mq_socket, frames);
+        ret = TRUE;
+        break;
+    default:
+        break;
+    }
+    return ret;
+}
+static IpcamServiceBatch *ipcam_service_batch_new(const gchar *name, const gchar *client_id)
+{
+    IpcamServiceBatch *batch = g_new0(IpcamServiceBatch, 1);
+    guint8 marker = IPCAM_SERVICE_BATCH_MARKER;
+
+    batch->name = g_strdup(name);
+    batch->client_id = g_strdup(client_id);
+    batch->marker = g_byte_array_sized_new(16);
+    g_byte_array_append(batch->marker, &marker, 1);
+    batch->frames = g_ptr_array_sized_new(16);
+    g_ptr_array_add(batch->frames, NULL);
+    return batch;
+}
+static void ipcam_service_batch_free(IpcamServiceBatch *batch)
+{
+    guint i;
+    for (i = 0; i < batch->frames->len; i++)
+    {
+        if (g_ptr_array_index(batch->frames, i))
+            g_bytes_unref(g_ptr_array_index(batch->frames, i));
+    }
+    g_ptr_array_free(batch->frames, TRUE);
+    if (batch->marker)
+        g_byte_array_free(batch->marker, TRUE);
+    g_free(batch->client_id);
+    g_free(batch->name);
+    g_free(batch);
+}
+static void ipcam_service_batch_send(IpcamService *service, IpcamServiceBatch *batch)
+{
+    GBytes **frames;
+
+    g_ptr_array_add(batch->frames, NULL);
+    frames = (GBytes **)batch->frames->pdata;
+    if (batch->marker->len > 2)
+    {
+        frames[0] = g_byte_array_free_to_bytes(batch->marker);
+        batch->marker = NULL;
+    }
+    else
+    {
+        /* A lone message goes out as it is */
+        frames++;
+    }
+    ipcam_service_send_bytes(service, batch->name, frames, batch->client_id);
+}
+static gchar *ipcam_service_batch_key(const gchar *name, const gchar *client_id)
+{
+    return g_strconcat(name, "\n", client_id, NULL);
+}
+/*
+ * Like ipcam_service_send_bytes(), but on a socket with batching set up
+ * the message joins the batch for its destination.  The batch is sent
+ * once it holds batch_count messages or batch_bytes bytes, or when it has
+ * waited batch_delay milliseconds; the delay is checked by the service
+ * loop, so a batch filled from another thread may wait one poll longer.
+ */
+gboolean ipcam_service_queue_bytes(IpcamService *service,
+                                   const gchar *name,
+                                   GBytes *frames[],
+                                   const gchar *client_id)
+{
+    IpcamServicePrivate *priv = ipcam_service_get_instance_private(service);
+    IpcamServiceBatch *batch;
+    gint max_count, max_bytes;
+    gboolean full;
+    gchar *key;
+    guint8 count;
+    guint i;
+
+    max_count = ipcam_service_get_socket_option(service, name, IPCAM_SOCKET_OPTION_BATCH_COUNT);
+    for (i = 0; frames[i]; i++)
+        ;
+    if (max_count <= 1 || 0 == i || i > IPCAM_SERVICE_BATCH_MAX_FRAMES)
+    {
+        return ipcam_service_send_bytes(service, name, frames, client_id);
+    }
+    max_bytes = ipcam_service_get_socket_option(service, name, IPCAM_SOCKET_OPTION_BATCH_BYTES);
+
+    key = ipcam_service_batch_key(name, client_id);
+    g_mutex_lock(&priv->batch_mutex);
+    batch = g_hash_table_lookup(priv->batch_hash, key);
+    if (NULL == batch)
+    {
+        gint delay = ipcam_service_get_socket_option(service, name, IPCAM_SOCKET_OPTION_BATCH_DELAY);
+        batch = ipcam_service_batch_new(name, client_id);
+        batch->deadline = g_get_monotonic_time() + (gint64)MAX(delay, 0) * 1000;
+        g_hash_table_insert(priv->batch_hash, g_strdup(key), batch);
+    }
+    count = (guint8)i;
+    g_byte_array_append(batch->marker, &count, 1);
+    for (i = 0; frames[i]; i++)
+    {
+        g_ptr_array_add(batch->frames, g_bytes_ref(frames[i]));
+        batch->size += g_bytes_get_size(frames[i]);
+    }
+    full = (gint)(batch->marker->len - 1) >= max_count ||
+        (max_bytes > 0 && batch->size >= (gsize)max_bytes);
+    if (full)
+    {
+        gpointer stored_key;
+        g_hash_table_lookup_extended(priv->batch_hash, key, &stored_key, NULL);
+        g_hash_table_steal(priv->batch_hash, key);
+        g_free(stored_key);
+    }
+    g_mutex_unlock(&priv->batch_mutex);
+    g_free(key);
+
+    if (full)
+    {
+        ipcam_service_batch_send(service, batch);
+        ipcam_service_batch_free(batch);
+    }
+    return TRUE;
+}
+static void ipcam_service_flush_batches(IpcamService *service, gboolean all, gint *timeout)
+{
+    IpcamServicePrivate *priv = ipcam_service_get_instance_private(service);
+    gint64 now = g_get_monotonic_time();
+    GHashTableIter iter;
+    gpointer key, value;
+    GList *due = NULL, *item;
+
+    g_mutex_lock(&priv->batch_mutex);
+    g_hash_table_iter_init(&iter, priv->batch_hash);
+    while (g_hash_table_iter_next(&iter, &key, &value))
+    {
+        IpcamServiceBatch *batch = value;
+        if (all || batch->deadline <= now)
+        {
+            due = g_list_prepend(due, batch);
+            g_hash_table_iter_steal(&iter);
+            g_free(key);
+        }
+        else if (timeout)
+        {
+            *timeout = MIN(*timeout, (gint)((batch->deadline - now + 999) / 1000));
+        }
+    }
+    g_mutex_unlock(&priv->batch_mutex);
+
+    for (item = due; item; item = item->next)
+    {
+        ipcam_service_batch_send(service, item->data);
+        ipcam_service_batch_free(item->data);
+    }
+    g_list_free(due);
+}
+static void ipcam_service_prepare_poll_impl(IpcamBaseService *self, gint *timeout)
+{
+    ipcam_service_flush_batches(IPCAM_SERVICE(self), FALSE, timeout);
+}
+/* Sends every pending batch now */
+void ipcam_service_flush(IpcamService *service)
+{
+    g_return_if_fail(IPCAM_IS_SERVICE(service));
+    ipcam_service_flush_batches(service, TRUE, NULL);
+}
+gboolean ipcam_service_set_socket_option(IpcamService *service,
+                                         const gchar *name,
+                                         IpcamSocketOption option,
+                                         gint value)
+{
+    IpcamServicePrivate *priv = ipcam_service_get_instance_private(service);
+    return ipcam_socket_manager_set_option(priv->socket_manager, name, option, value);
+}
+gint ipcam_service_get_socket_option(IpcamService *service,
+                                     const gchar *name,
+                                     IpcamSocketOption option)
+{
+    gint value = 0;
+    IpcamServicePrivate *priv = ipcam_service_get_instance_private(service);
+    ipcam_socket_manager_get_option(priv->socket_manager, name, option, &value);
+    return value;
+}
+void ipcam_service_add_socket_stat(IpcamService *service,
+                                   const gchar *name,
+                                   IpcamSocketStat stat,
+                                   guint64 amount)
+{
+    IpcamServicePrivate *priv = ipcam_service_get_instance_private(service);
+    ipcam_socket_manager_add_stat(priv->socket_manager, name, stat, amount);
+}
+guint64 ipcam_service_get_socket_stat(IpcamService *service,
+                                      const gchar *name,
+                                      IpcamSocketStat stat)
+{
+    IpcamServicePrivate *priv = ipcam_service_get_instance_private(service);
+    return ipcam_socket_manager_get_stat(priv->socket_manager, name, stat);
+}
 gboolean ipcam_service_is_server(IpcamService *service, const gchar *name)
 {
     gint type;
@@ -2,6 +2,7 @@
 #define __SERVICE_H__
 
 #include "base_service.h"
+#include "socket_manager.h"
 
 #define IPCAM_SERVICE_TYPE (ipcam_service_get_type())
 #define IPCAM_SERVICE(obj) (G_TYPE_CHECK_INSTANCE_CAST((obj), IPCAM_SERVICE_TYPE, IpcamService))
@@ -10,6 +11,17 @@
 #define IPCAM_IS_SERVICE_CLASS(klass) (G_TYPE_CHECK_CLASS_TYPE((klass), IPCAM_SERVICE_TYPE))
 #define IPCAM_SERVICE_GET_CLASS(obj) (G_TYPE_INSTANCE_GET_CLASS((obj), IPCAM_SERVICE_TYPE, IpcamServiceClass))
 
+/*
+ * A batch carries several messages in one multipart message.  Its first
+ * frame is the marker byte followed by one byte per message giving the
+ * number of frames it has; the frames of the messages follow in order.
+ * The marker byte is unused in MessagePack and starts no JSON text or
+ * UTF-8 string, so a batch is never taken for a plain message.  Every
+ * batch received is unpacked and dispatched message by message.
+ */
+#define IPCAM_SERVICE_BATCH_MARKER 0xc1
+#define IPCAM_SERVICE_BATCH_MAX_FRAMES G_MAXUINT8
+
 typedef struct _IpcamService IpcamService;
 typedef struct _IpcamServiceClass IpcamServiceClass;
 
@@ -23,6 +35,13 @@ struct _IpcamServiceClass {
     //
     void (*server_receive_string)(IpcamService *self, const gchar *name, const gchar *client_id, const gchar *string);
     void (*client_receive_string)(IpcamService *self, const gchar *name, const gchar *string);
+    /*
+     * Optional, NULL terminated frame lists; default to the string virtuals.
+     * The frames, and the client id frame, wrap the received zmq memory;
+     * take a reference to keep any of them past the call.
+     */
+    void (*server_receive_bytes)(IpcamService *self, const gchar *name, GBytes *client_id, GBytes *data[]);
+    void (*client_receive_bytes)(IpcamService *self, const gchar *name, GBytes *data[]);
 };
 
 GType ipcam_service_get_type(void);
@@ -30,6 +49,29 @@ gboolean ipcam_service_send_strings(IpcamService *service,
                                     const gchar *name,
                                     const gchar *strings[],
                                     const gchar *client_id);
+gboolean ipcam_service_send_bytes(IpcamService *service,
+                                  const gchar *name,
+                                  GBytes *frames[],
+                                  const gchar *client_id);
+gboolean ipcam_service_queue_bytes(IpcamService *service,
+                                   const gchar *name,
+                                   GBytes *frames[],
+                                   const gchar *client_id);
+void ipcam_service_flush(IpcamService *service);
+gboolean ipcam_service_set_socket_option(IpcamService *service,
+                                         const gchar *name,
+                                         IpcamSocketOption option,
+                                         gint value);
+gint ipcam_service_get_socket_option(IpcamService *service,
+                                     const gchar *name,
+                                     IpcamSocketOption option);
+void ipcam_service_add_socket_stat(IpcamService *service,
+                                   const gchar *name,
+                                   IpcamSocketStat stat,
+                                   guint64 amount);
+guint64 ipcam_service_get_socket_stat(IpcamService *service,
+                                      const gchar *name,
+                                      IpcamSocketStat stat);
 gboolean ipcam_service_is_server(IpcamService *service, const gchar *name);
 gboolean ipcam_service_is_client(IpcamService *service, const gchar *name);
 gboolean ipcam_service_connect_by_name(IpcamService *service,
@@ -8,6 +8,8 @@ typedef struct _IpcamSocketManagerHashValue
     gchar *name;
     void *mq_socket;
     gint type;
+    gint options[IPCAM_SOCKET_OPTION_LAST];
+    guint64 stats[IPCAM_SOCKET_STAT_LAST];
 } IpcamSocketManagerHashValue;
 
 typedef struct _IpcamSocketManagerPrivate
@@ -74,7 +76,7 @@ gboolean ipcam_socket_manager_add(IpcamSocketManager *socket_manager,
                                   const void *mq_socket)
 {
     IpcamSocketManagerPrivate *priv = ipcam_socket_manager_get_instance_private(socket_manager);
-    IpcamSocketManagerHashValue *value = g_new(IpcamSocketManagerHashValue, 1);
+    IpcamSocketManagerHashValue *value = g_new0(IpcamSocketManagerHashValue, 1);
     g_return_val_if_fail(value, FALSE);
     value->name = g_strdup(name);
     value->mq_socket = (void *)mq_socket;
@@ -181,6 +183,92 @@ gboolean ipcam_socket_manager_get_by_socket(IpcamSocketManager *socket_manager,
 
     return ret;
 }
+gboolean ipcam_socket_manager_set_option(IpcamSocketManager *socket_manager,
+                                         const gchar *name,
+                                         IpcamSocketOption option,
+                                         gint value)
+{
+    g_return_val_if_fail(IPCAM_IS_SOCKET_MANAGER(socket_manager), FALSE);
+    g_return_val_if_fail(option < IPCAM_SOCKET_OPTION_LAST, FALSE);
+    gboolean ret = FALSE;
+    IpcamSocketManagerPrivate *priv = ipcam_socket_manager_get_instance_private(socket_manager);
+
+    g_mutex_lock(&priv->mutex);
+    IpcamSocketManagerHashValue *hash_value =
+        (IpcamSocketManagerHashValue *)g_hash_table_lookup(priv->socket_hash, name);
+    if (NULL != hash_value)
+    {
+        hash_value->options[option] = value;
+        ret = TRUE;
+    }
+    g_mutex_unlock(&priv->mutex);
+
+    return ret;
+}
+gboolean ipcam_socket_manager_get_option(IpcamSocketManager *socket_manager,
+                                         const gchar *name,
+                                         IpcamSocketOption option,
+                                         gint *value)
+{
+    g_return_val_if_fail(IPCAM_IS_SOCKET_MANAGER(socket_manager), FALSE);
+    g_return_val_if_fail(option < IPCAM_SOCKET_OPTION_LAST, FALSE);
+    gboolean ret = FALSE;
+    IpcamSocketManagerPrivate *priv = ipcam_socket_manager_get_instance_private(socket_manager);
+
+    g_mutex_lock(&priv->mutex);
+    IpcamSocketManagerHashValue *hash_value =
+        (IpcamSocketManagerHashValue *)g_hash_table_lookup(priv->socket_hash, name);
+    if (NULL != hash_value)
+    {
+        *value = hash_value->options[option];
+        ret = TRUE;
+    }
+    g_mutex_unlock(&priv->mutex);
+
+    return ret;
+}
+gboolean ipcam_socket_manager_add_stat(IpcamSocketManager *socket_manager,
+                                       const gchar *name,
+                                       IpcamSocketStat stat,
+                                       guint64 amount)
+{
+    g_return_val_if_fail(IPCAM_IS_SOCKET_MANAGER(socket_manager), FALSE);
+    g_return_val_if_fail(stat < IPCAM_SOCKET_STAT_LAST, FALSE);
+    gboolean ret = FALSE;
+    IpcamSocketManagerPrivate *priv = ipcam_socket_manager_get_instance_private(socket_manager);
+
+    g_mutex_lock(&priv->mutex);
+    IpcamSocketManagerHashValue *hash_value =
+        (IpcamSocketManagerHashValue *)g_hash_table_lookup(priv->socket_hash, name);
+    if (NULL != hash_value)
+    {
+        hash_value->stats[stat] += amount;
+        ret = TRUE;
+    }
+    g_mutex_unlock(&priv->mutex);
+
+    return ret;
+}
+guint64 ipcam_socket_manager_get_stat(IpcamSocketManager *socket_manager,
+                                      const gchar *name,
+                                      IpcamSocketStat stat)
+{
+    g_return_val_if_fail(IPCAM_IS_SOCKET_MANAGER(socket_manager), 0);
+    g_return_val_if_fail(stat < IPCAM_SOCKET_STAT_LAST, 0);
+    guint64 ret = 0;
+    IpcamSocketManagerPrivate *priv = ipcam_socket_manager_get_instance_private(socket_manager);
+
+    g_mutex_lock(&priv->mutex);
+    IpcamSocketManagerHashValue *hash_value =
+        (IpcamSocketManagerHashValue *)g_hash_table_lookup(priv->socket_hash, name);
+    if (NULL != hash_value)
+    {
+        ret = hash_value->stats[stat];
+    }
+    g_mutex_unlock(&priv->mutex);
+
+    return ret;
+}
 
 void ipcam_socket_manager_close_all_socket(IpcamSocketManager *socket_manager)
 {
@@ -11,6 +11,31 @@ enum
      IPCAM_SOCKET_TYPE_PUBLISHER = 2,
      IPCAM_SOCKET_TYPE_SUBSCRIBER = 3,
 };
+
+/* Per socket settings, all plain integers, default 0 */
+typedef enum
+{
+     IPCAM_SOCKET_OPTION_ENCODING = 0,
+     IPCAM_SOCKET_OPTION_FRAMING,
+     IPCAM_SOCKET_OPTION_MAX_SIZE,
+     IPCAM_SOCKET_OPTION_COMPRESS_THRESHOLD,
+     IPCAM_SOCKET_OPTION_BATCH_COUNT,
+     IPCAM_SOCKET_OPTION_BATCH_BYTES,
+     IPCAM_SOCKET_OPTION_BATCH_DELAY,
+     IPCAM_SOCKET_OPTION_WINDOW,
+     IPCAM_SOCKET_OPTION_WINDOW_QUEUE,
+     IPCAM_SOCKET_OPTION_LAST
+} IpcamSocketOption;
+
+/* Per socket counters, only ever added to */
+typedef enum
+{
+     IPCAM_SOCKET_STAT_COMPRESSED = 0,
+     IPCAM_SOCKET_STAT_BYTES_SAVED,
+     IPCAM_SOCKET_STAT_COMPRESS_TIME,
+     IPCAM_SOCKET_STAT_WINDOW_OVERFLOW,
+     IPCAM_SOCKET_STAT_LAST
+} IpcamSocketStat;
      
 #define IPCAM_SOCKET_MANAGER_TYPE (ipcam_socket_manager_get_type())
 #define IPCAM_SOCKET_MANAGER(obj) (G_TYPE_CHECK_INSTANCE_CAST((obj), IPCAM_SOCKET_MANAGER_TYPE, IpcamSocketManager))
@@ -40,6 +65,21 @@ gboolean ipcam_socket_manager_has_name(IpcamSocketManager *socket_manager, const
 gboolean ipcam_socket_manager_has_socket(IpcamSocketManager *socket_manager, const void *mq_socket);
 gboolean ipcam_socket_manager_get_by_name(IpcamSocketManager *socket_manager, const gchar *name, int *type, void **mq_socket);
 gboolean ipcam_socket_manager_get_by_socket(IpcamSocketManager *socket_manager, const void *mq_socket, gchar **name, int *type);
+gboolean ipcam_socket_manager_set_option(IpcamSocketManager *socket_manager,
+                                         const gchar *name,
+                                         IpcamSocketOption option,
+                                         gint value);
+gboolean ipcam_socket_manager_get_option(IpcamSocketManager *socket_manager,
+                                         const gchar *name,
+                                         IpcamSocketOption option,
+                                         gint *value);
+gboolean ipcam_socket_manager_add_stat(IpcamSocketManager *socket_manager,
+                                       const gchar *name,
+                                       IpcamSocketStat stat,
+                                       guint64 amount);
+guint64 ipcam_socket_manager_get_stat(IpcamSocketManager *socket_manager,
+                                      const gchar *name,
+                                      IpcamSocketStat stat);
 void ipcam_socket_manager_close_all_socket(IpcamSocketManager *socket_manager);
 
 #endif /* __SOCKET_MANAGER_H__ */
@@ -1,47 +1,63 @@
+#include <string.h>
 #include "timer_manager.h"
+#include "deadline_queue.h"
+#include "timer_spec.h"
 
 typedef struct _IpcamTimerManagerHashValue
 {
+    IpcamDeadlineEntry entry;   /* first, so an expired entry is its value */
     gchar *timer_id;
     GObject *object;
     TCFunc callback;
+    gint64 lateness;
+    /* Timer pump timers: fires once, and has been fired */
+    gboolean once;
+    gboolean fired;
+    /* Local timers only, those of the timer pump are fired from outside */
+    gboolean local;
+    IpcamTimerSpec spec;
 } IpcamTimerManagerHashValue;
 
 typedef IpcamTimerManagerHashValue hash_value;
 
 typedef struct _IpcamTimerManagerPrivate
 {
+    /*
+     * Guards the table and the heap, timers are added and deleted from any
+     * thread; never held while a callback runs
+     */
+    GMutex mutex;
     GHashTable *timers_hash;
+    IpcamDeadlineQueue *deadlines;
 } IpcamTimerManagerPrivate;
 
 G_DEFINE_TYPE_WITH_PRIVATE(IpcamTimerManager, ipcam_timer_manager, G_TYPE_OBJECT);
 
 static void ipcam_timer_manager_dispose(GObject *self)
 {
-    static gboolean first_run = TRUE;
-
-    if (first_run)
-    {
-        first_run = FALSE;
-        G_OBJECT_CLASS(ipcam_timer_manager_parent_class)->dispose(self);
-    }
+    G_OBJECT_CLASS(ipcam_timer_manager_parent_class)->dispose(self);
 }
 static void ipcam_timer_manager_finalize(GObject *self)
 {
     IpcamTimerManagerPrivate *priv = ipcam_timer_manager_get_instance_private(IPCAM_TIMER_MANAGER(self));
+    ipcam_deadline_queue_free(priv->deadlines);
     g_hash_table_destroy(priv->timers_hash);
+    g_mutex_clear(&priv->mutex);
     G_OBJECT_CLASS(ipcam_timer_manager_parent_class)->finalize(self);
 }
 static void destroy(gpointer data)
 {
     hash_value *value = (hash_value *)data;
+    ipcam_timer_spec_clear(&value->spec);
     g_free(value->timer_id);
     g_free(value);
 }
 static void ipcam_timer_manager_init(IpcamTimerManager *self)
 {
     IpcamTimerManagerPrivate *priv = ipcam_timer_manager_get_instance_private(self);
+    g_mutex_init(&priv->mutex);
     priv->timers_hash = g_hash_table_new_full(g_str_hash, g_str_equal, NULL, (GDestroyNotify)destroy);
+    priv->deadlines = ipcam_deadline_queue_new();
 }
 static void ipcam_timer_manager_class_init(IpcamTimerManagerClass *klass)
 {
@@ -49,6 +65,41 @@ static void ipcam_timer_manager_class_init(IpcamTimerManagerClass *klass)
     this_class->dispose = &ipcam_timer_manager_dispose;
     this_class->finalize = &ipcam_timer_manager_finalize;
 }
+/* With the lock held; NULL when the id is taken */
+static hash_value *ipcam_timer_manager_insert(IpcamTimerManagerPrivate *priv,
+                                              const gchar *timer_id,
+                                              GObject *object,
+                                              TCFunc callback)
+{
+    hash_value *value;
+
+    if (g_hash_table_contains(priv->timers_hash, timer_id))
+        return NULL;
+    value = g_new0(hash_value, 1);
+    value->timer_id = g_strdup(timer_id);
+    value->object = object;
+    value->callback = callback;
+    g_hash_table_insert(priv->timers_hash, value->timer_id, (gpointer)value);
+    return value;
+}
+/* Looks the timer up and takes what firing it needs, FALSE if it is gone */
+static gboolean ipcam_timer_manager_get_callback(IpcamTimerManagerPrivate *priv,
+                                                 const gchar *timer_id,
+                                                 GObject **object,
+                                                 TCFunc *callback)
+{
+    hash_value *value;
+
+    g_mutex_lock(&priv->mutex);
+    value = (hash_value *)g_hash_table_lookup(priv->timers_hash, timer_id);
+    if (value)
+    {
+        *object = value->object;
+        *callback = value->callback;
+    }
+    g_mutex_unlock(&priv->mutex);
+    return value != NULL;
+}
 gboolean ipcam_timer_manager_add_timer(IpcamTimerManager *timer_manager,
                                        const gchar *timer_id,
                                        GObject *object,
@@ -56,26 +107,192 @@ gboolean ipcam_timer_manager_add_timer(IpcamTimerManager *timer_manager,
 {
     g_return_val_if_fail(IPCAM_IS_TIMER_MANAGER(timer_manager), FALSE);
     IpcamTimerManagerPrivate *priv = ipcam_timer_manager_get_instance_private(timer_manager);
-    g_return_val_if_fail(!g_hash_table_contains(priv->timers_hash, timer_id), FALSE);
-    hash_value *value = g_new(hash_value, 1);
-    value->timer_id = g_strdup(timer_id);
-    value->object = object;
-    value->callback = callback;
-    return g_hash_table_insert(priv->timers_hash, (gpointer)timer_id, (gpointer)value);
+    hash_value *value;
+
+    g_mutex_lock(&priv->mutex);
+    value = ipcam_timer_manager_insert(priv, timer_id, object, callback);
+    g_mutex_unlock(&priv->mutex);
+    g_return_val_if_fail(value != NULL, FALSE);
+    return TRUE;
+}
+/*
+ * A timer run by this process itself rather than by the timer pump: no
+ * round trip to another process, and no dependency on it running.  The
+ * owner calls ipcam_timer_manager_dispatch() from its loop.
+ */
+gboolean ipcam_timer_manager_add_local_timer(IpcamTimerManager *timer_manager,
+                                             const gchar *timer_id,
+                                             const gchar *spec,
+                                             GObject *object,
+                                             TCFunc callback)
+{
+    g_return_val_if_fail(IPCAM_IS_TIMER_MANAGER(timer_manager), FALSE);
+    IpcamTimerManagerPrivate *priv = ipcam_timer_manager_get_instance_private(timer_manager);
+    IpcamTimerSpec timer_spec;
+    hash_value *value;
+
+    if (!ipcam_timer_spec_parse(spec, &timer_spec) ||
+        (timer_spec.interval <= 0 && NULL == timer_spec.cron))
+    {
+        g_warning("Bad spec '%s' for timer '%s'.\n", spec, timer_id);
+        return FALSE;
+    }
+
+    g_mutex_lock(&priv->mutex);
+    value = ipcam_timer_manager_insert(priv, timer_id, object, callback);
+    if (value)
+    {
+        value->local = TRUE;
+        value->spec = timer_spec;
+        ipcam_deadline_queue_push(priv->deadlines, &value->entry,
+                                  ipcam_timer_spec_first_deadline(&value->spec, g_get_monotonic_time()));
+    }
+    g_mutex_unlock(&priv->mutex);
+
+    if (NULL == value)
+    {
+        g_warning("Timer '%s' already exists.\n", timer_id);
+        ipcam_timer_spec_clear(&timer_spec);
+        return FALSE;
+    }
+    return TRUE;
+}
+/*
+ * Fires the local timers that are due and returns the next deadline, or
+ * IPCAM_DEADLINE_QUEUE_NONE.  A timer behind its schedule fires once
+ * per call, and a timer with no deadline left is deleted after its last
+ * fire.
+ */
+gint64 ipcam_timer_manager_dispatch(IpcamTimerManager *timer_manager, gint64 now)
+{
+    g_return_val_if_fail(IPCAM_IS_TIMER_MANAGER(timer_manager), IPCAM_DEADLINE_QUEUE_NONE);
+    IpcamTimerManagerPrivate *priv = ipcam_timer_manager_get_instance_private(timer_manager);
+    GSList *due = NULL, *item;
+    IpcamDeadlineEntry *entry;
+    gint64 next;
+
+    g_mutex_lock(&priv->mutex);
+    while ((entry = ipcam_deadline_queue_pop_expired(priv->deadlines, now)))
+    {
+        due = g_slist_prepend(due, entry);
+    }
+    /* Rescheduled first and fired by id, so a callback may delete any timer */
+    for (item = due; item; item = item->next)
+    {
+        hash_value *value = (hash_value *)item->data;
+        next = ipcam_timer_spec_next_deadline(&value->spec, value->entry.deadline, now);
+        value->lateness = now - value->entry.deadline;
+        if (next != IPCAM_DEADLINE_QUEUE_NONE)
+            ipcam_deadline_queue_push(priv->deadlines, &value->entry, next);
+        item->data = g_strdup(value->timer_id);
+    }
+    g_mutex_unlock(&priv->mutex);
+
+    due = g_slist_reverse(due);
+    for (item = due; item; item = item->next)
+    {
+        GObject *object;
+        TCFunc callback;
+        hash_value *value;
+
+        if (ipcam_timer_manager_get_callback(priv, item->data, &object, &callback))
+        {
+            callback(object);
+        }
+        /* Looked up again, the callback may have deleted or re-added it */
+        g_mutex_lock(&priv->mutex);
+        value = g_hash_table_lookup(priv->timers_hash, item->data);
+        if (value && value->local && !ipcam_deadline_queue_contains(priv->deadlines, &value->entry))
+        {
+            g_hash_table_remove(priv->timers_hash, item->data);
+        }
+        g_mutex_unlock(&priv->mutex);
+    }
+    g_slist_free_full(due, g_free);
+
+    g_mutex_lock(&priv->mutex);
+    next = ipcam_deadline_queue_next(priv->deadlines);
+    g_mutex_unlock(&priv->mutex);
+    return next;
 }
 void ipcam_timer_manager_del_timer(IpcamTimerManager *timer_manager, const gchar *timer_id)
 {
     g_return_if_fail(IPCAM_IS_TIMER_MANAGER(timer_manager));
     IpcamTimerManagerPrivate *priv = ipcam_timer_manager_get_instance_private(timer_manager);
-    g_hash_table_remove(priv->timers_hash, (gpointer)timer_id);
+    g_mutex_lock(&priv->mutex);
+    hash_value *value = (hash_value *)g_hash_table_lookup(priv->timers_hash, (gpointer)timer_id);
+    if (value)
+    {
+        ipcam_deadline_queue_remove(priv->deadlines, &value->entry);
+        g_hash_table_remove(priv->timers_hash, (gpointer)timer_id);
+    }
+    g_mutex_unlock(&priv->mutex);
+}
+/*
+ * Marks a timer of the timer pump as firing only once, so it is deleted
+ * after it fired, as the pump drops it then too.
+ */
+void ipcam_timer_manager_set_once(IpcamTimerManager *timer_manager, const gchar *timer_id)
+{
+    g_return_if_fail(IPCAM_IS_TIMER_MANAGER(timer_manager));
+    IpcamTimerManagerPrivate *priv = ipcam_timer_manager_get_instance_private(timer_manager);
+    g_mutex_lock(&priv->mutex);
+    hash_value *value = (hash_value *)g_hash_table_lookup(priv->timers_hash, (gpointer)timer_id);
+    if (value && !value->local)
+    {
+        value->once = TRUE;
+    }
+    g_mutex_unlock(&priv->mutex);
 }
 void ipcam_timer_manager_trig_timer(IpcamTimerManager *timer_manager, const gchar *timer_id)
+{
+    ipcam_timer_manager_fire_timer(timer_manager, timer_id, 0);
+}
+/* lateness is how long after its deadline the timer fired, in microseconds */
+void ipcam_timer_manager_fire_timer(IpcamTimerManager *timer_manager,
+                                    const gchar *timer_id,
+                                    gint64 lateness)
 {
     g_return_if_fail(IPCAM_IS_TIMER_MANAGER(timer_manager));
     IpcamTimerManagerPrivate *priv = ipcam_timer_manager_get_instance_private(timer_manager);
+    GObject *object = NULL;
+    TCFunc callback = NULL;
+
+    g_mutex_lock(&priv->mutex);
     hash_value *value = (hash_value *)g_hash_table_lookup(priv->timers_hash, (gpointer)timer_id);
     if (value)
     {
-        value->callback(value->object);
+        value->lateness = lateness;
+        value->fired = TRUE;
+        object = value->object;
+        callback = value->callback;
+    }
+    g_mutex_unlock(&priv->mutex);
+
+    if (callback)
+    {
+        callback(object);
     }
+
+    /* Unless the callback re-added it, which leaves a new, unfired entry */
+    g_mutex_lock(&priv->mutex);
+    value = (hash_value *)g_hash_table_lookup(priv->timers_hash, (gpointer)timer_id);
+    if (value && value->once && value->fired)
+    {
+        g_hash_table_remove(priv->timers_hash, (gpointer)timer_id);
+    }
+    g_mutex_unlock(&priv->mutex);
+}
+/* Of the current or last fire, so a callback can ask how late it runs */
+gint64 ipcam_timer_manager_get_lateness(IpcamTimerManager *timer_manager, const gchar *timer_id)
+{
+    g_return_val_if_fail(IPCAM_IS_TIMER_MANAGER(timer_manager), 0);
+    IpcamTimerManagerPrivate *priv = ipcam_timer_manager_get_instance_private(timer_manager);
+    gint64 lateness;
+
+    g_mutex_lock(&priv->mutex);
+    hash_value *value = (hash_value *)g_hash_table_lookup(priv->timers_hash, (gpointer)timer_id);
+    lateness = value ? value->lateness : 0;
+    g_mutex_unlock(&priv->mutex);
+    return lateness;
 }
@@ -31,7 +31,18 @@ gboolean ipcam_timer_manager_add_timer(IpcamTimerManager *timer_manager,
                                        const gchar *timer_id,
                                        GObject *object,
                                        TCFunc callback);
+gboolean ipcam_timer_manager_add_local_timer(IpcamTimerManager *timer_manager,
+                                             const gchar *timer_id,
+                                             const gchar *spec,
+                                             GObject *object,
+                                             TCFunc callback);
+gint64 ipcam_timer_manager_dispatch(IpcamTimerManager *timer_manager, gint64 now);
 void ipcam_timer_manager_del_timer(IpcamTimerManager *timer_manager, const gchar *timer_id);
+void ipcam_timer_manager_set_once(IpcamTimerManager *timer_manager, const gchar *timer_id);
 void ipcam_timer_manager_trig_timer(IpcamTimerManager *timer_manager, const gchar *timer_id);
+void ipcam_timer_manager_fire_timer(IpcamTimerManager *timer_manager,
+                                    const gchar *timer_id,
+                                    gint64 lateness);
+gint64 ipcam_timer_manager_get_lateness(IpcamTimerManager *timer_manager, const gchar *timer_id);
 
 #endif /* __TIMER_MANAGER_H__ */
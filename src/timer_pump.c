@@ -1,12 +1,18 @@
 #include <czmq.h>
 #include "timer_pump.h"
+#include "deadline_queue.h"
+#include "timer_spec.h"
+
+/* Longest the pump sleeps, so a stop is noticed */
+#define IPCAM_TIMER_PUMP_IDLE_TIMEOUT 1000 /* millisecond */
 
 typedef struct _IpcamTimerPumpHashValue
 {
+    IpcamDeadlineEntry entry;   /* first, so an expired entry is its value */
+    gchar *key;
     gchar *client_id;
     gchar *timer_id;
-    glong interval;
-    guint time_begin;
+    IpcamTimerSpec spec;
     guint count;
 } IpcamTimerPumpHashValue;
 
@@ -15,6 +21,8 @@ typedef IpcamTimerPumpHashValue hash_value;
 typedef struct _IpcamTimerPumpPrivate
 {
     GHashTable *timers_hash;
+    /* Every timer by its next deadline, only due ones are looked at */
+    IpcamDeadlineQueue *deadlines;
     void *server_socket;
 } IpcamTimerPumpPrivate;
 
@@ -22,27 +30,23 @@ G_DEFINE_TYPE_WITH_PRIVATE(IpcamTimerPump, ipcam_timer_pump, IPCAM_BASE_SERVICE_
 
 static void ipcam_timer_pump_on_read_impl(IpcamTimerPump *timer_pump, void *mq_socket);
 static void ipcam_timer_pump_in_loop_impl(IpcamTimerPump *timer_pump);
+static void ipcam_timer_pump_prepare_poll_impl(IpcamBaseService *self, gint *timeout);
 static void ipcam_timer_pump_register(IpcamTimerPump *timer_pump,
                                       const gchar *client_id,
                                       const gchar *timer_id,
-                                      glong interval);
+                                      IpcamTimerSpec *spec);
 static void ipcam_timer_pump_unregister(IpcamTimerPump *timer_pump,
                                         const gchar *client_id,
                                         const gchar *timer_id);
 
 static void ipcam_timer_pump_dispose(GObject *self)
 {
-    static gboolean first_run = TRUE;
-
-    if (first_run)
-    {
-        first_run = FALSE;
-        G_OBJECT_CLASS(ipcam_timer_pump_parent_class)->dispose(self);
-    }
+    G_OBJECT_CLASS(ipcam_timer_pump_parent_class)->dispose(self);
 }
 static void ipcam_timer_pump_finalize(GObject *self)
 {
     IpcamTimerPumpPrivate *priv = ipcam_timer_pump_get_instance_private(IPCAM_TIMER_PUMP(self));
+    ipcam_deadline_queue_free(priv->deadlines);
     g_hash_table_remove_all(priv->timers_hash);
     g_hash_table_destroy(priv->timers_hash);
     G_OBJECT_CLASS(ipcam_timer_pump_parent_class)->finalize(self);
@@ -50,6 +54,7 @@ static void ipcam_timer_pump_finalize(GObject *self)
 static void destroy_value(gpointer data)
 {
     hash_value *value = (hash_value*)data;
+    ipcam_timer_spec_clear(&value->spec);
     g_free(value->client_id);
     g_free(value->timer_id);
     g_free(value);
@@ -61,6 +66,7 @@ static void ipcam_timer_pump_init(IpcamTimerPump *self)
     assert(priv->server_socket);
     priv->timers_hash = g_hash_table_new_full(g_str_hash, g_str_equal, g_free, 
                                               (GDestroyNotify)destroy_value);
+    priv->deadlines = ipcam_deadline_queue_new();
 }
 static void ipcam_timer_pump_class_init(IpcamTimerPumpClass *klass)
 {
@@ -71,13 +77,14 @@ static void ipcam_timer_pump_class_init(IpcamTimerPumpClass *klass)
     IpcamBaseServiceClass *base_service_class = IPCAM_BASE_SERVICE_CLASS(klass);
     base_service_class->on_read = &ipcam_timer_pump_on_read_impl;
     base_service_class->in_loop = &ipcam_timer_pump_in_loop_impl;
+    base_service_class->prepare_poll = &ipcam_timer_pump_prepare_poll_impl;
 }
 static void ipcam_timer_pump_on_read_impl(IpcamTimerPump *timer_pump, void *mq_socket)
 {
     gchar *timer_id = NULL;
     gchar *interval = NULL;
     gchar *client_id = NULL;
-    glong n_interval = 0;
+    IpcamTimerSpec spec;
     IpcamTimerPumpPrivate *priv = ipcam_timer_pump_get_instance_private(timer_pump);
     g_return_if_fail(mq_socket == priv->server_socket);
 
@@ -89,14 +96,17 @@ static void ipcam_timer_pump_on_read_impl(IpcamTimerPump *timer_pump, void *mq_s
     
     if (interval && client_id && timer_id)
     {
-        n_interval = strtol(interval, NULL, 10);
-        if (n_interval < 1)
+        if (!ipcam_timer_spec_parse(interval, &spec))
+        {
+            g_warning("Bad spec '%s' for timer '%s'.\n", interval, timer_id);
+        }
+        else if (spec.interval <= 0 && NULL == spec.cron)
         {
             ipcam_timer_pump_unregister(timer_pump, client_id, timer_id);
         }
         else
         {
-            ipcam_timer_pump_register(timer_pump, client_id, timer_id, n_interval);
+            ipcam_timer_pump_register(timer_pump, client_id, timer_id, &spec);
         }
     }
 
@@ -105,45 +115,118 @@ static void ipcam_timer_pump_on_read_impl(IpcamTimerPump *timer_pump, void *mq_s
     zstr_free(&client_id);
 }
 
-static time_t get_monotonic_time(time_t *tloc)
+/*
+ * One message to the client for the given timers that fired in this pass,
+ * earliest first, so it wakes up once.  A single fire is sent as is, more
+ * are sent as a batch of them, which the client unpacks in one read.
+ */
+static void ipcam_timer_pump_send_fired(IpcamTimerPump *timer_pump, GSList *timers, gint64 now)
 {
-    struct timespec tsNow;
-    time_t t;
+    IpcamTimerPumpPrivate *priv = ipcam_timer_pump_get_instance_private(timer_pump);
+    hash_value *val = (hash_value *)timers->data;
+    zmsg_t *msg = zmsg_new();
+    gchar lateness[24];
+    GSList *item;
 
-    if (clock_gettime(CLOCK_MONOTONIC, &tsNow) == 0) {
-        t = tsNow.tv_sec;
-        if (tloc)
-            *tloc = t;
+    zmsg_addstr(msg, "%s", val->client_id);
+    if (timers->next)
+    {
+        guint n_timers = g_slist_length(timers);
+        guint8 *marker = g_new(guint8, n_timers + 1);
+        guint i = 1;
+        marker[0] = IPCAM_SERVICE_BATCH_MARKER;
+        for (item = timers; item; item = item->next)
+            marker[i++] = ((hash_value *)item->data)->spec.lateness ? 2 : 1;
+        zmsg_addmem(msg, marker, n_timers + 1);
+        g_free(marker);
     }
-    else {
-        t = time(tloc);
+    for (item = timers; item; item = item->next)
+    {
+        val = (hash_value *)item->data;
+        zmsg_addstr(msg, "%s", val->timer_id);
+        if (val->spec.lateness)
+        {
+            g_snprintf(lateness, sizeof(lateness), "%" G_GINT64_FORMAT, now - val->entry.deadline);
+            zmsg_addstr(msg, "%s", lateness);
+        }
     }
-
-    return t;
+    zmsg_send(&msg, priv->server_socket);
 }
-
-static void ipcam_timer_pump_check_timer(gpointer key, gpointer value, gpointer user_data)
+/*
+ * Fires the timers that are due, grouped by client where the timers ask
+ * for it.  Each fire is client id, timer id and, where the timer asks for
+ * it, how late it is in microseconds.  A timer with no deadline left, a "once" timer, is
+ * dropped after it fired.
+ */
+static void ipcam_timer_pump_in_loop_impl(IpcamTimerPump *timer_pump)
 {
-    gint now = get_monotonic_time(NULL);
-    IpcamTimerPumpPrivate *priv = (IpcamTimerPumpPrivate *)user_data;
-    hash_value *val = (hash_value *)value;
-    if (val->time_begin + val->interval <= now)
+    IpcamTimerPumpPrivate *priv = ipcam_timer_pump_get_instance_private(timer_pump);
+    gint64 now = g_get_monotonic_time();
+    GHashTable *client_hash;
+    GSList *fired = NULL, *clients = NULL, *item;
+    IpcamDeadlineEntry *entry;
+
+    while ((entry = ipcam_deadline_queue_pop_expired(priv->deadlines, now)))
     {
-        val->time_begin = now;
+        hash_value *val = (hash_value *)entry;
         val->count++;
-        zstr_sendm(priv->server_socket, val->client_id);
-        zstr_send(priv->server_socket, val->timer_id);
+        fired = g_slist_prepend(fired, val);
     }
+    if (NULL == fired)
+        return;
+
+    /* Per client, in the order their first timers expired */
+    client_hash = g_hash_table_new(g_str_hash, g_str_equal);
+    fired = g_slist_reverse(fired);
+    for (item = fired; item; item = item->next)
+    {
+        hash_value *val = (hash_value *)item->data;
+        GSList *timers;
+        if (!val->spec.batch)
+        {
+            /* A client that might not understand batches */
+            GSList single = { val, NULL };
+            ipcam_timer_pump_send_fired(timer_pump, &single, now);
+            continue;
+        }
+        timers = g_hash_table_lookup(client_hash, val->client_id);
+        if (NULL == timers)
+            clients = g_slist_prepend(clients, val->client_id);
+        g_hash_table_insert(client_hash, val->client_id, g_slist_prepend(timers, val));
+    }
+    clients = g_slist_reverse(clients);
+    for (item = clients; item; item = item->next)
+    {
+        GSList *timers = g_slist_reverse(g_hash_table_lookup(client_hash, item->data));
+        ipcam_timer_pump_send_fired(timer_pump, timers, now);
+        g_slist_free(timers);
+    }
+    g_slist_free(clients);
+    g_hash_table_destroy(client_hash);
+
+    /* Pushed back only now, so a timer behind its schedule fires once per loop */
+    for (item = fired; item; item = item->next)
+    {
+        hash_value *val = (hash_value *)item->data;
+        gint64 next = ipcam_timer_spec_next_deadline(&val->spec, val->entry.deadline, now);
+        if (next != IPCAM_DEADLINE_QUEUE_NONE)
+            ipcam_deadline_queue_push(priv->deadlines, &val->entry, next);
+        else
+            g_hash_table_remove(priv->timers_hash, val->key);
+    }
+    g_slist_free(fired);
 }
-static void ipcam_timer_pump_in_loop_impl(IpcamTimerPump *timer_pump)
+/* Sleeps until the earliest deadline instead of waking on a fixed period */
+static void ipcam_timer_pump_prepare_poll_impl(IpcamBaseService *self, gint *timeout)
 {
-    IpcamTimerPumpPrivate *priv = ipcam_timer_pump_get_instance_private(timer_pump);
-    g_hash_table_foreach(priv->timers_hash, (GHFunc)ipcam_timer_pump_check_timer, (gpointer)priv);
+    IpcamTimerPumpPrivate *priv = ipcam_timer_pump_get_instance_private(IPCAM_TIMER_PUMP(self));
+    *timeout = ipcam_deadline_queue_timeout(priv->deadlines, g_get_monotonic_time(),
+                                            IPCAM_TIMER_PUMP_IDLE_TIMEOUT);
 }
 static void ipcam_timer_pump_register(IpcamTimerPump *timer_pump,
                                       const gchar *client_id,
                                       const gchar *timer_id,
-                                      glong interval)
+                                      IpcamTimerSpec *spec)
 {
     IpcamTimerPumpPrivate *priv = ipcam_timer_pump_get_instance_private(timer_pump);
     gchar *key = g_new(gchar, strlen(client_id) + strlen(timer_id) + 1);
@@ -151,18 +234,21 @@ static void ipcam_timer_pump_register(IpcamTimerPump *timer_pump,
     strcat(key, timer_id);
     if (g_hash_table_contains(priv->timers_hash, key))
     {
+        ipcam_timer_spec_clear(spec);
         g_free(key);
         return;
     }
     
-    hash_value *value = g_new(hash_value, 1);
+    hash_value *value = g_new0(hash_value, 1);
+    value->key = key;
     value->client_id = g_strdup(client_id);
     value->timer_id = g_strdup(timer_id);
-    value->interval = interval;
-    value->time_begin = get_monotonic_time(NULL);
+    value->spec = *spec;        /* the value owns the spec from now on */
     value->count = 0;
     
     g_hash_table_insert(priv->timers_hash, key, value);
+    ipcam_deadline_queue_push(priv->deadlines, &value->entry,
+                              ipcam_timer_spec_first_deadline(&value->spec, g_get_monotonic_time()));
 }
 static void ipcam_timer_pump_unregister(IpcamTimerPump *timer_pump,
                                         const gchar *client_id,
@@ -173,7 +259,12 @@ static void ipcam_timer_pump_unregister(IpcamTimerPump *timer_pump,
     strcpy(key, client_id);
     strcat(key, timer_id);
 
-    g_hash_table_remove(priv->timers_hash, key);
+    hash_value *value = g_hash_table_lookup(priv->timers_hash, key);
+    if (value)
+    {
+        ipcam_deadline_queue_remove(priv->deadlines, &value->entry);
+        g_hash_table_remove(priv->timers_hash, key);
+    }
     
     g_free(key);
 }
@@ -3,6 +3,18 @@
 
 #include "service.h"
 
+/*
+ * Clients register a timer by sending [timer id][spec], the spec being
+ * e.g. "2", "100ms", "250ms catchup", "5 once", "cron 0 3 * * *" or
+ * "60 jitter" (see timer_spec.h), and remove it with "0".  Each fire
+ * comes back as [timer id], followed by [lateness in microseconds] for
+ * timers registered with "lateness" in the spec; a "once" timer is
+ * removed after it fired.  Timers registered with "batch" have the fires
+ * of one client in the same pass sent as one batch (see service.h),
+ * [marker][timer id][lateness]..., which IpcamService dispatches fire by
+ * fire from the one read.  Older clients ask for neither and get one
+ * message per fire with the timer id alone, as they always did.
+ */
 #define IPCAM_TIMER_PUMP_ADDRESS "ipc:///tmp/ipcam_timer_pump.socket"
 
 #define IPCAM_TIMER_PUMP_TYPE (ipcam_timer_pump_get_type())
@@ -0,0 +1,321 @@
+#include <math.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include "timer_spec.h"
+
+/* Without a span of its own, cron jitter spreads over this */
+#define IPCAM_TIMER_CRON_JITTER (60 * G_TIME_SPAN_SECOND)
+/* Enough steps to cross any gap a valid cron line leaves, about 8 years */
+#define IPCAM_TIMER_CRON_MAX_STEPS 4096
+
+enum
+{
+    CRON_MINUTE = 0,
+    CRON_HOUR,
+    CRON_DAY,
+    CRON_MONTH,
+    CRON_WEEKDAY,
+    CRON_FIELDS
+};
+
+static const struct
+{
+    gint min;
+    gint max;
+} cron_ranges[CRON_FIELDS] =
+{
+    {0, 59}, {0, 23}, {1, 31}, {1, 12}, {0, 7}
+};
+
+/* One bit per allowed value of each field */
+struct _IpcamTimerCron
+{
+    guint64 bits[CRON_FIELDS];
+    /* Day and weekday both given: either may match, as cron does */
+    gboolean any_day;
+};
+
+static gboolean parse_number(const gchar *text, gchar **end, gint *value)
+{
+    gint64 number = g_ascii_strtoll(text, end, 10);
+    if (*end == text || number < 0 || number > 99)
+        return FALSE;
+    *value = (gint)number;
+    return TRUE;
+}
+
+/* "*", "5", "1-5", "*\/15", "0-30/10" and comma separated lists of them */
+static gboolean parse_cron_field(const gchar *text, gint field, guint64 *bits)
+{
+    gint min = cron_ranges[field].min, max = cron_ranges[field].max;
+    gchar **items = g_strsplit(text, ",", -1);
+    gboolean ret = TRUE;
+    gint i;
+
+    *bits = 0;
+    for (i = 0; ret && items[i]; i++)
+    {
+        gchar *p = items[i];
+        gint first = min, last = max, step = 1, v;
+
+        if (*p == '*')
+        {
+            p++;
+        }
+        else if (parse_number(p, &p, &first))
+        {
+            last = first;
+            if (*p == '-')
+                ret = parse_number(p + 1, &p, &last);
+        }
+        else
+        {
+            ret = FALSE;
+        }
+        if (ret && *p == '/')
+        {
+            ret = parse_number(p + 1, &p, &step) && step > 0;
+            if (ret && first == last && items[i][0] != '*')
+                last = max;
+        }
+        ret = ret && *p == '\0' && first >= min && last <= max && first <= last;
+        for (v = first; ret && v <= last; v += step)
+            *bits |= (guint64)1 << v;
+    }
+    g_strfreev(items);
+
+    /* Sunday is both 0 and 7 */
+    if (CRON_WEEKDAY == field && (*bits & ((guint64)1 << 7)))
+        *bits |= 1;
+    return ret;
+}
+
+static IpcamTimerCron *parse_cron(gchar **fields)
+{
+    IpcamTimerCron *cron = g_new0(IpcamTimerCron, 1);
+    gint i;
+
+    for (i = 0; i < CRON_FIELDS; i++)
+    {
+        if (NULL == fields[i] || !parse_cron_field(fields[i], i, &cron->bits[i]))
+        {
+            g_free(cron);
+            return NULL;
+        }
+    }
+    cron->any_day = (fields[CRON_DAY][0] != '*' && fields[CRON_WEEKDAY][0] != '*');
+    return cron;
+}
+
+static gboolean cron_has(const IpcamTimerCron *cron, gint field, gint value)
+{
+    return (cron->bits[field] >> value) & 1;
+}
+
+static gboolean cron_day_matches(const IpcamTimerCron *cron, const struct tm *tm)
+{
+    gboolean day = cron_has(cron, CRON_DAY, tm->tm_mday);
+    gboolean weekday = cron_has(cron, CRON_WEEKDAY, tm->tm_wday);
+    return cron->any_day ? (day || weekday) : (day && weekday);
+}
+
+/* The first matching minute after now, in wall clock seconds, -1 if none */
+static time_t cron_next(const IpcamTimerCron *cron, time_t now)
+{
+    time_t t = now - now % 60 + 60;
+    struct tm tm;
+    gint steps;
+
+    localtime_r(&t, &tm);
+    for (steps = 0; steps < IPCAM_TIMER_CRON_MAX_STEPS; steps++)
+    {
+        /* Step the first field that does not match, resetting the ones below */
+        if (!cron_has(cron, CRON_MONTH, tm.tm_mon + 1))
+        {
+            tm.tm_mon++;
+            tm.tm_mday = 1;
+            tm.tm_hour = 0;
+            tm.tm_min = 0;
+        }
+        else if (!cron_day_matches(cron, &tm))
+        {
+            tm.tm_mday++;
+            tm.tm_hour = 0;
+            tm.tm_min = 0;
+        }
+        else if (!cron_has(cron, CRON_HOUR, tm.tm_hour))
+        {
+            tm.tm_hour++;
+            tm.tm_min = 0;
+        }
+        else if (!cron_has(cron, CRON_MINUTE, tm.tm_min))
+        {
+            tm.tm_min++;
+        }
+        else
+        {
+            return mktime(&tm);
+        }
+        tm.tm_isdst = -1;
+        t = mktime(&tm);
+        localtime_r(&t, &tm);
+    }
+    return -1;
+}
+
+/*
+ * Specs come from any local client: anything not finite or beyond
+ * IPCAM_TIMER_MAX_DURATION is rejected, and a positive duration too small
+ * to count in microseconds is one, not 0, which would remove the timer.
+ */
+static gboolean parse_duration(const gchar *text, gint64 *duration)
+{
+    gchar *end = NULL;
+    gdouble value = g_ascii_strtod(text, &end);
+    gdouble scale = G_TIME_SPAN_SECOND;
+
+    if (end == text || !isfinite(value) || value < 0)
+        return FALSE;
+    if (0 == strcmp(end, "ms"))
+        scale = G_TIME_SPAN_MILLISECOND;
+    else if (0 == strcmp(end, "us"))
+        scale = 1;
+    else if (0 != strcmp(end, "s") && *end != '\0')
+        return FALSE;
+
+    value *= scale;
+    if (value > (gdouble)IPCAM_TIMER_MAX_DURATION)
+        return FALSE;
+    *duration = (value > 0 && value < 1) ? 1 : (gint64)value;
+    return TRUE;
+}
+
+gboolean ipcam_timer_spec_parse(const gchar *text, IpcamTimerSpec *spec)
+{
+    gchar **tokens;
+    gchar **words;
+    gint64 jitter = 0;
+    gboolean ret = TRUE;
+    gint n = 0, i;
+
+    g_return_val_if_fail(text && spec, FALSE);
+    memset(spec, 0, sizeof(*spec));
+
+    /* Drop the empty tokens runs of spaces leave */
+    tokens = g_strsplit(text, " ", -1);
+    words = g_new0(gchar *, g_strv_length(tokens) + 1);
+    for (i = 0; tokens[i]; i++)
+    {
+        if (tokens[i][0])
+            words[n++] = tokens[i];
+    }
+
+    i = 0;
+    if (words[0] && 0 == strcmp(words[0], "cron"))
+    {
+        spec->cron = parse_cron(words + 1);
+        ret = (spec->cron != NULL);
+        i = 1 + CRON_FIELDS;
+    }
+    else
+    {
+        ret = words[0] && parse_duration(words[0], &spec->interval);
+        i = 1;
+    }
+
+    for (; ret && i < n; i++)
+    {
+        if (0 == strcmp(words[i], "skip"))
+            spec->policy = IPCAM_TIMER_POLICY_SKIP;
+        else if (0 == strcmp(words[i], "catchup"))
+            spec->policy = IPCAM_TIMER_POLICY_CATCH_UP;
+        else if (0 == strcmp(words[i], "once"))
+            spec->once = TRUE;
+        else if (0 == strcmp(words[i], "batch"))
+            spec->batch = TRUE;
+        else if (0 == strcmp(words[i], "lateness"))
+            spec->lateness = TRUE;
+        else if (0 == strcmp(words[i], "jitter"))
+            jitter = spec->cron ? IPCAM_TIMER_CRON_JITTER : spec->interval;
+        else if (g_str_has_prefix(words[i], "jitter="))
+            ret = parse_duration(words[i] + strlen("jitter="), &jitter);
+        else
+            ret = FALSE;
+    }
+
+    g_free(words);
+    g_strfreev(tokens);
+
+    if (!ret)
+    {
+        ipcam_timer_spec_clear(spec);
+        memset(spec, 0, sizeof(*spec));
+        return FALSE;
+    }
+    if (spec->interval > 0)
+        spec->interval = MAX(spec->interval, IPCAM_TIMER_MIN_INTERVAL);
+    if (jitter > 0)
+        spec->phase = (gint64)(g_random_double() * jitter);
+    return TRUE;
+}
+
+void ipcam_timer_spec_clear(IpcamTimerSpec *spec)
+{
+    g_free(spec->cron);
+    spec->cron = NULL;
+}
+
+time_t ipcam_timer_spec_next_cron(const IpcamTimerSpec *spec, time_t after)
+{
+    g_return_val_if_fail(spec && spec->cron, -1);
+    return cron_next(spec->cron, after);
+}
+/*
+ * Wall clock schedule mapped onto the monotonic clock as of now.  The
+ * phase is taken off first, so a jittered timer that just fired finds
+ * the occurrence after its own.
+ */
+static gint64 cron_deadline(const IpcamTimerSpec *spec, gint64 now)
+{
+    gint64 wall = g_get_real_time() - spec->phase;
+    time_t next = ipcam_timer_spec_next_cron(spec, (time_t)(wall / G_TIME_SPAN_SECOND));
+
+    if (next < 0)
+        return G_MAXINT64;
+    return now + ((gint64)next * G_TIME_SPAN_SECOND - wall);
+}
+
+gint64 ipcam_timer_spec_first_deadline(const IpcamTimerSpec *spec, gint64 now)
+{
+    if (spec->cron)
+        return cron_deadline(spec, now);
+    return now + spec->interval + spec->phase;
+}
+
+/*
+ * Periodic deadlines are absolute, each one period after the last, so
+ * the poll latency never adds up.  When a timer falls behind, "skip"
+ * drops the missed periods and stays on the same grid; "catchup" fires
+ * once per missed period, one per loop, unless it is hopelessly behind.
+ * Cron timers look up the next matching minute after each fire, which
+ * also follows changes of the wall clock.
+ */
+gint64 ipcam_timer_spec_next_deadline(const IpcamTimerSpec *spec, gint64 deadline, gint64 now)
+{
+    gint64 missed;
+
+    if (spec->once)
+        return G_MAXINT64;
+    if (spec->cron)
+        return cron_deadline(spec, now);
+
+    deadline += spec->interval;
+    if (deadline >= now)
+        return deadline;
+    missed = (now - deadline) / spec->interval;
+    if (IPCAM_TIMER_POLICY_CATCH_UP == spec->policy && missed < IPCAM_TIMER_MAX_CATCH_UP)
+        return deadline;
+    /* The first point of the grid not before now */
+    return deadline + (now - deadline + spec->interval - 1) / spec->interval * spec->interval;
+}
@@ -0,0 +1,64 @@
+#ifndef __TIMER_SPEC_H__
+#define __TIMER_SPEC_H__
+
+#include <time.h>
+#include <glib.h>
+
+/*
+ * When a timer fires, as written by its owner: a period or a cron line,
+ * followed by options, all separated by spaces.
+ *
+ *   "2", "100ms", "0.25s", "500us"  every period, seconds by default
+ *   "cron 30 3 * * 1-5"             minute hour day month weekday, local time
+ *   "skip" / "catchup"              what a late periodic timer does
+ *   "once"                          fire one time only
+ *   "jitter" / "jitter=5s"          start at a random offset below the given
+ *                                   span (the period, or a minute for cron)
+ *   "batch"                         the client takes fires of the timer pump
+ *                                   batched, see timer_pump.h
+ *   "lateness"                      the client takes how late each fire of the
+ *                                   timer pump is, see timer_pump.h
+ *
+ * The offset is picked once, so a jittered timer keeps its own phase and
+ * the timers of many processes spread out instead of firing together.
+ * Shared by the timer pump and the local timers of IpcamTimerManager.
+ */
+
+/* What a periodic timer does about periods it missed */
+typedef enum
+{
+    IPCAM_TIMER_POLICY_SKIP = 0,
+    IPCAM_TIMER_POLICY_CATCH_UP
+} IpcamTimerPolicy;
+
+/* Shorter periods would keep the loop spinning */
+#define IPCAM_TIMER_MIN_INTERVAL G_TIME_SPAN_MILLISECOND
+/* Longest period or jitter, about 68 years; deadlines stay far from overflow */
+#define IPCAM_TIMER_MAX_DURATION ((gint64)G_MAXINT32 * G_TIME_SPAN_SECOND)
+/* A catch-up timer further behind than this many periods skips instead */
+#define IPCAM_TIMER_MAX_CATCH_UP 16
+
+typedef struct _IpcamTimerCron IpcamTimerCron;
+
+typedef struct _IpcamTimerSpec
+{
+    gint64 interval;            /* microsecond, 0 for a cron timer */
+    IpcamTimerCron *cron;
+    IpcamTimerPolicy policy;
+    gboolean once;
+    gboolean batch;
+    gboolean lateness;
+    gint64 phase;               /* the random offset, microsecond */
+} IpcamTimerSpec;
+
+/* FALSE on a malformed spec; a period of 0 means remove the timer */
+gboolean ipcam_timer_spec_parse(const gchar *text, IpcamTimerSpec *spec);
+void ipcam_timer_spec_clear(IpcamTimerSpec *spec);
+/* Of a cron spec: the first matching minute after, local time, -1 if none */
+time_t ipcam_timer_spec_next_cron(const IpcamTimerSpec *spec, time_t after);
+/* Deadlines are g_get_monotonic_time() microseconds */
+gint64 ipcam_timer_spec_first_deadline(const IpcamTimerSpec *spec, gint64 now);
+/* The deadline after the one that just fired, or G_MAXINT64 when done */
+gint64 ipcam_timer_spec_next_deadline(const IpcamTimerSpec *spec, gint64 deadline, gint64 now);
+
+#endif /* __TIMER_SPEC_H__ */
@@ -0,0 +1,109 @@
+#include "messages.h"
+#include "json_index.h"
+#include <json-glib/json-glib.h>
+#include <string.h>
+
+#define ROUNDS 200
+
+/* Bodies shaped like the large ones seen in practice */
+static gchar *make_osd_text(void)
+{
+    GString *string = g_string_new("{\"items\":{\"osd\":[");
+    gint i, j;
+    for (i = 0; i < 16; i++)
+    {
+        g_string_append_printf(string, "%s{\"x\":%d,\"y\":%d,\"text\":\"", i ? "," : "", i * 10, i * 20);
+        for (j = 0; j < 40; j++)
+            g_string_append(string, "Camera 01 \\\"lobby\\\" entrance, ");
+        g_string_append(string, "\"}");
+    }
+    g_string_append(string, "]}}");
+    return g_string_free(string, FALSE);
+}
+
+static gchar *make_region_list(void)
+{
+    GString *string = g_string_new("{\"items\":{\"regions\":[");
+    gint i;
+    for (i = 0; i < 400; i++)
+    {
+        g_string_append_printf(string,
+                               "%s{\"name\":\"zone %d\",\"x\":%d,\"y\":%d,\"w\":64,\"h\":48,\"enabled\":true}",
+                               i ? "," : "", i, i % 32, i / 32);
+    }
+    g_string_append(string, "]}}");
+    return g_string_free(string, FALSE);
+}
+
+static gchar *make_schedule_table(void)
+{
+    GString *string = g_string_new("{\"items\":{\"schedule\":[");
+    gint day, slot;
+    for (day = 0; day < 7; day++)
+    {
+        g_string_append(string, day ? ",[" : "[");
+        for (slot = 0; slot < 96; slot++)
+            g_string_append_printf(string, "%s[%d,%d,%d]", slot ? "," : "", slot * 15, slot * 15 + 14, slot % 3);
+        g_string_append_c(string, ']');
+    }
+    g_string_append(string, "]}}");
+    return g_string_free(string, FALSE);
+}
+
+static gchar *make_envelope(const gchar *body)
+{
+    return g_strdup_printf("{\"head\":{\"type\":\"notice\",\"token\":\"bench\",\"version\":\"1.0\","
+                           "\"event\":\"set_osd\"},\"body\":%s}", body);
+}
+
+static gdouble bench_message(const gchar *envelope, gsize length)
+{
+    gint64 start = g_get_monotonic_time();
+    gint i;
+    for (i = 0; i < ROUNDS; i++)
+    {
+        IpcamMessage *msg = ipcam_message_parse_from_data(envelope, length);
+        g_assert(msg);
+        g_object_unref(msg);
+    }
+    return (gdouble)length * ROUNDS / (g_get_monotonic_time() - start);
+}
+
+static gdouble bench_json_glib(const gchar *envelope, gsize length)
+{
+    gint64 start = g_get_monotonic_time();
+    gint i;
+    for (i = 0; i < ROUNDS; i++)
+    {
+        JsonParser *parser = json_parser_new();
+        g_assert(json_parser_load_from_data(parser, envelope, length, NULL));
+        g_object_unref(parser);
+    }
+    return (gdouble)length * ROUNDS / (g_get_monotonic_time() - start);
+}
+
+int main(int argc, char* argv[])
+{
+    static const gchar *impls[] = {"scalar", "sse2", "avx2", "neon"};
+    const gchar *names[] = {"osd text", "region list", "schedule table"};
+    gchar *bodies[] = {make_osd_text(), make_region_list(), make_schedule_table()};
+    guint i, j;
+
+    g_print("detected: %s\n", ipcam_json_index_get_impl());
+    for (i = 0; i < G_N_ELEMENTS(bodies); i++)
+    {
+        gchar *envelope = make_envelope(bodies[i]);
+        gsize length = strlen(envelope);
+
+        g_print("%s, %" G_GSIZE_FORMAT " bytes\n", names[i], length);
+        g_print("  %-10s %8.1f MB/s\n", "json-glib", bench_json_glib(envelope, length));
+        for (j = 0; j < G_N_ELEMENTS(impls); j++)
+        {
+            if (ipcam_json_index_set_impl(impls[j]))
+                g_print("  %-10s %8.1f MB/s\n", impls[j], bench_message(envelope, length));
+        }
+        g_free(envelope);
+        g_free(bodies[i]);
+    }
+    return 0;
+}
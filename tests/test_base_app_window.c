@@ -0,0 +1,109 @@
+#include "base_app.h"
+#include "messages.h"
+#include <assert.h>
+
+#define SOCKET_NAME "window_test"
+
+static IpcamFuture *send_request_timeout(IpcamBaseApp *app, const gchar *client_id, gint64 timeout_ms)
+{
+    IpcamMessage *request = g_object_new(IPCAM_REQUEST_MESSAGE_TYPE, "action", "get_base_info", NULL);
+    IpcamFuture *future = ipcam_base_app_send_message_future(app, request, SOCKET_NAME, client_id, timeout_ms);
+    g_object_unref(request);
+    return future;
+}
+
+static IpcamFuture *send_request(IpcamBaseApp *app, const gchar *client_id)
+{
+    return send_request_timeout(app, client_id, 50);
+}
+
+static gint call_returned;
+
+/* A call with no timeout, it only returns once the app cancels it */
+static gpointer call_forever(gpointer data)
+{
+    IpcamBaseApp *app = data;
+    IpcamMessage *request = g_object_new(IPCAM_REQUEST_MESSAGE_TYPE, "action", "get_base_info", NULL);
+    IpcamMessage *response = NULL;
+    gboolean ret = ipcam_base_app_call(app, request, SOCKET_NAME, "c", 0, &response);
+
+    assert(!ret && NULL == response);
+    g_object_unref(request);
+    g_atomic_int_set(&call_returned, 1);
+    return NULL;
+}
+
+/* Two in flight and one queued fit, the fourth overflows */
+static void fill_window(IpcamBaseApp *app, const gchar *client_id, IpcamFuture *futures[])
+{
+    gint i;
+
+    for (i = 0; i < 4; i++)
+        futures[i] = send_request(app, client_id);
+    for (i = 0; i < 3; i++)
+        assert(!ipcam_future_is_done(futures[i]));
+    assert(ipcam_future_get_state(futures[3]) == IPCAM_FUTURE_CANCELLED);
+}
+
+int main(int argc, char* argv[])
+{
+    IpcamBaseApp *app = g_object_new(IPCAM_BASE_APP_TYPE, NULL);
+    IpcamService *service = IPCAM_SERVICE(app);
+    IpcamBaseServiceClass *klass = IPCAM_BASE_SERVICE_GET_CLASS(app);
+    IpcamFuture *a[4], *b[4], *again, *forever;
+    GThread *caller;
+    gint timeout = 1000;
+    gint i;
+
+    /* Nobody connects, the router drops what is sent; only the window counts */
+    assert(ipcam_service_bind_by_name(service, SOCKET_NAME, "inproc://" SOCKET_NAME));
+    assert(ipcam_service_set_socket_option(service, SOCKET_NAME, IPCAM_SOCKET_OPTION_WINDOW, 2));
+    assert(ipcam_service_set_socket_option(service, SOCKET_NAME, IPCAM_SOCKET_OPTION_WINDOW_QUEUE, 1));
+
+    /* Each client of a server socket has a window of its own */
+    fill_window(app, "a", a);
+    fill_window(app, "b", b);
+    assert(2 == ipcam_service_get_socket_stat(service, SOCKET_NAME, IPCAM_SOCKET_STAT_WINDOW_OVERFLOW));
+
+    /* Timing out frees the slots, the queued request is sent and times out too */
+    g_usleep(60 * 1000);
+    klass->prepare_poll(IPCAM_BASE_SERVICE(app), &timeout);
+    for (i = 0; i < 3; i++)
+    {
+        assert(ipcam_future_get_state(a[i]) == IPCAM_FUTURE_TIMEOUT);
+        assert(ipcam_future_get_state(b[i]) == IPCAM_FUTURE_TIMEOUT);
+    }
+
+    /* And the window takes requests again */
+    again = send_request(app, "a");
+    assert(!ipcam_future_is_done(again));
+    assert(2 == ipcam_service_get_socket_stat(service, SOCKET_NAME, IPCAM_SOCKET_STAT_WINDOW_OVERFLOW));
+
+    /* A timeout of 0 sets no deadline, the same for futures and calls */
+    forever = send_request_timeout(app, "b", 0);
+    caller = g_thread_new("caller", call_forever, app);
+    g_usleep(60 * 1000);
+    timeout = 1000;
+    klass->prepare_poll(IPCAM_BASE_SERVICE(app), &timeout);
+    assert(!ipcam_future_is_done(forever));
+    assert(!g_atomic_int_get(&call_returned));
+    assert(!ipcam_future_wait(forever, 10));
+
+    /* Requests still pending when the app goes are cancelled */
+    g_object_unref(app);
+    assert(ipcam_future_get_state(again) == IPCAM_FUTURE_CANCELLED);
+    assert(ipcam_future_get_state(forever) == IPCAM_FUTURE_CANCELLED);
+    g_thread_join(caller);
+    assert(g_atomic_int_get(&call_returned));
+
+    ipcam_future_unref(forever);
+    ipcam_future_unref(again);
+    for (i = 0; i < 4; i++)
+    {
+        ipcam_future_unref(a[i]);
+        ipcam_future_unref(b[i]);
+    }
+
+    g_print("windows ok\n");
+    return 0;
+}
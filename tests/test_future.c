@@ -0,0 +1,95 @@
+#include "messages.h"
+#include "message_manager.h"
+#include <assert.h>
+#include <poll.h>
+
+static gpointer complete_later(gpointer data)
+{
+    g_usleep(20 * 1000);
+    ipcam_future_complete(data, NULL);
+    return NULL;
+}
+
+static void count_done(IpcamFuture *future, gpointer user_data)
+{
+    (*(gint *)user_data)++;
+}
+
+int main(int argc, char* argv[])
+{
+    IpcamFuture *futures[3];
+    IpcamFuture *all, *any;
+    struct pollfd pfd;
+    GThread *thread;
+    gint calls = 0;
+    gint i;
+
+    /* Completed from another thread, seen through wait and the eventfd */
+    futures[0] = ipcam_future_new();
+    pfd.fd = ipcam_future_get_fd(futures[0]);
+    pfd.events = POLLIN;
+    assert(pfd.fd >= 0 && 0 == poll(&pfd, 1, 0));
+    thread = g_thread_new("complete", complete_later, futures[0]);
+    assert(ipcam_future_wait(futures[0], 1000));
+    assert(1 == poll(&pfd, 1, 0));
+    assert(!ipcam_future_complete(futures[0], NULL));
+    assert(!ipcam_future_fail(futures[0], IPCAM_FUTURE_TIMEOUT));
+    assert(ipcam_future_get_state(futures[0]) == IPCAM_FUTURE_DONE);
+    g_thread_join(thread);
+    ipcam_future_on_done(futures[0], count_done, &calls);
+    assert(calls == 1);
+    ipcam_future_unref(futures[0]);
+
+    for (i = 0; i < 3; i++)
+        futures[i] = ipcam_future_new();
+    all = ipcam_future_all(futures, 3);
+    any = ipcam_future_any(futures, 3);
+    ipcam_future_on_done(all, count_done, &calls);
+    assert(!ipcam_future_wait(all, 10));
+
+    ipcam_future_fail(futures[1], IPCAM_FUTURE_TIMEOUT);
+    assert(ipcam_future_get_state(all) == IPCAM_FUTURE_TIMEOUT && calls == 2);
+    assert(!ipcam_future_is_done(any));
+    ipcam_future_complete(futures[2], NULL);
+    assert(ipcam_future_get_state(any) == IPCAM_FUTURE_DONE);
+    ipcam_future_complete(futures[0], NULL);
+    assert(calls == 2);
+
+    ipcam_future_unref(all);
+    ipcam_future_unref(any);
+    for (i = 0; i < 3; i++)
+        ipcam_future_unref(futures[i]);
+
+    /* A child freed while pending is cancelled, and so is what waits on it */
+    calls = 0;
+    for (i = 0; i < 3; i++)
+        futures[i] = ipcam_future_new();
+    all = ipcam_future_all(futures, 2);
+    any = ipcam_future_any(futures + 1, 2);
+    ipcam_future_on_done(futures[0], count_done, &calls);
+    ipcam_future_on_done(any, count_done, &calls);
+    ipcam_future_unref(futures[0]);
+    assert(calls == 1);
+    assert(ipcam_future_wait(all, 0));
+    assert(ipcam_future_get_state(all) == IPCAM_FUTURE_CANCELLED);
+    ipcam_future_unref(futures[1]);
+    assert(!ipcam_future_is_done(any));
+    ipcam_future_unref(futures[2]);
+    assert(ipcam_future_wait(any, 0));
+    assert(ipcam_future_get_state(any) == IPCAM_FUTURE_CANCELLED && calls == 2);
+    ipcam_future_unref(all);
+    ipcam_future_unref(any);
+
+    /* Requests still pending when the manager goes away are cancelled */
+    IpcamMessageManager *manager = g_object_new(IPCAM_MESSAGE_MANAGER_TYPE, NULL);
+    IpcamMessage *request = g_object_new(IPCAM_REQUEST_MESSAGE_TYPE, NULL);
+    IpcamFuture *future = ipcam_future_new();
+    assert(ipcam_message_manager_register_future(manager, request, future, 60 * 1000));
+    g_object_unref(manager);
+    assert(ipcam_future_get_state(future) == IPCAM_FUTURE_CANCELLED);
+    ipcam_future_unref(future);
+    g_object_unref(request);
+
+    g_print("futures ok\n");
+    return 0;
+}
@@ -0,0 +1,150 @@
+#include "request_message.h"
+#include <assert.h>
+#include <string.h>
+
+/* Fills the other encoding of a body its message shares with others */
+static gpointer encode_shared(gpointer data)
+{
+    IpcamMessage *message = data;
+    gint64 channel;
+
+    assert(ipcam_message_body_lookup_int(message, "items.channel", &channel) && channel == -3);
+    return ipcam_message_serialize_body(message, IPCAM_MESSAGE_ENCODING_MSGPACK);
+}
+
+int main(int argc, char* argv[])
+{
+    IpcamRequestMessage *request_message = g_object_new(IPCAM_REQUEST_MESSAGE_TYPE,
+                                                        "action", "set_base_info",
+                                                        "id", "42",
+                                                        NULL);
+    JsonBuilder *builder = json_builder_new();
+    json_builder_begin_object(builder);
+    json_builder_set_member_name(builder, "items");
+    json_builder_begin_object(builder);
+    json_builder_set_member_name(builder, "device_name");
+    json_builder_add_string_value(builder, "ipcam");
+    json_builder_set_member_name(builder, "channel");
+    json_builder_add_int_value(builder, -3);
+    json_builder_end_object(builder);
+    json_builder_end_object(builder);
+    g_object_set(G_OBJECT(request_message), "body", json_builder_get_root(builder), NULL);
+    g_object_unref(builder);
+
+    GBytes *json = ipcam_message_serialize(IPCAM_MESSAGE(request_message), IPCAM_MESSAGE_ENCODING_JSON);
+    GBytes *msgpack = ipcam_message_serialize(IPCAM_MESSAGE(request_message), IPCAM_MESSAGE_ENCODING_MSGPACK);
+    g_print("json %" G_GSIZE_FORMAT " bytes, msgpack %" G_GSIZE_FORMAT " bytes\n",
+            g_bytes_get_size(json), g_bytes_get_size(msgpack));
+
+    gsize size;
+    const gchar *data = g_bytes_get_data(msgpack, &size);
+    IpcamMessage *msg = ipcam_message_parse_from_data(data, size);
+    assert(msg && ipcam_message_is_request(msg));
+    assert(0 == strcmp(ipcam_request_message_get_action(IPCAM_REQUEST_MESSAGE(msg)), "set_base_info"));
+
+    gchar *device_name = NULL;
+    gint64 channel = 0;
+    assert(ipcam_message_body_lookup_string(msg, "items.device_name", &device_name));
+    assert(0 == strcmp(device_name, "ipcam"));
+    assert(ipcam_message_body_lookup_int(msg, "items.channel", &channel) && channel == -3);
+    assert(!ipcam_message_body_lookup_int(msg, "items.missing", &channel));
+    g_free(device_name);
+
+    /* Converting back gives the same JSON text as the original */
+    gchar *string = (gchar *)ipcam_message_to_string(msg);
+    assert(strlen(string) == g_bytes_get_size(json));
+    assert(0 == memcmp(string, g_bytes_get_data(json, NULL), strlen(string)));
+    g_print("%s\n", string);
+    g_free(string);
+
+    g_object_unref(msg);
+    data = g_bytes_get_data(json, &size);
+    msg = ipcam_message_parse_from_data(data, size);
+    assert(ipcam_message_body_lookup_string(msg, "items.device_name", &device_name));
+    assert(0 == strcmp(device_name, "ipcam"));
+    g_free(device_name);
+    g_object_unref(msg);
+
+    /* Split framing: the body frame is shared, not copied */
+    GBytes *head = ipcam_message_serialize_head(IPCAM_MESSAGE(request_message), IPCAM_MESSAGE_ENCODING_MSGPACK);
+    GBytes *body = ipcam_message_serialize_body(IPCAM_MESSAGE(request_message), IPCAM_MESSAGE_ENCODING_MSGPACK);
+    msg = ipcam_message_parse_from_frames(head, body);
+    assert(msg && ipcam_message_is_request(msg));
+    assert(ipcam_message_get_encoded_body(msg, IPCAM_MESSAGE_ENCODING_MSGPACK) == body);
+    assert(ipcam_message_body_lookup_int(msg, "items.channel", &channel) && channel == -3);
+    g_object_unref(msg);
+    g_bytes_unref(head);
+    g_bytes_unref(body);
+
+    /* A body edited through the getter is copied off the messages sharing it */
+    data = g_bytes_get_data(json, &size);
+    msg = ipcam_message_parse_from_data(data, size);
+    IpcamMessage *copy = g_object_new(IPCAM_REQUEST_MESSAGE_TYPE, NULL);
+    ipcam_message_share_body(copy, msg);
+    JsonObject *items = json_object_get_object_member(json_node_get_object(ipcam_message_get_body(copy)),
+                                                      "items");
+    json_object_set_int_member(items, "channel", 7);
+    assert(ipcam_message_body_lookup_int(msg, "items.channel", &channel) && channel == -3);
+    assert(ipcam_message_body_lookup_int(copy, "items.channel", &channel) && channel == 7);
+    GBytes *edited = ipcam_message_get_body_bytes(copy);
+    assert(g_strstr_len(g_bytes_get_data(edited, NULL), g_bytes_get_size(edited), "7"));
+    g_object_unref(copy);
+    g_object_unref(msg);
+
+    /* Messages sharing one body are encoded on several threads at once */
+    data = g_bytes_get_data(json, &size);
+    msg = ipcam_message_parse_from_data(data, size);
+    IpcamMessage *copies[4];
+    GThread *threads[4];
+    GBytes *packed[4];
+    for (gint i = 0; i < 4; i++)
+    {
+        copies[i] = g_object_new(IPCAM_REQUEST_MESSAGE_TYPE, NULL);
+        ipcam_message_share_body(copies[i], msg);
+        threads[i] = g_thread_new("encode", encode_shared, copies[i]);
+    }
+    for (gint i = 0; i < 4; i++)
+    {
+        packed[i] = g_thread_join(threads[i]);
+        assert(packed[i] && g_bytes_equal(packed[i], packed[0]));
+    }
+    for (gint i = 0; i < 4; i++)
+    {
+        g_bytes_unref(packed[i]);
+        g_object_unref(copies[i]);
+    }
+    g_object_unref(msg);
+
+    /* Broken scalars and unbalanced bodies are dropped by the scan */
+    const gchar *broken[] =
+    {
+        "{\"head\":{\"type\":\"notice\",\"event\":\"e\"},\"body\":xyz}",
+        "{\"head\":{\"type\":\"notice\",\"event\":\"e\"},\"body\":{\"a\":]}",
+        "{\"head\":{\"type\":\"notice\",\"event\":\"e\"},\"body\":[1}",
+        "{\"head\":{\"type\":\"notice\",\"event\":\"e\"},\"body\":tru}",
+        "{\"head\":{\"type\":\"notice\",\"event\":\"e\"},\"body\":01}",
+        "{\"head\":{\"type\":\"notice\",\"event\":\"e\"},\"body\":1.}",
+        "{\"head\":{\"type\":\"notice\",\"event\":\"e\"},\"body\":-}",
+        "{\"head\":{\"type\":\"notice\",\"event\":\"e\",\"x\":nul},\"body\":null}",
+        NULL
+    };
+    for (gint i = 0; broken[i]; i++)
+        assert(NULL == ipcam_message_parse_from_string(broken[i]));
+    msg = ipcam_message_parse_from_string("{\"head\":{\"type\":\"notice\",\"event\":\"e\"},"
+                                          "\"body\":[true,false,null,-0.5e+3,\"]\"]}");
+    assert(msg);
+    g_object_unref(msg);
+
+    /* Other errors inside a body surface as a NULL body, parsed only once */
+    msg = ipcam_message_parse_from_string("{\"head\":{\"type\":\"notice\",\"event\":\"e\"},"
+                                          "\"body\":{\"a\" 1}}");
+    assert(msg && ipcam_message_is_notice(msg));
+    assert(NULL == ipcam_message_get_body(msg));
+    assert(NULL == ipcam_message_get_body(msg));
+    g_object_unref(msg);
+
+    g_bytes_unref(json);
+    g_bytes_unref(msgpack);
+    g_object_unref(request_message);
+    return 0;
+}
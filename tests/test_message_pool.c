@@ -0,0 +1,49 @@
+#include "messages.h"
+#include <assert.h>
+#include <string.h>
+
+int main(int argc, char* argv[])
+{
+    IpcamMessagePool *pool = g_object_new(IPCAM_MESSAGE_POOL_TYPE, NULL);
+    const gchar *text = "{\"head\":{\"type\":\"request\",\"action\":\"set_osd\",\"id\":\"7\","
+        "\"token\":\"app\",\"version\":\"1.0\"},\"body\":{\"enabled\":true}}";
+    guint64 hits, misses;
+    guint idle;
+    gint i;
+
+    IpcamMessage *first = ipcam_message_pool_parse_from_data(pool, text, strlen(text));
+    assert(first && ipcam_message_get_pool(first) == pool);
+    g_object_unref(first);
+    ipcam_message_pool_get_stats(pool, &hits, &misses, &idle);
+    assert(hits == 0 && misses == 1 && idle == 1);
+
+    for (i = 0; i < 1000; i++)
+    {
+        IpcamMessage *msg = ipcam_message_pool_parse_from_data(pool, text, strlen(text));
+        /* The same instance comes back, reset and then filled in again */
+        assert(msg == first);
+        assert(0 == strcmp(ipcam_request_message_get_id(IPCAM_REQUEST_MESSAGE(msg)), "7"));
+        assert(0 == strcmp(ipcam_message_get_token(msg), "app"));
+
+        IpcamMessage *response = ipcam_request_message_get_response_message(IPCAM_REQUEST_MESSAGE(msg), "0");
+        assert(ipcam_message_get_pool(response) == pool);
+        assert(0 == strcmp(ipcam_response_message_get_id(IPCAM_RESPONSE_MESSAGE(response)), "7"));
+        g_object_unref(response);
+        g_object_unref(msg);
+    }
+
+    ipcam_message_pool_get_stats(pool, &hits, &misses, &idle);
+    g_print("hits %" G_GUINT64_FORMAT ", misses %" G_GUINT64_FORMAT ", idle %u\n", hits, misses, idle);
+    assert(misses == 2 && hits == 1999 && idle == 2);
+
+    /* A recycled request looks freshly constructed */
+    IpcamMessage *request = ipcam_message_pool_acquire(pool, IPCAM_MESSAGE_KIND_REQUEST);
+    assert(0 == strcmp(ipcam_request_message_get_action(IPCAM_REQUEST_MESSAGE(request)), ""));
+    assert(0 == strcmp(ipcam_message_get_token(request), ""));
+    assert(NULL == ipcam_message_get_body(request));
+    g_object_unref(request);
+
+    g_object_unref(pool);
+
+    return 0;
+}
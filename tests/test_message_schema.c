@@ -0,0 +1,412 @@
+#include <stdlib.h>
+#include <string.h>
+#include <assert.h>
+#include "base_app.h"
+#include "messages.h"
+#include "message_schema.h"
+#include "msgpack.h"
+#include "json_index.h"
+
+#define SOCKET_NAME "schema_test"
+
+static const gchar *settings_schema =
+    "{\"type\": \"object\","
+    " \"required\": [\"name\", \"channels\"],"
+    " \"additionalProperties\": false,"
+    " \"properties\": {"
+    "   \"name\": {\"type\": \"string\", \"maxLength\": 8},"
+    "   \"level\": {\"type\": \"integer\", \"minimum\": 0, \"maximum\": 10},"
+    "   \"ratio\": {\"type\": \"number\"},"
+    "   \"channels\": {\"type\": \"array\", \"maxItems\": 2, \"items\": {\"type\": \"integer\"}},"
+    "   \"extra\": {}}}";
+
+static void check_json(const IpcamMessageSchema *schema, const gchar *body, gboolean valid)
+{
+    if (valid != ipcam_message_schema_validate_json(schema, body, strlen(body)))
+    {
+        g_print("'%s' should %s\n", body, valid ? "pass" : "fail");
+        abort();
+    }
+}
+
+static void test_compile(void)
+{
+    const gchar *bad[] =
+    {
+        "", "[]", "{", "{\"type\": \"float\"}", "{\"type\": [\"string\", 1]}",
+        "{\"required\": \"name\"}", "{\"maxLength\": -1}", "{\"maxItems\": \"2\"}",
+        "{\"minimum\": 1.5}", "{\"additionalProperties\": 0}", "{\"items\": true}",
+        "{\"properties\": {\"a\": 1}}", "{} extra",
+        NULL
+    };
+    IpcamMessageSchema *schema;
+    gint i;
+
+    for (i = 0; bad[i]; i++)
+    {
+        schema = ipcam_message_schema_new(bad[i]);
+        if (schema)
+        {
+            g_print("'%s' should not compile\n", bad[i]);
+            abort();
+        }
+    }
+
+    /* Unknown keywords are skipped, an empty schema takes anything */
+    schema = ipcam_message_schema_new("{\"title\": {\"a\": [1, 2]}, \"description\": \"x\"}");
+    assert(schema);
+    check_json(schema, "[1, {\"a\": null}]", TRUE);
+    check_json(schema, "null", TRUE);
+    check_json(schema, "[1,", FALSE);
+    /* Values without a sub-schema are skipped, but their brackets must match */
+    check_json(schema, "[}", FALSE);
+    check_json(schema, "{\"a\": [1, {\"b\": 2]}}", FALSE);
+    check_json(schema, "[\"]}\", {\"b\": [\"\\\"{\"]}]", TRUE);
+    ipcam_message_schema_free(schema);
+}
+
+static void test_nesting(void)
+{
+    IpcamMessageSchema *schema = ipcam_message_schema_new("{}");
+    const gchar *impls[] = { "avx2", "sse2", "neon", "scalar", NULL };
+    GString *text = g_string_new(NULL);
+    gint i, depth;
+
+    assert(schema);
+    for (i = 0; impls[i]; i++)
+    {
+        if (!ipcam_json_index_set_impl(impls[i]))
+            continue;
+        /* Many blocks long, at and past the depth limit */
+        for (depth = 1024; depth <= 1025; depth++)
+        {
+            g_string_truncate(text, 0);
+            g_string_append(text, "{\"a\": ");
+            while ((gint)text->len < 6 + depth)
+                g_string_append_c(text, '[');
+            g_string_append(text, "1");
+            while ((gint)text->len < 7 + 2 * depth)
+                g_string_append_c(text, ']');
+            g_string_append_c(text, '}');
+            check_json(schema, text->str, depth <= 1024);
+            /* The innermost array closed as an object */
+            text->str[6 + depth + 1] = '}';
+            check_json(schema, text->str, FALSE);
+        }
+    }
+    g_string_free(text, TRUE);
+    ipcam_message_schema_free(schema);
+}
+
+static void test_json(void)
+{
+    IpcamMessageSchema *schema = ipcam_message_schema_new(settings_schema);
+
+    assert(schema);
+    check_json(schema, "{\"name\": \"cam\", \"channels\": []}", TRUE);
+    check_json(schema, "{\"channels\": [1, 2], \"name\": \"12345678\", \"level\": 10, "
+               "\"ratio\": 0.5, \"extra\": {\"deep\": [true]}}", TRUE);
+    check_json(schema, "{\"name\": \"cam\", \"channels\": [], \"ratio\": 3}", TRUE);
+
+    /* Type */
+    check_json(schema, "[]", FALSE);
+    check_json(schema, "{\"name\": 1, \"channels\": []}", FALSE);
+    check_json(schema, "{\"name\": \"cam\", \"channels\": [1.5]}", FALSE);
+    check_json(schema, "{\"name\": \"cam\", \"channels\": [], \"level\": \"1\"}", FALSE);
+    /* Required */
+    check_json(schema, "{\"name\": \"cam\"}", FALSE);
+    check_json(schema, "{}", FALSE);
+    /* additionalProperties */
+    check_json(schema, "{\"name\": \"cam\", \"channels\": [], \"other\": 1}", FALSE);
+    /* maxLength, maxItems, minimum and maximum */
+    check_json(schema, "{\"name\": \"123456789\", \"channels\": []}", FALSE);
+    check_json(schema, "{\"name\": \"cam\", \"channels\": [1, 2, 3]}", FALSE);
+    check_json(schema, "{\"name\": \"cam\", \"channels\": [], \"level\": -1}", FALSE);
+    check_json(schema, "{\"name\": \"cam\", \"channels\": [], \"level\": 11}", FALSE);
+    /* Broken text */
+    check_json(schema, "{\"name\": \"cam\", \"channels\": []", FALSE);
+    check_json(schema, "{\"name\": \"cam\", \"channels\": []} {}", FALSE);
+
+    ipcam_message_schema_free(schema);
+}
+
+static gboolean validate_msgpack(const IpcamMessageSchema *schema, GByteArray *buffer)
+{
+    gboolean valid = ipcam_message_schema_validate_msgpack(schema, (const gchar *)buffer->data, buffer->len);
+    g_byte_array_set_size(buffer, 0);
+    return valid;
+}
+
+static void test_msgpack(void)
+{
+    IpcamMessageSchema *schema = ipcam_message_schema_new(settings_schema);
+    GByteArray *buffer = g_byte_array_new();
+
+    assert(schema);
+    ipcam_msgpack_write_map_header(buffer, 3);
+    ipcam_msgpack_write_str(buffer, "name", -1);
+    ipcam_msgpack_write_str(buffer, "cam", -1);
+    ipcam_msgpack_write_str(buffer, "level", -1);
+    ipcam_msgpack_write_int(buffer, 4);
+    ipcam_msgpack_write_str(buffer, "channels", -1);
+    ipcam_msgpack_write_array_header(buffer, 2);
+    ipcam_msgpack_write_int(buffer, 1);
+    ipcam_msgpack_write_int(buffer, 2);
+    assert(validate_msgpack(schema, buffer));
+
+    /* Missing "channels" */
+    ipcam_msgpack_write_map_header(buffer, 1);
+    ipcam_msgpack_write_str(buffer, "name", -1);
+    ipcam_msgpack_write_str(buffer, "cam", -1);
+    assert(!validate_msgpack(schema, buffer));
+
+    /* An array over maxItems is refused from its header alone */
+    ipcam_msgpack_write_map_header(buffer, 2);
+    ipcam_msgpack_write_str(buffer, "name", -1);
+    ipcam_msgpack_write_str(buffer, "cam", -1);
+    ipcam_msgpack_write_str(buffer, "channels", -1);
+    ipcam_msgpack_write_array_header(buffer, 1000);
+    assert(!validate_msgpack(schema, buffer));
+
+    /* A wrong item type */
+    ipcam_msgpack_write_map_header(buffer, 2);
+    ipcam_msgpack_write_str(buffer, "name", -1);
+    ipcam_msgpack_write_str(buffer, "cam", -1);
+    ipcam_msgpack_write_str(buffer, "channels", -1);
+    ipcam_msgpack_write_array_header(buffer, 1);
+    ipcam_msgpack_write_double(buffer, 1.5);
+    assert(!validate_msgpack(schema, buffer));
+
+    /* Out of range, too long, and not allowed at all */
+    ipcam_msgpack_write_map_header(buffer, 3);
+    ipcam_msgpack_write_str(buffer, "name", -1);
+    ipcam_msgpack_write_str(buffer, "cam", -1);
+    ipcam_msgpack_write_str(buffer, "channels", -1);
+    ipcam_msgpack_write_array_header(buffer, 0);
+    ipcam_msgpack_write_str(buffer, "level", -1);
+    ipcam_msgpack_write_int(buffer, 11);
+    assert(!validate_msgpack(schema, buffer));
+    ipcam_msgpack_write_map_header(buffer, 2);
+    ipcam_msgpack_write_str(buffer, "name", -1);
+    ipcam_msgpack_write_str(buffer, "123456789", -1);
+    ipcam_msgpack_write_str(buffer, "channels", -1);
+    ipcam_msgpack_write_array_header(buffer, 0);
+    assert(!validate_msgpack(schema, buffer));
+    ipcam_msgpack_write_map_header(buffer, 3);
+    ipcam_msgpack_write_str(buffer, "name", -1);
+    ipcam_msgpack_write_str(buffer, "cam", -1);
+    ipcam_msgpack_write_str(buffer, "channels", -1);
+    ipcam_msgpack_write_array_header(buffer, 0);
+    ipcam_msgpack_write_str(buffer, "other", -1);
+    ipcam_msgpack_write_nil(buffer);
+    assert(!validate_msgpack(schema, buffer));
+
+    /* Truncated */
+    ipcam_msgpack_write_map_header(buffer, 2);
+    ipcam_msgpack_write_str(buffer, "name", -1);
+    assert(!validate_msgpack(schema, buffer));
+
+    g_byte_array_unref(buffer);
+    ipcam_message_schema_free(schema);
+}
+
+static IpcamMessage *parse(const gchar *text)
+{
+    return ipcam_message_parse_from_data(text, strlen(text));
+}
+
+static void test_message_body(void)
+{
+    IpcamMessageSchema *schema = ipcam_message_schema_new(settings_schema);
+    IpcamMessage *msg;
+    GBytes *msgpack;
+    gsize size;
+    const gchar *data;
+
+    assert(schema);
+    msg = parse("{\"head\":{\"type\":\"request\",\"action\":\"set\",\"id\":\"1\"},"
+                "\"body\":{\"name\":\"cam\",\"channels\":[3]}}");
+    assert(msg && ipcam_message_validate_body(msg, schema));
+
+    /* The same body as MessagePack */
+    msgpack = ipcam_message_serialize(msg, IPCAM_MESSAGE_ENCODING_MSGPACK);
+    g_object_unref(msg);
+    data = g_bytes_get_data(msgpack, &size);
+    msg = ipcam_message_parse_from_data(data, size);
+    assert(msg && ipcam_message_validate_body(msg, schema));
+    g_object_unref(msg);
+    g_bytes_unref(msgpack);
+
+    msg = parse("{\"head\":{\"type\":\"request\",\"action\":\"set\",\"id\":\"1\"},"
+                "\"body\":{\"name\":\"cam\",\"channels\":[3],\"other\":1}}");
+    assert(msg && !ipcam_message_validate_body(msg, schema));
+    g_object_unref(msg);
+
+    /* No body at all is a null one */
+    msg = parse("{\"head\":{\"type\":\"request\",\"action\":\"set\",\"id\":\"1\"}}");
+    assert(msg && !ipcam_message_validate_body(msg, schema));
+    g_object_unref(msg);
+
+    ipcam_message_schema_free(schema);
+}
+
+static void test_head(void)
+{
+    gchar *long_field = g_strnfill(129, 'a');
+    gchar *text;
+    IpcamMessage *msg;
+    const gchar *bad[] =
+    {
+        "{\"head\":{\"type\":\"request\",\"id\":\"1\"}}",
+        "{\"head\":{\"type\":\"request\",\"action\":\"set\"}}",
+        "{\"head\":{\"type\":\"response\",\"action\":\"set\"}}",
+        "{\"head\":{\"type\":\"notice\"}}",
+        "{\"head\":{\"type\":\"other\",\"event\":\"e\"}}",
+        "{\"head\":{\"event\":\"e\"}}",
+        "{\"head\":{\"type\":\"notice\",\"event\":\"e\",\"compression\":\"gzip\"},\"body\":\"\"}",
+        "{\"body\":{}}",
+        "{\"head\":{\"type\":\"notice\",\"event\":\"e\"}",
+        NULL
+    };
+    gint i;
+
+    for (i = 0; bad[i]; i++)
+    {
+        msg = parse(bad[i]);
+        if (msg)
+        {
+            g_print("'%s' should not parse\n", bad[i]);
+            abort();
+        }
+    }
+
+    /* Head fields are capped at 128 bytes */
+    text = g_strdup_printf("{\"head\":{\"type\":\"notice\",\"event\":\"%s\"}}", long_field);
+    assert(NULL == parse(text));
+    g_free(text);
+    text = g_strdup_printf("{\"head\":{\"type\":\"notice\",\"event\":\"e\",\"token\":\"%s\"}}", long_field);
+    assert(NULL == parse(text));
+    g_free(text);
+    long_field[128] = '\0';
+    text = g_strdup_printf("{\"head\":{\"type\":\"notice\",\"event\":\"%s\"}}", long_field);
+    msg = parse(text);
+    assert(msg && ipcam_message_is_notice(msg));
+    g_object_unref(msg);
+    g_free(text);
+    g_free(long_field);
+
+    /* A response without a code is taken as the empty code */
+    msg = parse("{\"head\":{\"type\":\"response\",\"action\":\"set\",\"id\":\"1\"}}");
+    assert(msg && ipcam_message_is_response(msg));
+    assert(0 == strcmp(ipcam_response_message_get_code(IPCAM_RESPONSE_MESSAGE(msg)), ""));
+    g_object_unref(msg);
+}
+
+static void test_response_code(void)
+{
+    IpcamMessage *request = g_object_new(IPCAM_REQUEST_MESSAGE_TYPE, "action", "set", "id", "7", NULL);
+    IpcamMessage *response = ipcam_request_message_get_response_message(IPCAM_REQUEST_MESSAGE(request), NULL);
+    GBytes *bytes;
+    IpcamMessage *msg;
+    gsize size;
+    const gchar *data;
+
+    /* NULL stays accepted and goes out as the empty code */
+    assert(0 == strcmp(ipcam_response_message_get_code(IPCAM_RESPONSE_MESSAGE(response)), ""));
+    bytes = ipcam_message_serialize(response, IPCAM_MESSAGE_ENCODING_MSGPACK);
+    data = g_bytes_get_data(bytes, &size);
+    msg = ipcam_message_parse_from_data(data, size);
+    assert(msg && ipcam_message_is_response(msg));
+    assert(0 == strcmp(ipcam_response_message_get_id(IPCAM_RESPONSE_MESSAGE(msg)), "7"));
+    assert(0 == strcmp(ipcam_response_message_get_code(IPCAM_RESPONSE_MESSAGE(msg)), ""));
+
+    g_object_unref(msg);
+    g_bytes_unref(bytes);
+    g_object_unref(response);
+    g_object_unref(request);
+}
+
+static void server_receive(IpcamBaseApp *app, const gchar *client_id, const gchar *text)
+{
+    IpcamServiceClass *klass = IPCAM_SERVICE_GET_CLASS(app);
+    GBytes *id = g_bytes_new(client_id, strlen(client_id));
+    GBytes *frames[2] = { g_bytes_new(text, strlen(text)), NULL };
+
+    klass->server_receive_bytes(IPCAM_SERVICE(app), SOCKET_NAME, id, frames);
+    g_bytes_unref(frames[0]);
+    g_bytes_unref(id);
+}
+
+static void test_reject_count(void)
+{
+    IpcamBaseApp *app = g_object_new(IPCAM_BASE_APP_TYPE, NULL);
+    IpcamService *service = IPCAM_SERVICE(app);
+    IpcamServiceClass *klass = IPCAM_SERVICE_GET_CLASS(app);
+    GBytes *frames[2] = { g_bytes_new_static("garbage", 7), NULL };
+    gchar *big, *peer;
+    gint i;
+
+    assert(ipcam_service_bind_by_name(service, SOCKET_NAME, "inproc://" SOCKET_NAME));
+    assert(!ipcam_base_app_register_notice_schema(app, "settings", "{\"type\": \"float\"}"));
+    assert(ipcam_base_app_register_notice_schema(app, "settings", settings_schema));
+
+    /* A good notice is not counted */
+    server_receive(app, "peer",
+                   "{\"head\":{\"type\":\"notice\",\"event\":\"settings\",\"token\":\"peer\"},"
+                   "\"body\":{\"name\":\"cam\",\"channels\":[]}}");
+    assert(0 == ipcam_base_app_get_reject_count(app, "peer"));
+
+    /* Malformed, a wrong token and an invalid body all count against the client */
+    server_receive(app, "peer", "garbage");
+    assert(1 == ipcam_base_app_get_reject_count(app, "peer"));
+    server_receive(app, "peer",
+                   "{\"head\":{\"type\":\"notice\",\"event\":\"settings\",\"token\":\"other\"},"
+                   "\"body\":{\"name\":\"cam\",\"channels\":[]}}");
+    assert(2 == ipcam_base_app_get_reject_count(app, "peer"));
+    server_receive(app, "peer",
+                   "{\"head\":{\"type\":\"notice\",\"event\":\"settings\",\"token\":\"peer\"},"
+                   "\"body\":{\"name\":\"cam\"}}");
+    assert(3 == ipcam_base_app_get_reject_count(app, "peer"));
+    assert(0 == ipcam_base_app_get_reject_count(app, "other"));
+
+    /* Oversized input is dropped before it is parsed */
+    assert(ipcam_service_set_socket_option(service, SOCKET_NAME, IPCAM_SOCKET_OPTION_MAX_SIZE, 64));
+    big = g_strnfill(65, ' ');
+    server_receive(app, "peer", big);
+    assert(4 == ipcam_base_app_get_reject_count(app, "peer"));
+    g_free(big);
+
+    /* On a client socket the socket name is the peer */
+    klass->client_receive_bytes(service, "upstream", frames);
+    assert(1 == ipcam_base_app_get_reject_count(app, "upstream"));
+
+    /* Peers past the limit are counted together */
+    for (i = 0; i < 300; i++)
+    {
+        peer = g_strdup_printf("flood%d", i);
+        server_receive(app, peer, "garbage");
+        g_free(peer);
+    }
+    assert(1 == ipcam_base_app_get_reject_count(app, "flood0"));
+    assert(0 == ipcam_base_app_get_reject_count(app, "flood299"));
+    assert(300 - (256 - 2) == ipcam_base_app_get_reject_count(app, "*"));
+    assert(4 == ipcam_base_app_get_reject_count(app, "peer"));
+
+    g_bytes_unref(frames[0]);
+    g_object_unref(app);
+}
+
+int main(int argc, char* argv[])
+{
+    test_compile();
+    test_nesting();
+    test_json();
+    test_msgpack();
+    test_message_body();
+    test_head();
+    test_response_code();
+    test_reject_count();
+
+    g_print("schemas ok\n");
+    return 0;
+}
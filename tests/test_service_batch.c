@@ -0,0 +1,212 @@
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <assert.h>
+#include "service.h"
+
+#define IPCAM_BATCH_SERVICE_TYPE (ipcam_batch_service_get_type())
+#define IPCAM_BATCH_SERVICE(obj) (G_TYPE_CHECK_INSTANCE_CAST((obj), IPCAM_BATCH_SERVICE_TYPE, IpcamBatchService))
+
+typedef struct _IpcamBatchService
+{
+    IpcamService parent;
+    GPtrArray *server_received;
+    GPtrArray *client_received;
+} IpcamBatchService;
+
+typedef struct _IpcamBatchServiceClass
+{
+    IpcamServiceClass parent_class;
+} IpcamBatchServiceClass;
+
+GType ipcam_batch_service_get_type(void);
+
+G_DEFINE_TYPE(IpcamBatchService, ipcam_batch_service, IPCAM_SERVICE_TYPE);
+
+/* The frames of one message, joined by '|' */
+static gchar *join_frames(GBytes *data[])
+{
+    GString *string = g_string_new(NULL);
+    gint i;
+
+    for (i = 0; data[i]; i++)
+    {
+        gsize size;
+        const gchar *bytes = g_bytes_get_data(data[i], &size);
+        if (i > 0)
+            g_string_append_c(string, '|');
+        g_string_append_len(string, bytes, size);
+    }
+    return g_string_free(string, FALSE);
+}
+
+static GBytes **make_frames(const gchar *strings[])
+{
+    GBytes **frames;
+    gint i, n;
+
+    for (n = 0; strings[n]; n++)
+        ;
+    frames = g_new0(GBytes *, n + 1);
+    for (i = 0; i < n; i++)
+        frames[i] = g_bytes_new(strings[i], strlen(strings[i]));
+    return frames;
+}
+
+static void free_frames(GBytes **frames)
+{
+    gint i;
+    for (i = 0; frames[i]; i++)
+        g_bytes_unref(frames[i]);
+    g_free(frames);
+}
+
+static void queue(IpcamService *service, const gchar *name, const gchar *client_id, const gchar *strings[])
+{
+    GBytes **frames = make_frames(strings);
+    assert(ipcam_service_queue_bytes(service, name, frames, client_id));
+    free_frames(frames);
+}
+
+/* A batch written by hand, with whatever counts the test gives it */
+static void send_raw_batch(IpcamService *service, const guint8 *counts, gsize length, const gchar *strings[])
+{
+    GBytes **frames = make_frames(strings);
+    GBytes **batch;
+    guint8 marker[8];
+    gint i, n;
+
+    for (n = 0; frames[n]; n++)
+        ;
+    batch = g_new0(GBytes *, n + 2);
+    marker[0] = IPCAM_SERVICE_BATCH_MARKER;
+    memcpy(marker + 1, counts, length);
+    batch[0] = g_bytes_new(marker, length + 1);
+    for (i = 0; i < n; i++)
+        batch[i + 1] = g_bytes_ref(frames[i]);
+    assert(ipcam_service_send_bytes(service, "client", batch, NULL));
+    free_frames(batch);
+    free_frames(frames);
+}
+
+static void check_received(GPtrArray *received, const gchar *expected[])
+{
+    guint i;
+
+    for (i = 0; expected[i]; i++)
+    {
+        assert(i < received->len);
+        if (0 != strcmp(g_ptr_array_index(received, i), expected[i]))
+        {
+            g_print("message %u: expected '%s', got '%s'\n",
+                    i, expected[i], (gchar *)g_ptr_array_index(received, i));
+            abort();
+        }
+    }
+    assert(i == received->len);
+}
+
+static void ipcam_batch_service_server_receive_bytes(IpcamService *service,
+                                                     const gchar *name,
+                                                     GBytes *client_id,
+                                                     GBytes *data[])
+{
+    IpcamBatchService *self = IPCAM_BATCH_SERVICE(service);
+    gchar *message = join_frames(data);
+    gboolean end = (0 == strcmp(message, "end"));
+
+    assert(0 == strcmp(name, "server"));
+    assert(g_bytes_get_size(client_id) == 4 &&
+           0 == memcmp(g_bytes_get_data(client_id, NULL), "peer", 4));
+    g_ptr_array_add(self->server_received, message);
+    if (!end)
+        return;
+
+    /*
+     * Only the good batch and the closing plain message got through, the
+     * malformed batches were dropped whole
+     */
+    check_received(self->server_received, (const gchar *[]){"a", "b1|b2", "c", "end", NULL});
+
+    /* Back to the client, the batch is not full and goes out on the flush */
+    queue(service, "server", "peer", (const gchar *[]){"x", NULL});
+    queue(service, "server", "peer", (const gchar *[]){"y1", "y2", NULL});
+    ipcam_service_flush(service);
+}
+
+static void ipcam_batch_service_client_receive_bytes(IpcamService *service,
+                                                     const gchar *name,
+                                                     GBytes *data[])
+{
+    IpcamBatchService *self = IPCAM_BATCH_SERVICE(service);
+
+    assert(0 == strcmp(name, "client"));
+    g_ptr_array_add(self->client_received, join_frames(data));
+}
+
+static void ipcam_batch_service_before(IpcamBaseService *base_service)
+{
+}
+
+static void ipcam_batch_service_in_loop(IpcamBaseService *base_service)
+{
+    IpcamBatchService *self = IPCAM_BATCH_SERVICE(base_service);
+
+    if (self->client_received->len < 2)
+        return;
+    check_received(self->client_received, (const gchar *[]){"x", "y1|y2", NULL});
+    g_print("batches ok\n");
+    exit(0);
+}
+
+static void ipcam_batch_service_init(IpcamBatchService *self)
+{
+    self->server_received = g_ptr_array_new_with_free_func(g_free);
+    self->client_received = g_ptr_array_new_with_free_func(g_free);
+}
+
+static void ipcam_batch_service_class_init(IpcamBatchServiceClass *klass)
+{
+    IpcamBaseServiceClass *base_service_class = IPCAM_BASE_SERVICE_CLASS(klass);
+    IpcamServiceClass *service_class = IPCAM_SERVICE_CLASS(klass);
+
+    base_service_class->before = ipcam_batch_service_before;
+    base_service_class->in_loop = ipcam_batch_service_in_loop;
+    service_class->server_receive_bytes = ipcam_batch_service_server_receive_bytes;
+    service_class->client_receive_bytes = ipcam_batch_service_client_receive_bytes;
+}
+
+int main(int argc, char* argv[])
+{
+    IpcamService *service = g_object_new(IPCAM_BATCH_SERVICE_TYPE, "name", "batch-test", NULL);
+    const guint8 too_many[] = {1, 3};
+    const guint8 zero[] = {1, 0};
+    const guint8 too_few[] = {1};
+    GBytes *end[2] = { NULL, NULL };
+
+    /* Anything lost hangs the loop, fail instead */
+    alarm(5);
+
+    assert(ipcam_service_bind_by_name(service, "server", "inproc://batch_test"));
+    assert(ipcam_service_connect_by_name(service, "client", "inproc://batch_test", "peer"));
+    assert(ipcam_service_set_socket_option(service, "client", IPCAM_SOCKET_OPTION_BATCH_COUNT, 3));
+    assert(ipcam_service_set_socket_option(service, "server", IPCAM_SOCKET_OPTION_BATCH_COUNT, 10));
+    assert(ipcam_service_set_socket_option(service, "server", IPCAM_SOCKET_OPTION_BATCH_DELAY, 60000));
+
+    /* The third message fills the batch and sends it */
+    queue(service, "client", NULL, (const gchar *[]){"a", NULL});
+    queue(service, "client", NULL, (const gchar *[]){"b1", "b2", NULL});
+    queue(service, "client", NULL, (const gchar *[]){"c", NULL});
+
+    /* Counts past the frames, an empty message, and frames left over */
+    send_raw_batch(service, too_many, sizeof(too_many), (const gchar *[]){"m1", "m2", NULL});
+    send_raw_batch(service, zero, sizeof(zero), (const gchar *[]){"m1", NULL});
+    send_raw_batch(service, too_few, sizeof(too_few), (const gchar *[]){"m1", "m2", NULL});
+
+    end[0] = g_bytes_new_static("end", 3);
+    assert(ipcam_service_send_bytes(service, "client", end, NULL));
+    g_bytes_unref(end[0]);
+
+    ipcam_base_service_start(IPCAM_BASE_SERVICE(service));
+    return 1;
+}
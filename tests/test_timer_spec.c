@@ -0,0 +1,182 @@
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <assert.h>
+#include "timer_spec.h"
+
+#define MS G_TIME_SPAN_MILLISECOND
+
+/* "2026-01-01 00:00" as local time */
+static time_t at(const gchar *text)
+{
+    struct tm tm;
+
+    memset(&tm, 0, sizeof(tm));
+    assert(5 == sscanf(text, "%d-%d-%d %d:%d", &tm.tm_year, &tm.tm_mon, &tm.tm_mday,
+                       &tm.tm_hour, &tm.tm_min));
+    tm.tm_year -= 1900;
+    tm.tm_mon -= 1;
+    tm.tm_isdst = -1;
+    return mktime(&tm);
+}
+
+/* Each of the expected times in turn, the first one after start */
+static void check_cron(const gchar *text, const gchar *start, const gchar *expected[])
+{
+    IpcamTimerSpec spec;
+    time_t t = at(start);
+    gint i;
+
+    assert(ipcam_timer_spec_parse(text, &spec));
+    assert(spec.cron && 0 == spec.interval);
+    for (i = 0; expected[i]; i++)
+    {
+        t = ipcam_timer_spec_next_cron(&spec, t);
+        if (t != at(expected[i]))
+        {
+            g_print("'%s' after %s: expected %s, got %ld\n", text, start, expected[i], (long)t);
+            abort();
+        }
+    }
+    ipcam_timer_spec_clear(&spec);
+}
+
+static void test_cron(void)
+{
+    IpcamTimerSpec spec;
+
+    setenv("TZ", "UTC0", 1);
+    tzset();
+
+    /* Ranges and steps */
+    check_cron("cron */15 * * * *", "2026-01-01 00:00",
+               (const gchar *[]){"2026-01-01 00:15", "2026-01-01 00:30", "2026-01-01 00:45",
+                                 "2026-01-01 01:00", NULL});
+    check_cron("cron 0-30/10 * * * *", "2026-01-01 00:00",
+               (const gchar *[]){"2026-01-01 00:10", "2026-01-01 00:20", "2026-01-01 00:30",
+                                 "2026-01-01 01:00", NULL});
+    check_cron("cron 5/10 * * * *", "2026-01-01 00:50",
+               (const gchar *[]){"2026-01-01 00:55", "2026-01-01 01:05", "2026-01-01 01:15", NULL});
+    check_cron("cron 0 9,17 * * *", "2026-01-01 12:00",
+               (const gchar *[]){"2026-01-01 17:00", "2026-01-02 09:00", NULL});
+    /* Seconds into a minute still find the next minute */
+    check_cron("cron * * * * *", "2026-01-01 00:00",
+               (const gchar *[]){"2026-01-01 00:01", NULL});
+
+    /* Day of month or day of week once both are given, 2026-01-01 is a Thursday */
+    check_cron("cron 0 12 13 * 5", "2026-01-01 00:00",
+               (const gchar *[]){"2026-01-02 12:00", "2026-01-09 12:00", "2026-01-13 12:00",
+                                 "2026-01-16 12:00", NULL});
+    /* Only the weekday restricts when the day is "*" */
+    check_cron("cron 0 0 * * 1-5", "2026-01-02 00:00",
+               (const gchar *[]){"2026-01-05 00:00", "2026-01-06 00:00", NULL});
+
+    /* Sunday is both 7 and 0 */
+    check_cron("cron 0 0 * * 7", "2026-01-01 00:00",
+               (const gchar *[]){"2026-01-04 00:00", "2026-01-11 00:00", NULL});
+    check_cron("cron 0 0 * * 0", "2026-01-01 00:00",
+               (const gchar *[]){"2026-01-04 00:00", NULL});
+    check_cron("cron 0 0 * * 6-7", "2026-01-01 00:00",
+               (const gchar *[]){"2026-01-03 00:00", "2026-01-04 00:00", "2026-01-10 00:00", NULL});
+
+    /* Feb 29 only comes in leap years, Feb 31 never does */
+    check_cron("cron 0 0 29 2 *", "2026-01-01 00:00",
+               (const gchar *[]){"2028-02-29 00:00", NULL});
+    assert(ipcam_timer_spec_parse("cron 0 0 31 2 *", &spec));
+    assert(-1 == ipcam_timer_spec_next_cron(&spec, at("2026-01-01 00:00")));
+    assert(G_MAXINT64 == ipcam_timer_spec_first_deadline(&spec, 0));
+    ipcam_timer_spec_clear(&spec);
+
+    /* Central European time: 02:30 does not exist on 2026-03-29 */
+    setenv("TZ", "CET-1CEST,M3.5.0,M10.5.0/3", 1);
+    tzset();
+    check_cron("cron 30 2 * * *", "2026-03-28 03:00",
+               (const gchar *[]){"2026-03-30 02:30", NULL});
+    check_cron("cron 0 12 * * *", "2026-03-28 13:00",
+               (const gchar *[]){"2026-03-29 12:00", "2026-03-30 12:00", NULL});
+}
+
+static void test_parse(void)
+{
+    const gchar *bad[] =
+    {
+        "", "abc", "2 foo", "-1", "1e300", "inf", "nan", "2147483648", "1 jitter=inf",
+        "5 minutes", "cron", "cron * * * *", "cron * * * * * extra", "cron 60 * * * *",
+        "cron * 24 * * *", "cron * * 0 * *", "cron * * * 13 *", "cron * * * * 8",
+        "cron 5-1 * * * *", "cron */0 * * * *", "cron a * * * *", "cron 1,,2 * * * *",
+        NULL
+    };
+    IpcamTimerSpec spec;
+    gint i;
+
+    for (i = 0; bad[i]; i++)
+    {
+        if (ipcam_timer_spec_parse(bad[i], &spec))
+        {
+            g_print("'%s' should not parse\n", bad[i]);
+            abort();
+        }
+        assert(NULL == spec.cron && 0 == spec.interval);
+    }
+
+    assert(ipcam_timer_spec_parse("2", &spec) && spec.interval == 2 * G_TIME_SPAN_SECOND);
+    assert(spec.policy == IPCAM_TIMER_POLICY_SKIP && !spec.once && 0 == spec.phase);
+    assert(ipcam_timer_spec_parse("100ms", &spec) && spec.interval == 100 * MS);
+    assert(ipcam_timer_spec_parse("0.25s  catchup", &spec) && spec.interval == 250 * MS);
+    assert(spec.policy == IPCAM_TIMER_POLICY_CATCH_UP);
+    assert(ipcam_timer_spec_parse("500us", &spec) && spec.interval == IPCAM_TIMER_MIN_INTERVAL);
+    assert(ipcam_timer_spec_parse("0.0000001", &spec) && spec.interval == IPCAM_TIMER_MIN_INTERVAL);
+    assert(ipcam_timer_spec_parse("0", &spec) && 0 == spec.interval && NULL == spec.cron);
+    assert(ipcam_timer_spec_parse("5 once", &spec) && spec.once && !spec.batch);
+    assert(ipcam_timer_spec_parse("5 once batch", &spec) && spec.once && spec.batch);
+    assert(!spec.lateness);
+    assert(ipcam_timer_spec_parse("5 lateness once", &spec) && spec.once && spec.lateness && !spec.batch);
+    assert(ipcam_timer_spec_first_deadline(&spec, 1000) == 1000 + 5 * G_TIME_SPAN_SECOND);
+
+    for (i = 0; i < 100; i++)
+    {
+        assert(ipcam_timer_spec_parse("1 jitter=5s", &spec));
+        assert(spec.phase >= 0 && spec.phase < 5 * G_TIME_SPAN_SECOND);
+        assert(ipcam_timer_spec_first_deadline(&spec, 0) == G_TIME_SPAN_SECOND + spec.phase);
+        assert(ipcam_timer_spec_parse("200ms jitter", &spec));
+        assert(spec.phase >= 0 && spec.phase < 200 * MS);
+    }
+}
+
+static void test_next_deadline(void)
+{
+    IpcamTimerSpec spec;
+    gint64 d = 1000 * MS;
+
+    assert(ipcam_timer_spec_parse("100ms", &spec));
+    /* On time, and late within the period: the next one on the grid */
+    assert(ipcam_timer_spec_next_deadline(&spec, d, d) == d + 100 * MS);
+    assert(ipcam_timer_spec_next_deadline(&spec, d, d + 100 * MS) == d + 100 * MS);
+    assert(ipcam_timer_spec_next_deadline(&spec, d, d + 30 * MS) == d + 100 * MS);
+    /* Skip drops the missed periods and stays on the grid */
+    assert(ipcam_timer_spec_next_deadline(&spec, d, d + 350 * MS) == d + 400 * MS);
+    assert(ipcam_timer_spec_next_deadline(&spec, d, d + 400 * MS) == d + 400 * MS);
+
+    /* Catch-up fires once per missed period */
+    assert(ipcam_timer_spec_parse("100ms catchup", &spec));
+    assert(ipcam_timer_spec_next_deadline(&spec, d, d + 350 * MS) == d + 100 * MS);
+    assert(ipcam_timer_spec_next_deadline(&spec, d + 100 * MS, d + 350 * MS) == d + 200 * MS);
+    assert(ipcam_timer_spec_next_deadline(&spec, d + 300 * MS, d + 350 * MS) == d + 400 * MS);
+    /* Unless more than IPCAM_TIMER_MAX_CATCH_UP periods behind, then it skips */
+    assert(ipcam_timer_spec_next_deadline(&spec, d, d + 1650 * MS) == d + 100 * MS);
+    assert(ipcam_timer_spec_next_deadline(&spec, d, d + 1850 * MS) == d + 1900 * MS);
+
+    /* A one-shot timer has nothing left after it fired */
+    assert(ipcam_timer_spec_parse("100ms once", &spec));
+    assert(ipcam_timer_spec_next_deadline(&spec, d, d) == G_MAXINT64);
+}
+
+int main(int argc, char* argv[])
+{
+    test_parse();
+    test_next_deadline();
+    test_cron();
+
+    g_print("timer specs ok\n");
+    return 0;
+}